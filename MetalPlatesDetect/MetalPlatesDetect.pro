@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -25,13 +25,59 @@ DEFINES += QT_DEPRECATED_WARNINGS
 CONFIG += c++11
 
 SOURCES += \
+        channelscore.cpp \
+        configwatcher.cpp \
+        detectionlog.cpp \
+        fastmorphology.cpp \
+        framearena.cpp \
+        headlessprocessor.cpp \
+        labclahe.cpp \
+        latencygovernor.cpp \
         main.cpp \
+        maskcodec.cpp \
+        memoryaccounting.cpp \
+        metricsserver.cpp \
+        motiongate.cpp \
+        opencvkernels.cpp \
         opencvtoolwidgets.cpp \
-        testmetaldetectwindow.cpp
+        perfregression.cpp \
+        pipelinemetrics.cpp \
+        pipelineplan.cpp \
+        pipelinesettings.cpp \
+        platetracker.cpp \
+        shmring.cpp \
+        soamixture.cpp \
+        testmetaldetectwindow.cpp \
+        threadaffinity.cpp \
+        tracing.cpp
 
 HEADERS += \
+        channelscore.h \
+        configwatcher.h \
+        detectionlog.h \
+        fastmorphology.h \
+        framearena.h \
+        headlessprocessor.h \
+        labclahe.h \
+        latencygovernor.h \
+        maskcodec.h \
+        memoryaccounting.h \
+        metricsserver.h \
+        motiongate.h \
+        opencvkernels.h \
         opencvtoolwidgets.h \
-        testmetaldetectwindow.h
+        perfregression.h \
+        pipelinemetrics.h \
+        pipelineplan.h \
+        pipelinesettings.h \
+        platetracker.h \
+        shmring.h \
+        soamixture.h \
+        staticpipeline.h \
+        testmetaldetectwindow.h \
+        threadaffinity.h \
+        tracing.h \
+        triplebuffer.h
 
 FORMS += \
         testmetaldetectwindow.ui
@@ -48,6 +94,9 @@ linux-g++ {
     LIBS += -L$$(HOME)/OpenCV/lib/
 }
 
+# shm_open of the output ring
+unix:!macx: LIBS += -lrt
+
 LIBS += -lopencv_core$${OPENCV_VER} \
         -lopencv_imgproc$${OPENCV_VER} \
         -lopencv_imgcodecs$${OPENCV_VER} \
@@ -60,6 +109,14 @@ LIBS += -lopencv_core$${OPENCV_VER} \
         -lopencv_video$${OPENCV_VER} \
         -lopencv_videoio$${OPENCV_VER}
 
+# make perfcheck: times the fixed configurations against the baseline of this box's
+# CPU model in perf/, one file per model. The first run on a CPU model only records
+# its baseline and passes, so run it once before the change under test; record it
+# again with --perf-record after intended changes
+perfcheck.commands = ./$(TARGET) --headless --perf-check --perf-baseline $$PWD/perf
+perfcheck.depends = $(TARGET)
+QMAKE_EXTRA_TARGETS += perfcheck
+
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
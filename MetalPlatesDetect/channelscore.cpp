@@ -0,0 +1,124 @@
+#include "channelscore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+namespace OpencvKernels {
+
+namespace {
+
+const int histSize = 256;
+const int channelCount = colorModeCount * 3;
+const int stripeRows = 32;
+
+// separation matters most for the subtractor, contrast and entropy break ties on uniform scenes
+const double separationWeight = 0.6;
+const double contrastWeight = 0.25;
+const double entropyWeight = 0.15;
+
+typedef std::vector<uint32_t> Histograms;   // channelCount * histSize
+
+void accumulate(const cv::Mat &stripe, ColorMode mode, cv::Mat &converted, uint32_t *hists)
+{
+    const cv::Mat *planes = &stripe;
+    if (mode != modeBGR) {
+        bgr2mode(stripe, converted, mode);
+        planes = &converted;
+    }
+    uint32_t *h0 = hists + (mode * 3) * histSize;
+    uint32_t *h1 = h0 + histSize;
+    uint32_t *h2 = h1 + histSize;
+    for (int y = 0; y < planes->rows; y++) {
+        const uchar *p = planes->ptr<uchar>(y);
+        for (int x = 0; x < planes->cols; x++, p += 3) {
+            h0[p[0]]++;
+            h1[p[1]]++;
+            h2[p[2]]++;
+        }
+    }
+}
+
+class ScoreSweep : public cv::ParallelLoopBody
+{
+public:
+    ScoreSweep(const cv::Mat &frame, const cv::Mat &background, Histograms &frameHists, Histograms &backgroundHists) :
+        fFrame(frame), fBackground(background), fFrameHists(frameHists), fBackgroundHists(backgroundHists) {}
+
+    void operator()(const cv::Range &range) const override
+    {
+        Histograms frameHists(size_t(channelCount) * histSize, 0);
+        Histograms backgroundHists(fBackground.empty() ? 0 : size_t(channelCount) * histSize, 0);
+        cv::Mat converted;
+
+        for (int stripe = range.start; stripe < range.end; stripe++) {
+            int y0 = stripe * stripeRows;
+            int y1 = std::min(y0 + stripeRows, fFrame.rows);
+            cv::Mat frameStripe = fFrame.rowRange(y0, y1);
+            for (int mode = 0; mode < colorModeCount; mode++)
+                accumulate(frameStripe, ColorMode(mode), converted, frameHists.data());
+            if (!fBackground.empty()) {
+                cv::Mat backgroundStripe = fBackground.rowRange(y0, y1);
+                for (int mode = 0; mode < colorModeCount; mode++)
+                    accumulate(backgroundStripe, ColorMode(mode), converted, backgroundHists.data());
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(fMutex);
+        for (size_t i = 0; i < frameHists.size(); i++)
+            fFrameHists[i] += frameHists[i];
+        for (size_t i = 0; i < backgroundHists.size(); i++)
+            fBackgroundHists[i] += backgroundHists[i];
+    }
+
+private:
+    const cv::Mat &fFrame;
+    const cv::Mat &fBackground;
+    Histograms &fFrameHists;
+    Histograms &fBackgroundHists;
+    mutable std::mutex fMutex;
+};
+
+}
+
+std::vector<ChannelScore> scoreChannels(const cv::Mat &frame, const cv::Mat &background)
+{
+    std::vector<ChannelScore> scores;
+    if (frame.empty() || frame.type() != CV_8UC3)
+        return scores;
+    cv::Mat bg = (background.size() == frame.size() && background.type() == frame.type()) ? background : cv::Mat();
+
+    Histograms frameHists(size_t(channelCount) * histSize, 0);
+    Histograms backgroundHists(bg.empty() ? 0 : size_t(channelCount) * histSize, 0);
+    int stripes = (frame.rows + stripeRows - 1) / stripeRows;
+    cv::parallel_for_(cv::Range(0, stripes), ScoreSweep(frame, bg, frameHists, backgroundHists));
+
+    const double total = double(frame.total());
+    for (int c = 0; c < channelCount; c++) {
+        const uint32_t *hf = &frameHists[size_t(c) * histSize];
+        double mean = 0, sq = 0, entropy = 0, intersection = 0;
+        for (int i = 0; i < histSize; i++) {
+            double p = hf[i] / total;
+            mean += p * i;
+            sq += p * i * i;
+            if (p > 0)
+                entropy -= p * std::log2(p);
+            if (!bg.empty())
+                intersection += std::min(hf[i], backgroundHists[size_t(c) * histSize + i]) / total;
+        }
+
+        ChannelScore s;
+        s.mode = ColorMode(c / 3);
+        s.channel = c % 3;
+        s.contrast = std::min(std::sqrt(std::max(sq - mean * mean, 0.)) / 127.5, 1.);
+        s.entropy = entropy / 8;
+        s.separation = bg.empty() ? 0 : 1 - intersection;
+        s.score = separationWeight * s.separation + contrastWeight * s.contrast + entropyWeight * s.entropy;
+        scores.push_back(s);
+    }
+
+    std::stable_sort(scores.begin(), scores.end(), [](const ChannelScore &a, const ChannelScore &b) { return a.score > b.score; });
+    return scores;
+}
+
+} // namespace OpencvKernels
@@ -0,0 +1,30 @@
+#ifndef CHANNELSCORE_H
+#define CHANNELSCORE_H
+
+#include "opencvkernels.h"
+#include <vector>
+
+// Ranks every channel of every ColorMode by how well it shows plates against
+// the background. The frame and the background are swept once in horizontal
+// stripes; each stripe is converted to all modes while it is in cache and
+// feeds per-channel histograms, stripes run in parallel.
+namespace OpencvKernels {
+
+const int colorModeCount = 8;
+
+struct ChannelScore {
+    ColorMode   mode;
+    int         channel;        // 0..2 within the mode
+    double      contrast;       // standard deviation of the frame channel, 0..1
+    double      entropy;        // of the frame channel histogram, 0..1
+    double      separation;     // 1 - intersection of frame and background histograms, 0..1
+    double      score;          // weighted sum of the above, higher is better
+};
+
+// background may be empty or of another size, separation is 0 then.
+// The result is sorted best first.
+std::vector<ChannelScore> scoreChannels(const cv::Mat &frame, const cv::Mat &background);
+
+} // namespace OpencvKernels
+
+#endif // CHANNELSCORE_H
@@ -0,0 +1,144 @@
+#include "configwatcher.h"
+#include "tracing.h"
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QSettings>
+#include <opencv2/imgcodecs.hpp>
+
+namespace {
+
+const int settleMs = 300;
+
+// the groups a snapshot is made of, changes elsewhere need a restart
+const char * const toolGroups[] = {
+    PipelineSettings::ClaheGroup,
+    PipelineSettings::SeparateChannelsGroup,
+    PipelineSettings::BackgroundSubtractorGroup,
+    PipelineSettings::MorphologyGroup,
+    PipelineSettings::PlateTrackerGroup,
+    PipelineSettings::MotionGateGroup
+};
+
+}
+
+ConfigListener::ConfigListener(const QString &path, const std::function<void()> &changed, QObject *parent) :
+    QObject(parent),
+    fPath(QFileInfo(path).absoluteFilePath()),
+    fChanged(changed)
+{
+    // the directory as well, to see the file again after an editor replaced it
+    fWatcher.addPath(fPath);
+    fWatcher.addPath(QFileInfo(fPath).absolutePath());
+    fSettle.setSingleShot(true);
+    fSettle.setInterval(settleMs);
+    connect(&fWatcher, SIGNAL(fileChanged(QString)), this, SLOT(fileChanged()));
+    connect(&fWatcher, SIGNAL(directoryChanged(QString)), this, SLOT(fileChanged()));
+    connect(&fSettle, SIGNAL(timeout()), this, SLOT(settled()));
+}
+
+void ConfigListener::fileChanged()
+{
+    fSettle.start();
+}
+
+void ConfigListener::settled()
+{
+    if (!QFileInfo::exists(fPath))
+        return;
+    if (!fWatcher.files().contains(fPath))
+        fWatcher.addPath(fPath);
+    fChanged();
+}
+
+ConfigWatcher::ConfigWatcher(const QString &path, const ReferenceFn &reference, QObject *parent) :
+    QThread(parent),
+    fPath(path),
+    fReference(reference),
+    fGeneration(0)
+{
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+    stop();
+}
+
+void ConfigWatcher::start()
+{
+    stop();
+    // nothing runs on the watcher thread yet
+    reload();
+    QThread::start(QThread::LowPriority);
+}
+
+void ConfigWatcher::stop()
+{
+    if (isRunning()) {
+        quit();
+        wait();
+    }
+}
+
+void ConfigWatcher::run()
+{
+    // created here so the file watcher and the timer belong to this thread's event loop
+    ConfigListener listener(fPath, [this]() { reload(); });
+    exec();
+}
+
+void ConfigWatcher::reload()
+{
+    TRACE_SPAN("config reload");
+    QSettings settings(fPath, QSettings::IniFormat);
+    if (settings.status() != QSettings::NoError) {
+        qWarning() << "Can't read" << fPath << "- keeping the current parameters";
+        return;
+    }
+    QMap<QString, QVariantMap> groups;
+    foreach (const QString &group, settings.childGroups()) {
+        settings.beginGroup(group);
+        QVariantMap &values = groups[group];
+        foreach (const QString &key, settings.childKeys())
+            values[key] = settings.value(key);
+        settings.endGroup();
+    }
+
+    std::shared_ptr<const Snapshot> previous = current();
+    QStringList changed;
+    for (size_t i = 0; i < sizeof(toolGroups) / sizeof(toolGroups[0]); i++) {
+        if (!previous || groups.value(toolGroups[i]) != fGroups.value(toolGroups[i]))
+            changed << toolGroups[i];
+    }
+    fGroups = groups;
+    if (changed.isEmpty())
+        return;
+
+    std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+    snapshot->generation = generation() + 1;
+    snapshot->params = PipelineSettings::readToolParams(&settings);
+    snapshot->changedGroups = changed;
+    bool newImage = !previous || snapshot->params.backgroundImage != previous->params.backgroundImage;
+    if (newImage && !snapshot->params.backgroundImage.empty()) {
+        snapshot->background = cv::imread( snapshot->params.backgroundImage, cv::IMREAD_UNCHANGED );
+        if (snapshot->background.empty())
+            qWarning() << "Can't load background image" << QString::fromStdString(snapshot->params.backgroundImage);
+    }
+    if (snapshot->background.empty() && previous) {
+        newImage = false;
+        snapshot->background = previous->background;
+    }
+    const bool referenceChanged = newImage || changed.contains(PipelineSettings::ClaheGroup) ||
+                                  changed.contains(PipelineSettings::SeparateChannelsGroup);
+    snapshot->referenceGeneration = snapshot->generation;
+    if (referenceChanged && !snapshot->background.empty())
+        snapshot->reference = fReference(snapshot->params, snapshot->background);
+    else if (previous) {
+        snapshot->reference = previous->reference;
+        if (!referenceChanged)
+            snapshot->referenceGeneration = previous->referenceGeneration;
+    }
+
+    std::atomic_store(&fCurrent, std::shared_ptr<const Snapshot>(snapshot));
+    fGeneration.store(snapshot->generation, std::memory_order_release);
+}
@@ -0,0 +1,83 @@
+#ifndef CONFIGWATCHER_H
+#define CONFIGWATCHER_H
+
+#include <QFileSystemWatcher>
+#include <QMap>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+#include <QVariant>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <opencv2/core.hpp>
+#include "pipelinesettings.h"
+
+// Reports a settings file a short while after it stopped changing on disk,
+// so a half-written file is not read; editors replacing the file instead of
+// writing it are followed too.
+class ConfigListener : public QObject
+{
+    Q_OBJECT
+
+public:
+    ConfigListener(const QString &path, const std::function<void()> &changed, QObject *parent = nullptr);
+
+private:
+    QString fPath;
+    QFileSystemWatcher fWatcher;
+    QTimer fSettle;
+    std::function<void()> fChanged;
+
+private slots:
+    void fileChanged();
+    void settled();
+};
+
+// Hot reload of the tool parameters for the headless path, RCU style. The
+// file is read on the watcher's thread into a new snapshot, which is never
+// changed once published and replaces the current one with an atomic
+// pointer swap. The processing loop compares the generation between frames
+// and only then takes the newest snapshot, so reading the file, decoding
+// the background image and preparing the reference the subtractor is
+// primed with all stay off the frame path and no frame waits for them.
+class ConfigWatcher : public QThread
+{
+    Q_OBJECT
+
+public:
+    struct Snapshot {
+        uint64_t                    generation;
+        PipelineSettings::ToolParams params;
+        cv::Mat                     background;     // decoded backgroundImage
+        cv::Mat                     reference;      // background as it reaches the subtractor
+        uint64_t                    referenceGeneration;    // of the snapshot the reference was made for
+        QStringList                 changedGroups;  // since the previous snapshot
+    };
+    // runs on the watcher's thread, only when the background or what is in front of the subtractor changed
+    typedef std::function<cv::Mat(const PipelineSettings::ToolParams &params, const cv::Mat &background)> ReferenceFn;
+
+    ConfigWatcher(const QString &path, const ReferenceFn &reference, QObject *parent = nullptr);
+    ~ConfigWatcher();
+
+    // reads the file into the first snapshot and follows it
+    void start();
+    void stop();
+
+    uint64_t generation() const { return fGeneration.load(std::memory_order_acquire); }
+    std::shared_ptr<const Snapshot> current() const { return std::atomic_load(&fCurrent); }
+
+protected:
+    void run() override;
+
+private:
+    QString fPath;
+    ReferenceFn fReference;
+    std::shared_ptr<const Snapshot> fCurrent;
+    std::atomic<uint64_t> fGeneration;
+    QMap<QString, QVariantMap> fGroups;     // as last read, only used by the reading thread
+
+    void reload();
+};
+
+#endif // CONFIGWATCHER_H
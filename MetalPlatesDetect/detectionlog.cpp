@@ -0,0 +1,405 @@
+#include "detectionlog.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char fileMagic[8] = { 'M', 'P', 'D', 'E', 'T', 'L', 'O', 'G' };
+const uint32_t fileVersion = 1;
+const qint64 fileHeaderSize = 16;
+
+const uint32_t dataMagic = 0x4b4c4244;      // "DBLK"
+const uint32_t indexMagic = 0x4b4c4249;     // "IBLK"
+const uint32_t tailMagic = 0x4c494154;      // "TAIL"
+
+// data block: magic, rows, size, min time, max time, stream mask, reserved, then the columns
+const qint64 dataHeaderSize = 48;
+// index block: magic, entries, size, previous index, reserved, then the entries and the tail
+const qint64 indexHeaderSize = 32;
+// offset, min time, max time, stream mask, rows, reserved
+const qint64 indexEntrySize = 40;
+// magic, reserved, offset of the index block
+const qint64 tailSize = 16;
+// time, params hash, area, stream, x, y, width, height, algo
+const qint64 rowSize = 8 + 8 + 4 + 5 * 2 + 1;
+
+qint64 dataBlockSize(uint32_t rows)
+{
+    return (dataHeaderSize + rowSize * rows + 7) & ~qint64(7);
+}
+
+qint64 indexBlockSize(uint32_t entries)
+{
+    return indexHeaderSize + indexEntrySize * entries + tailSize;
+}
+
+template <typename T>
+T readValue(const uchar *p)
+{
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+template <typename T>
+void writeValue(uchar *p, T value)
+{
+    memcpy(p, &value, sizeof(T));
+}
+
+// column offsets in a data block, the wide columns first so every column stays aligned
+struct Columns {
+    explicit Columns(uint32_t rows) :
+        time(dataHeaderSize),
+        hash(time + 8 * qint64(rows)),
+        area(hash + 8 * qint64(rows)),
+        stream(area + 4 * qint64(rows)),
+        x(stream + 2 * qint64(rows)),
+        y(x + 2 * qint64(rows)),
+        width(y + 2 * qint64(rows)),
+        height(width + 2 * qint64(rows)),
+        algo(height + 2 * qint64(rows))
+    {}
+    qint64 time, hash, area, stream, x, y, width, height, algo;
+};
+
+bool validHeader(const uchar *data, qint64 size)
+{
+    return size >= fileHeaderSize && memcmp(data, fileMagic, sizeof(fileMagic)) == 0 && readValue<uint32_t>(data + 8) == fileVersion;
+}
+
+// false if there is no complete data block at the offset
+bool readDataBlock(const uchar *data, qint64 size, qint64 offset, DetectionBlock &block)
+{
+    if (offset + dataHeaderSize > size || readValue<uint32_t>(data + offset) != dataMagic)
+        return false;
+    const uint32_t rows = readValue<uint32_t>(data + offset + 4);
+    const uint64_t blockSize = readValue<uint64_t>(data + offset + 8);
+    if (rows == 0 || qint64(blockSize) != dataBlockSize(rows) || offset + qint64(blockSize) > size)
+        return false;
+    block.offset = uint64_t(offset);
+    block.rows = rows;
+    block.minTimeUs = readValue<int64_t>(data + offset + 16);
+    block.maxTimeUs = readValue<int64_t>(data + offset + 24);
+    block.streamMask = readValue<uint64_t>(data + offset + 32);
+    return true;
+}
+
+// false if there is no complete index block at the offset; entries may be null
+bool readIndexBlock(const uchar *data, qint64 size, qint64 offset, uint64_t &previous, std::vector<DetectionBlock> *entries)
+{
+    if (offset + indexHeaderSize > size || readValue<uint32_t>(data + offset) != indexMagic)
+        return false;
+    const uint32_t count = readValue<uint32_t>(data + offset + 4);
+    const uint64_t blockSize = readValue<uint64_t>(data + offset + 8);
+    if (qint64(blockSize) != indexBlockSize(count) || offset + qint64(blockSize) > size)
+        return false;
+    previous = readValue<uint64_t>(data + offset + 16);
+    if (entries) {
+        entries->resize(count);
+        for (uint32_t i = 0; i < count; i++) {
+            const uchar *entry = data + offset + indexHeaderSize + indexEntrySize * i;
+            DetectionBlock &block = (*entries)[i];
+            block.offset = readValue<uint64_t>(entry);
+            block.minTimeUs = readValue<int64_t>(entry + 8);
+            block.maxTimeUs = readValue<int64_t>(entry + 16);
+            block.streamMask = readValue<uint64_t>(entry + 24);
+            block.rows = readValue<uint32_t>(entry + 32);
+        }
+    }
+    return true;
+}
+
+// Walks the blocks behind the file header, returns the end of the last complete one.
+// The data blocks go to blocks, the ones behind the last index also to unindexed.
+qint64 walkBlocks(const uchar *data, qint64 size, std::vector<DetectionBlock> &blocks,
+                  std::vector<DetectionBlock> &unindexed, uint64_t &lastIndex)
+{
+    qint64 offset = fileHeaderSize;
+    lastIndex = 0;
+    for (;;) {
+        DetectionBlock block;
+        uint64_t previous;
+        if (readDataBlock(data, size, offset, block)) {
+            blocks.push_back(block);
+            unindexed.push_back(block);
+            offset += dataBlockSize(block.rows);
+        }
+        else if (readIndexBlock(data, size, offset, previous, nullptr)) {
+            lastIndex = uint64_t(offset);
+            unindexed.clear();
+            offset += qint64(readValue<uint64_t>(data + offset + 8));
+        }
+        else
+            return offset;
+    }
+}
+
+// offset of the index block ending the file, 0 if the file does not end with one
+uint64_t tailIndex(const uchar *data, qint64 size)
+{
+    if (size < fileHeaderSize + indexBlockSize(0))
+        return 0;
+    const uchar *tail = data + size - tailSize;
+    if (readValue<uint32_t>(tail) != tailMagic)
+        return 0;
+    const uint64_t index = readValue<uint64_t>(tail + 8);
+    uint64_t previous;
+    if (index < uint64_t(fileHeaderSize) || index >= uint64_t(size) ||
+            !readIndexBlock(data, size, qint64(index), previous, nullptr) ||
+            index + readValue<uint64_t>(data + index + 8) != uint64_t(size))
+        return 0;
+    return index;
+}
+
+}
+
+DetectionLogWriter::DetectionLogWriter() :
+    fPreviousIndex(0),
+    fFlushIntervalUs(10 * 1000 * 1000)
+{
+}
+
+bool DetectionLogWriter::open(const QString &path)
+{
+    close();
+    fFile.setFileName(path);
+    if (!fFile.open(QIODevice::ReadWrite))
+        return false;
+    fPreviousIndex = 0;
+    fUnindexed.clear();
+
+    const qint64 size = fFile.size();
+    if (size == 0) {
+        uchar header[fileHeaderSize] = {};
+        memcpy(header, fileMagic, sizeof(fileMagic));
+        writeValue(header + 8, fileVersion);
+        if (fFile.write(reinterpret_cast<const char*>(header), fileHeaderSize) != fileHeaderSize) {
+            fFile.close();
+            return false;
+        }
+        return true;
+    }
+
+    uchar *data = fFile.map(0, size);
+    if (!data || !validHeader(data, size)) {
+        if (data)
+            fFile.unmap(data);
+        fFile.close();
+        return false;
+    }
+    qint64 end = size;
+    fPreviousIndex = tailIndex(data, size);
+    if (!fPreviousIndex) {
+        // the last writer died: its complete blocks go into the next index, a torn one is cut off
+        std::vector<DetectionBlock> blocks;
+        end = walkBlocks(data, size, blocks, fUnindexed, fPreviousIndex);
+    }
+    fFile.unmap(data);
+    if ((end < size && !fFile.resize(end)) || !fFile.seek(end)) {
+        fFile.close();
+        return false;
+    }
+    return true;
+}
+
+void DetectionLogWriter::append(const Detection &detection)
+{
+    fRows.push_back(detection);
+    if (int(fRows.size()) >= blockRows || (fFlushIntervalUs > 0 && detection.timeUs - fRows.front().timeUs >= fFlushIntervalUs))
+        flush();
+}
+
+bool DetectionLogWriter::flush()
+{
+    if (!isOpen())
+        return false;
+    if (fRows.empty())
+        return true;
+
+    const uint32_t rows = uint32_t(fRows.size());
+    const qint64 size = dataBlockSize(rows);
+    fBlock.fill(0, int(size));
+    uchar *p = reinterpret_cast<uchar*>(fBlock.data());
+    const Columns columns(rows);
+
+    DetectionBlock block;
+    block.offset = uint64_t(fFile.pos());
+    block.rows = rows;
+    block.minTimeUs = fRows[0].timeUs;
+    block.maxTimeUs = fRows[0].timeUs;
+    block.streamMask = 0;
+    for (uint32_t i = 0; i < rows; i++) {
+        const Detection &d = fRows[i];
+        block.minTimeUs = std::min(block.minTimeUs, d.timeUs);
+        block.maxTimeUs = std::max(block.maxTimeUs, d.timeUs);
+        block.streamMask |= uint64_t(1) << (d.stream % 64);
+        writeValue(p + columns.time + 8 * i, d.timeUs);
+        writeValue(p + columns.hash + 8 * i, d.paramsHash);
+        writeValue(p + columns.area + 4 * i, d.area);
+        writeValue(p + columns.stream + 2 * i, d.stream);
+        writeValue(p + columns.x + 2 * i, d.x);
+        writeValue(p + columns.y + 2 * i, d.y);
+        writeValue(p + columns.width + 2 * i, d.width);
+        writeValue(p + columns.height + 2 * i, d.height);
+        p[columns.algo + i] = d.algo;
+    }
+    writeValue(p, dataMagic);
+    writeValue(p + 4, rows);
+    writeValue(p + 8, uint64_t(size));
+    writeValue(p + 16, block.minTimeUs);
+    writeValue(p + 24, block.maxTimeUs);
+    writeValue(p + 32, block.streamMask);
+    fRows.clear();
+
+    if (fFile.write(fBlock) != size || !fFile.flush())
+        return false;
+    fUnindexed.push_back(block);
+    if (int(fUnindexed.size()) >= indexEvery)
+        return writeIndex();
+    return true;
+}
+
+bool DetectionLogWriter::writeIndex()
+{
+    if (fUnindexed.empty())
+        return true;
+    const uint32_t entries = uint32_t(fUnindexed.size());
+    const qint64 size = indexBlockSize(entries);
+    const uint64_t offset = uint64_t(fFile.pos());
+    fBlock.fill(0, int(size));
+    uchar *p = reinterpret_cast<uchar*>(fBlock.data());
+
+    writeValue(p, indexMagic);
+    writeValue(p + 4, entries);
+    writeValue(p + 8, uint64_t(size));
+    writeValue(p + 16, fPreviousIndex);
+    for (uint32_t i = 0; i < entries; i++) {
+        uchar *entry = p + indexHeaderSize + indexEntrySize * i;
+        const DetectionBlock &block = fUnindexed[i];
+        writeValue(entry, block.offset);
+        writeValue(entry + 8, block.minTimeUs);
+        writeValue(entry + 16, block.maxTimeUs);
+        writeValue(entry + 24, block.streamMask);
+        writeValue(entry + 32, block.rows);
+    }
+    uchar *tail = p + size - tailSize;
+    writeValue(tail, tailMagic);
+    writeValue(tail + 8, offset);
+
+    if (fFile.write(fBlock) != size || !fFile.flush())
+        return false;
+    fPreviousIndex = offset;
+    fUnindexed.clear();
+    return true;
+}
+
+void DetectionLogWriter::close()
+{
+    if (!isOpen())
+        return;
+    flush();
+    writeIndex();
+    fFile.close();
+}
+
+DetectionLogReader::DetectionLogReader() :
+    fData(nullptr),
+    fSize(0),
+    fIndexed(false)
+{
+}
+
+bool DetectionLogReader::open(const QString &path)
+{
+    close();
+    fFile.setFileName(path);
+    if (!fFile.open(QIODevice::ReadOnly))
+        return false;
+    fSize = fFile.size();
+    fData = fSize > 0 ? fFile.map(0, fSize) : nullptr;
+    if (!fData || !validHeader(fData, fSize)) {
+        close();
+        return false;
+    }
+
+    // the chain runs backwards, every index lists the blocks in front of it
+    uint64_t index = tailIndex(fData, fSize);
+    fIndexed = index != 0;
+    std::vector<std::vector<DetectionBlock> > indexes;
+    uint64_t limit = uint64_t(fSize);
+    while (fIndexed && index) {
+        uint64_t previous;
+        std::vector<DetectionBlock> entries;
+        fIndexed = index < limit && readIndexBlock(fData, fSize, qint64(index), previous, &entries);
+        for (size_t i = 0; i < entries.size() && fIndexed; i++)
+            fIndexed = entries[i].rows > 0 && entries[i].offset + uint64_t(dataBlockSize(entries[i].rows)) <= index;
+        indexes.push_back(entries);
+        limit = index;
+        index = previous;
+    }
+    if (fIndexed) {
+        for (size_t i = indexes.size(); i-- > 0; )
+            fBlocks.insert(fBlocks.end(), indexes[i].begin(), indexes[i].end());
+    }
+    else {
+        std::vector<DetectionBlock> unindexed;
+        uint64_t lastIndex;
+        walkBlocks(fData, fSize, fBlocks, unindexed, lastIndex);
+    }
+    return true;
+}
+
+void DetectionLogReader::close()
+{
+    if (fData)
+        fFile.unmap(fData);
+    fData = nullptr;
+    fSize = 0;
+    fIndexed = false;
+    fBlocks.clear();
+    if (fFile.isOpen())
+        fFile.close();
+}
+
+uint64_t DetectionLogReader::detectionCount() const
+{
+    uint64_t count = 0;
+    for (size_t i = 0; i < fBlocks.size(); i++)
+        count += fBlocks[i].rows;
+    return count;
+}
+
+std::vector<Detection> DetectionLogReader::query(int64_t fromUs, int64_t toUs, int stream) const
+{
+    std::vector<Detection> result;
+    const uint64_t streamBit = stream >= 0 ? uint64_t(1) << (stream % 64) : ~uint64_t(0);
+    for (size_t b = 0; b < fBlocks.size(); b++) {
+        const DetectionBlock &block = fBlocks[b];
+        if (block.maxTimeUs < fromUs || block.minTimeUs >= toUs || !(block.streamMask & streamBit))
+            continue;
+
+        // blocks start 8-byte aligned in a page aligned mapping, the columns can be read in place
+        const uchar *p = fData + block.offset;
+        const Columns columns(block.rows);
+        const int64_t *times = reinterpret_cast<const int64_t*>(p + columns.time);
+        const uint16_t *streams = reinterpret_cast<const uint16_t*>(p + columns.stream);
+        for (uint32_t i = 0; i < block.rows; i++) {
+            if (times[i] < fromUs || times[i] >= toUs || (stream >= 0 && streams[i] != stream))
+                continue;
+            Detection d;
+            d.timeUs = times[i];
+            d.stream = streams[i];
+            d.paramsHash = readValue<uint64_t>(p + columns.hash + 8 * i);
+            d.area = readValue<uint32_t>(p + columns.area + 4 * i);
+            d.x = readValue<uint16_t>(p + columns.x + 2 * i);
+            d.y = readValue<uint16_t>(p + columns.y + 2 * i);
+            d.width = readValue<uint16_t>(p + columns.width + 2 * i);
+            d.height = readValue<uint16_t>(p + columns.height + 2 * i);
+            d.algo = p[columns.algo + i];
+            result.push_back(d);
+        }
+    }
+    return result;
+}
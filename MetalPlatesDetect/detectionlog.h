@@ -0,0 +1,102 @@
+#ifndef DETECTIONLOG_H
+#define DETECTIONLOG_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <cstdint>
+#include <vector>
+
+// Append-only binary log of the plate detections, kept for months for
+// traceability. Detections are buffered and written in blocks, every column
+// of a block stored contiguously; the block header carries the time range and
+// the streams of the block, so a query only reads the columns of blocks that
+// can match. Every indexEvery blocks and on close an index block listing the
+// blocks since the previous index is appended, linked to the previous one and
+// ending with a tail that points at it. A reader finding the tail at the end
+// of the file follows the index chain, otherwise (the log is being written or
+// the writer died) it walks the block headers. A writer opening a log that
+// does not end in a tail cuts off a torn block and indexes the rest first.
+// All values are little endian and naturally aligned.
+
+struct Detection {
+    int64_t     timeUs;         // since the epoch
+    uint16_t    stream;
+    uint16_t    x;
+    uint16_t    y;
+    uint16_t    width;
+    uint16_t    height;
+    uint32_t    area;           // foreground pixels
+    uint8_t     algo;           // OpencvKernels::BackgroundAlgo
+    uint64_t    paramsHash;     // BackgroundSubtractorParams::hash()
+};
+
+struct DetectionBlock {
+    uint64_t    offset;
+    int64_t     minTimeUs;
+    int64_t     maxTimeUs;
+    uint64_t    streamMask;     // bit stream % 64
+    uint32_t    rows;
+};
+
+class DetectionLogWriter
+{
+public:
+    enum { blockRows = 4096, indexEvery = 16 };
+
+    DetectionLogWriter();
+    ~DetectionLogWriter() { close(); }
+
+    // creates the log or appends to it
+    bool open(const QString &path);
+    bool isOpen() const { return fFile.isOpen(); }
+    // a block is written when it is full or holds detections older than the flush interval
+    void append(const Detection &detection);
+    void setFlushIntervalMs(int ms) { fFlushIntervalUs = int64_t(ms) * 1000; }
+    bool flush();
+    // flushes and writes the index
+    void close();
+
+private:
+    QFile fFile;
+    std::vector<Detection> fRows;
+    std::vector<DetectionBlock> fUnindexed;
+    uint64_t fPreviousIndex;
+    int64_t fFlushIntervalUs;
+    QByteArray fBlock;
+
+    bool writeIndex();
+
+    DetectionLogWriter(const DetectionLogWriter&);
+    DetectionLogWriter &operator=(const DetectionLogWriter&);
+};
+
+class DetectionLogReader
+{
+public:
+    DetectionLogReader();
+    ~DetectionLogReader() { close(); }
+
+    // maps the log, it may still be written
+    bool open(const QString &path);
+    void close();
+    // false when the blocks had to be found by walking the file
+    bool indexed() const { return fIndexed; }
+
+    const std::vector<DetectionBlock> &blocks() const { return fBlocks; }
+    uint64_t detectionCount() const;
+    // detections with fromUs <= timeUs < toUs of one stream, or of all with -1, in log order
+    std::vector<Detection> query(int64_t fromUs, int64_t toUs, int stream = -1) const;
+
+private:
+    QFile fFile;
+    uchar *fData;
+    qint64 fSize;
+    bool fIndexed;
+    std::vector<DetectionBlock> fBlocks;
+
+    DetectionLogReader(const DetectionLogReader&);
+    DetectionLogReader &operator=(const DetectionLogReader&);
+};
+
+#endif // DETECTIONLOG_H
@@ -0,0 +1,275 @@
+#include "fastmorphology.h"
+#include "tracing.h"
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace OpencvKernels {
+
+namespace {
+
+struct MinOp {
+    static uchar identity() { return 255; }
+    static uchar apply(uchar a, uchar b) { return std::min(a, b); }
+};
+
+struct MaxOp {
+    static uchar identity() { return 0; }
+    static uchar apply(uchar a, uchar b) { return std::max(a, b); }
+};
+
+// Horizontal pass: every row is padded with the identity value and split in
+// blocks of the kernel width, g holds the running min/max from the left of
+// each block and h from the right. Any window then spans at most two blocks.
+template <typename Op>
+class RowPass : public cv::ParallelLoopBody
+{
+public:
+    RowPass(const cv::Mat &src, cv::Mat &dst, int k) : fSrc(src), fDst(dst), fK(k) {}
+
+    void operator()(const cv::Range &range) const override
+    {
+        const int cols = fSrc.cols;
+        const int anchor = fK / 2;
+        const int n = cols + fK - 1;
+        std::vector<uchar> f(n + fK), g(n + fK), h(n + fK);
+        std::fill(f.begin(), f.end(), Op::identity());
+
+        for (int y = range.start; y < range.end; y++) {
+            const uchar *s = fSrc.ptr<uchar>(y);
+            std::copy(s, s + cols, f.begin() + anchor);
+
+            for (int i = 0; i < n; i++)
+                g[i] = (i % fK) ? Op::apply(g[i-1], f[i]) : f[i];
+            for (int i = n - 1; i >= 0; i--)
+                h[i] = ((i + 1) % fK && i + 1 < n) ? Op::apply(h[i+1], f[i]) : f[i];
+
+            uchar *d = fDst.ptr<uchar>(y);
+            for (int x = 0; x < cols; x++)
+                d[x] = Op::apply(h[x], g[x + fK - 1]);
+        }
+    }
+
+private:
+    const cv::Mat &fSrc;
+    cv::Mat &fDst;
+    int fK;
+};
+
+// Vertical pass: the same recurrence along columns, done on whole row
+// segments so the inner loops run over contiguous memory and vectorize.
+template <typename Op>
+class ColumnPass : public cv::ParallelLoopBody
+{
+public:
+    ColumnPass(const cv::Mat &src, cv::Mat &dst, int k) : fSrc(src), fDst(dst), fK(k) {}
+
+    void operator()(const cv::Range &range) const override
+    {
+        const int rows = fSrc.rows;
+        const int anchor = fK / 2;
+        const int n = rows + fK - 1;
+        const int width = range.end - range.start;
+        std::vector<uchar> g(size_t(n) * width), h(size_t(n) * width);
+        std::vector<uchar> pad(width, Op::identity());
+
+        for (int i = 0; i < n; i++) {
+            int y = i - anchor;
+            const uchar *f = (y >= 0 && y < rows) ? fSrc.ptr<uchar>(y) + range.start : pad.data();
+            uchar *gi = &g[size_t(i) * width];
+            if (i % fK) {
+                const uchar *gp = gi - width;
+                for (int x = 0; x < width; x++)
+                    gi[x] = Op::apply(gp[x], f[x]);
+            }
+            else
+                std::copy(f, f + width, gi);
+        }
+        for (int i = n - 1; i >= 0; i--) {
+            int y = i - anchor;
+            const uchar *f = (y >= 0 && y < rows) ? fSrc.ptr<uchar>(y) + range.start : pad.data();
+            uchar *hi = &h[size_t(i) * width];
+            if ((i + 1) % fK && i + 1 < n) {
+                const uchar *hn = hi + width;
+                for (int x = 0; x < width; x++)
+                    hi[x] = Op::apply(hn[x], f[x]);
+            }
+            else
+                std::copy(f, f + width, hi);
+        }
+
+        for (int y = 0; y < rows; y++) {
+            const uchar *hy = &h[size_t(y) * width];
+            const uchar *gy = &g[size_t(y + fK - 1) * width];
+            uchar *d = fDst.ptr<uchar>(y) + range.start;
+            for (int x = 0; x < width; x++)
+                d[x] = Op::apply(hy[x], gy[x]);
+        }
+    }
+
+private:
+    const cv::Mat &fSrc;
+    cv::Mat &fDst;
+    int fK;
+};
+
+template <typename Op>
+void rectFilter(const cv::Mat &src, cv::Mat &dst, cv::Size kernel)
+{
+    CV_Assert(src.type() == CV_8UC1);
+    kernel.width = std::max(kernel.width, 1);
+    kernel.height = std::max(kernel.height, 1);
+    if (kernel.width == 1 && kernel.height == 1) {
+        src.copyTo(dst);
+        return;
+    }
+
+    cv::Mat horizontal;
+    if (kernel.width > 1) {
+        horizontal.create(src.size(), CV_8UC1);
+        cv::parallel_for_(cv::Range(0, src.rows), RowPass<Op>(src, horizontal, kernel.width));
+    }
+    else
+        horizontal = src;
+
+    if (kernel.height > 1) {
+        // the column pass reads whole rows of its source, it can't run in place
+        cv::Mat columnSrc = horizontal.data == dst.data ? horizontal.clone() : horizontal;
+        dst.create(src.size(), CV_8UC1);
+        // the columns are handed out in units of 64 bytes, a cache line: the inner loops
+        // run over whole vector widths and two threads only share the lines of dst at the
+        // border of their ranges; a thread's scratch covers all the units of its range
+        const int stripe = 64;
+        int stripes = (src.cols + stripe - 1) / stripe;
+        cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range &range) {
+            cv::Range columns(range.start * stripe, std::min(range.end * stripe, src.cols));
+            ColumnPass<Op>(columnSrc, dst, kernel.height)(columns);
+        });
+    }
+    else
+        horizontal.copyTo(dst);
+}
+
+} // namespace
+
+MorphologyParams::MorphologyParams() :
+    binarize(true),
+    open(true),
+    close(true),
+    fillHoles(false),
+    shape(morphRect),
+    width(5),
+    height(5)
+{
+}
+
+cv::Size MorphologyParams::kernelSize() const
+{
+    switch (shape) {
+    case morphHorizontalLine:
+        return cv::Size(width, 1);
+    case morphVerticalLine:
+        return cv::Size(1, height);
+    case morphRect:
+    default:
+        return cv::Size(width, height);
+    }
+}
+
+cv::Size MorphologyParams::reach() const
+{
+    // every erode or dilate looks kernel / 2 pixels to one side at most
+    const int passes = (open ? 2 : 0) + (close ? 2 : 0);
+    const cv::Size kernel = kernelSize();
+    return cv::Size(passes * (std::max(kernel.width, 1) / 2), passes * (std::max(kernel.height, 1) / 2));
+}
+
+bool MorphologyParams::supportsRegions() const
+{
+    return !fillHoles;
+}
+
+void erodeRect(const cv::Mat &src, cv::Mat &dst, cv::Size kernel)
+{
+    rectFilter<MinOp>(src, dst, kernel);
+}
+
+void dilateRect(const cv::Mat &src, cv::Mat &dst, cv::Size kernel)
+{
+    rectFilter<MaxOp>(src, dst, kernel);
+}
+
+void openRect(const cv::Mat &src, cv::Mat &dst, cv::Size kernel)
+{
+    cv::Mat eroded;
+    erodeRect(src, eroded, kernel);
+    dilateRect(eroded, dst, kernel);
+}
+
+void closeRect(const cv::Mat &src, cv::Mat &dst, cv::Size kernel)
+{
+    cv::Mat dilated;
+    dilateRect(src, dilated, kernel);
+    erodeRect(dilated, dst, kernel);
+}
+
+void fillHoles(const cv::Mat &src, cv::Mat &dst)
+{
+    CV_Assert(src.type() == CV_8UC1);
+    // one pixel frame of background connects every border region to the seed
+    cv::Mat flooded(src.rows + 2, src.cols + 2, CV_8UC1, cv::Scalar(0));
+    src.copyTo(flooded(cv::Rect(1, 1, src.cols, src.rows)));
+    cv::floodFill(flooded, cv::Point(0, 0), cv::Scalar(255));
+
+    cv::Mat holes;
+    cv::bitwise_not(flooded(cv::Rect(1, 1, src.cols, src.rows)), holes);
+    cv::bitwise_or(src, holes, dst);
+}
+
+void cleanupMask(const cv::Mat &src, cv::Mat &dst, const MorphologyParams &params)
+{
+    TRACE_SPAN("cleanupMask");
+    cv::Size kernel = params.kernelSize();
+    cv::Mat mask;
+    if (params.binarize)
+        cv::threshold(src, mask, 127, 255, cv::THRESH_BINARY);
+    else
+        mask = src;
+
+    if (params.open) {
+        cv::Mat opened;
+        openRect(mask, opened, kernel);
+        mask = opened;
+    }
+    if (params.close) {
+        cv::Mat closed;
+        closeRect(mask, closed, kernel);
+        mask = closed;
+    }
+    if (params.fillHoles)
+        fillHoles(mask, dst);
+    else
+        mask.copyTo(dst);
+}
+
+void cleanupMaskRegion(const cv::Mat &src, cv::Mat &dst, const MorphologyParams &params)
+{
+    CV_Assert(params.supportsRegions() && src.size() == dst.size());
+    // clamped to the whole mask, whose border pads the same way when it is cleaned at once
+    const cv::Size reach = params.reach();
+    cv::Size whole;
+    cv::Point offset;
+    src.locateROI(whole, offset);
+    const cv::Rect region(offset, src.size());
+    const cv::Rect grown = cv::Rect(offset.x - reach.width, offset.y - reach.height,
+                                    src.cols + 2 * reach.width, src.rows + 2 * reach.height) & cv::Rect(cv::Point(), whole);
+    cv::Mat context = src;
+    context.adjustROI(region.y - grown.y, grown.br().y - region.br().y, region.x - grown.x, grown.br().x - region.br().x);
+
+    cv::Mat cleaned;
+    cleanupMask(context, cleaned, params);
+    cleaned(cv::Rect(region.tl() - grown.tl(), region.size())).copyTo(dst);
+}
+
+} // namespace OpencvKernels
@@ -0,0 +1,50 @@
+#ifndef FASTMORPHOLOGY_H
+#define FASTMORPHOLOGY_H
+
+#include <opencv2/core.hpp>
+
+// Mask cleanup with rectangular and line structuring elements.
+// Erosion and dilation use the van Herk/Gil-Werman running min/max, so the
+// cost per pixel does not depend on the kernel size. Only CV_8UC1 masks are
+// supported, pixels outside the image never affect the result.
+namespace OpencvKernels {
+
+enum MorphShape {
+    morphRect,
+    morphHorizontalLine,
+    morphVerticalLine
+};
+
+struct MorphologyParams {
+    MorphologyParams();
+
+    bool        binarize;   // drop MOG2/KNN shadow values before cleanup
+    bool        open;
+    bool        close;
+    bool        fillHoles;
+    MorphShape  shape;
+    int         width;
+    int         height;
+
+    cv::Size kernelSize() const;
+    // how far the open and the close together look from a pixel, in each direction
+    cv::Size reach() const;
+    // true if cleanupMaskRegion() gives the whole-mask result; filling holes needs the image border
+    bool supportsRegions() const;
+};
+
+void erodeRect(const cv::Mat &src, cv::Mat &dst, cv::Size kernel);
+void dilateRect(const cv::Mat &src, cv::Mat &dst, cv::Size kernel);
+void openRect(const cv::Mat &src, cv::Mat &dst, cv::Size kernel);
+void closeRect(const cv::Mat &src, cv::Mat &dst, cv::Size kernel);
+// fills background regions that are not connected to the image border
+void fillHoles(const cv::Mat &src, cv::Mat &dst);
+
+void cleanupMask(const cv::Mat &src, cv::Mat &dst, const MorphologyParams &params);
+// src and dst are regions of whole masks (see cv::Mat::locateROI()): the cleanup reads the
+// mask of src grown by reach() and writes only the region of dst
+void cleanupMaskRegion(const cv::Mat &src, cv::Mat &dst, const MorphologyParams &params);
+
+} // namespace OpencvKernels
+
+#endif // FASTMORPHOLOGY_H
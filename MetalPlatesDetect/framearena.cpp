@@ -0,0 +1,189 @@
+#include "framearena.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+const size_t hugePageSize = size_t(2) << 20;
+const size_t pageSize = 4096;
+
+size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// returns null if nothing could be reserved, hugePages tells what was used
+uchar *reserveRegion(size_t size, bool &hugePages)
+{
+    void *p = nullptr;
+#ifdef _WIN32
+    if (hugePages && GetLargePageMinimum() && size % GetLargePageMinimum() == 0)
+        p = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    hugePages = p != nullptr;
+    if (!p)
+        p = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    bool wanted = hugePages;
+    hugePages = false;
+#ifdef MAP_HUGETLB
+    if (wanted) {
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        hugePages = p != MAP_FAILED;
+        if (!hugePages)
+            p = nullptr;
+    }
+#endif
+    if (!p) {
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return nullptr;
+#ifdef MADV_HUGEPAGE
+        // transparent huge pages, taken when the pages are touched below
+        if (wanted)
+            madvise(p, size, MADV_HUGEPAGE);
+#endif
+    }
+#endif
+    if (!p)
+        return nullptr;
+
+    volatile uchar *bytes = static_cast<uchar*>(p);
+    for (size_t offset = 0; offset < size; offset += pageSize)
+        bytes[offset] = 0;
+    return static_cast<uchar*>(p);
+}
+
+}
+
+FrameArenaAllocator::Params::Params() :
+    enabled(false),
+    sizeMB(256),
+    minBufferKB(256),
+    hugePages(false)
+{
+}
+
+FrameArenaAllocator &FrameArenaAllocator::instance()
+{
+    // never destroyed, buffers from the arena may be released during static destruction
+    static FrameArenaAllocator *arena = new FrameArenaAllocator;
+    return *arena;
+}
+
+FrameArenaAllocator::FrameArenaAllocator() :
+    fStd(cv::Mat::getStdAllocator()),
+    fBase(nullptr),
+    fSize(0),
+    fHugePages(false),
+    fMinBytes(0),
+    fTop(0)
+{
+}
+
+bool FrameArenaAllocator::install(const Params &params)
+{
+    if (isInstalled())
+        return true;
+    size_t size = alignUp(size_t(std::max(params.sizeMB, 1)) << 20, hugePageSize);
+    bool hugePages = params.hugePages;
+    uchar *base = reserveRegion(size, hugePages);
+    if (!base)
+        return false;
+
+    fBase = base;
+    fSize = size;
+    fHugePages = hugePages;
+    fMinBytes = size_t(std::max(params.minBufferKB, 0)) << 10;
+    cv::Mat::setDefaultAllocator(this);
+    return true;
+}
+
+FrameArenaAllocator::Stats FrameArenaAllocator::stats() const
+{
+    std::lock_guard<std::mutex> lock(fMutex);
+    return fStats;
+}
+
+uchar *FrameArenaAllocator::takeBlock(size_t size) const
+{
+    size = alignUp(size, alignment);
+    std::lock_guard<std::mutex> lock(fMutex);
+
+    // a released block of about the size, else fresh space, else any larger block
+    std::multimap<size_t, uchar*>::iterator it = fFree.lower_bound(size);
+    uchar *block = nullptr;
+    size_t blockSize = size;
+    if (it != fFree.end() && (it->first <= size + size / 4 || fTop + size > fSize)) {
+        block = it->second;
+        blockSize = it->first;
+        fFree.erase(it);
+    }
+    else if (fTop + size <= fSize) {
+        block = fBase + fTop;
+        fTop += size;
+    }
+    else {
+        fStats.fallbacks++;
+        return nullptr;
+    }
+
+    fUsed[block] = blockSize;
+    fStats.served++;
+    fStats.usedBytes += blockSize;
+    fStats.peakBytes = std::max(fStats.peakBytes, fStats.usedBytes);
+    return block;
+}
+
+cv::UMatData *FrameArenaAllocator::allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                                            cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const
+{
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--)
+        total *= sizes[i];
+    uchar *block = data || total < fMinBytes ? nullptr : takeBlock(total);
+    if (!block)
+        return fStd->allocate(dims, sizes, type, data, step, flags, usageFlags);
+
+    // continuous layout, as the standard allocator gives it
+    if (step) {
+        size_t size = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; i--) {
+            step[i] = size;
+            size *= sizes[i];
+        }
+    }
+    cv::UMatData *u = new cv::UMatData(this);
+    u->data = u->origdata = block;
+    u->size = total;
+    return u;
+}
+
+bool FrameArenaAllocator::allocate(cv::UMatData *data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const
+{
+    return fStd->allocate(data, accessFlags, usageFlags);
+}
+
+void FrameArenaAllocator::deallocate(cv::UMatData *u) const
+{
+    if (!u)
+        return;
+    if (!ownsBlock(u->origdata)) {
+        fStd->deallocate(u);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        std::unordered_map<const uchar*, size_t>::iterator it = fUsed.find(u->origdata);
+        CV_Assert(it != fUsed.end());
+        fFree.insert(std::make_pair(it->second, u->origdata));
+        fStats.usedBytes -= it->second;
+        fUsed.erase(it);
+    }
+    delete u;
+}
@@ -0,0 +1,74 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+// cv::Mat allocator that serves frame-sized buffers from one region reserved
+// and touched up front, optionally backed by huge pages, so buffers
+// recreated every frame neither fault on first touch nor go back to the
+// system. Blocks are 64-byte aligned and kept on a free list when released;
+// the same frame geometry gets the same blocks again. Smaller buffers and
+// buffers that do not fit any more come from OpenCV's standard allocator.
+class FrameArenaAllocator : public cv::MatAllocator
+{
+public:
+    struct Params {
+        Params();
+
+        bool    enabled;
+        int     sizeMB;         // reserved region
+        int     minBufferKB;    // smaller buffers are left to the standard allocator
+        bool    hugePages;      // explicit huge pages, then transparent ones, then normal pages
+    };
+
+    struct Stats {
+        Stats() : served(0), fallbacks(0), usedBytes(0), peakBytes(0) {}
+        uint64_t served;
+        uint64_t fallbacks;     // buffers that did not fit
+        size_t   usedBytes;
+        size_t   peakBytes;
+    };
+
+    static FrameArenaAllocator &instance();
+
+    // reserves the region and makes it the default allocator of cv::Mat; only once
+    bool install(const Params &params);
+    bool isInstalled() const { return fBase != nullptr; }
+    size_t reservedBytes() const { return fSize; }
+    bool usesHugePages() const { return fHugePages; }
+    Stats stats() const;
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData *data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData *data) const override;
+
+private:
+    enum { alignment = 64 };
+
+    FrameArenaAllocator();
+
+    uchar *takeBlock(size_t size) const;
+    bool ownsBlock(const uchar *p) const { return p >= fBase && p < fBase + fSize; }
+
+    const cv::MatAllocator *fStd;
+    uchar *fBase;
+    size_t fSize;
+    bool fHugePages;
+    size_t fMinBytes;
+
+    mutable std::mutex fMutex;
+    mutable size_t fTop;                                    // start of the untouched rest
+    mutable std::multimap<size_t, uchar*> fFree;            // released blocks by size
+    mutable std::unordered_map<const uchar*, size_t> fUsed; // block sizes
+    mutable Stats fStats;
+
+    FrameArenaAllocator(const FrameArenaAllocator&);
+    FrameArenaAllocator &operator=(const FrameArenaAllocator&);
+};
+
+#endif // FRAMEARENA_H
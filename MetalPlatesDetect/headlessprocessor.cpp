@@ -0,0 +1,1141 @@
+#include "headlessprocessor.h"
+#include "pipelinesettings.h"
+#include "soamixture.h"
+#include "tracing.h"
+#include "threadaffinity.h"
+#include "maskcodec.h"
+#include "opencvtoolwidgets.h"
+#include "pipelineplan.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QDebug>
+#include <algorithm>
+#include <chrono>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+namespace {
+
+double elapsedMs(int64 start)
+{
+    return (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+}
+
+// The glare suppression at the head equalizes over the whole frame, so with
+// regions only the stages behind it are restricted to them. The subtractor
+// writes its regions into the raw mask the previous frame left behind, the
+// mask cleanup runs on the regions too, reading the raw mask around them as
+// far as it reaches, unless it fills holes and has to run over the whole raw
+// mask. The caller makes sure the previous frame ran in full resolution
+// through the same pipeline.
+template <typename Pipeline>
+void runStaticPipeline(Pipeline &pipeline, const cv::Mat &frame, cv::Mat &mask, const std::vector<cv::Rect> *regions,
+                       cv::Mat &equalized, cv::Mat &separated, LatencyGovernor &governor, PipelineMetrics &metrics)
+{
+    cv::Mat &raw = pipeline.tail().tail().headOutput();
+    if (regions && (raw.size() != frame.size() || mask.size() != frame.size()))
+        regions = nullptr;
+    if (!regions) {
+        pipeline.process(frame, mask);
+        for (int i = 0; i < Pipeline::StageCount; i++) {
+            governor.recordStage(i, pipeline.stageMs(i));
+            metrics.recordStage(i, pipeline.stageMs(i));
+        }
+        return;
+    }
+
+    typename Pipeline::Tail::Head &channels = pipeline.tail().head();
+    typename Pipeline::Tail::Tail::Head &subtractor = pipeline.tail().tail().head();
+    typename Pipeline::Tail::Tail::Tail &cleanup = pipeline.tail().tail().tail();
+    std::vector<double> stageMs(Pipeline::StageCount, 0.);
+
+    int64 start = cv::getTickCount();
+    {
+        MemoryAccounting::StageScope memoryScope(Pipeline::Head::name());
+        pipeline.head().process(frame, equalized);
+    }
+    stageMs[0] = elapsedMs(start);
+
+    start = cv::getTickCount();
+    if (channels.forwardsInput())
+        separated = equalized;
+    else {
+        MemoryAccounting::StageScope memoryScope(Pipeline::Tail::Head::name());
+        if (separated.data == equalized.data)
+            separated.release();
+        separated.create(frame.size(), CV_8UC(Pipeline::Tail::Head::OutputChannels));
+        for (size_t r = 0; r < regions->size(); r++) {
+            cv::Mat separatedRegion = separated((*regions)[r]);
+            channels.process(equalized((*regions)[r]), separatedRegion);
+        }
+    }
+    stageMs[1] = elapsedMs(start);
+
+    // regions of the whole frames, so the subtractor finds their part of the background
+    start = cv::getTickCount();
+    {
+        MemoryAccounting::StageScope memoryScope(Pipeline::Tail::Tail::Head::name());
+        for (size_t r = 0; r < regions->size(); r++) {
+            cv::Mat rawRegion = raw((*regions)[r]);
+            subtractor.process(separated((*regions)[r]), rawRegion);
+        }
+    }
+    stageMs[2] = elapsedMs(start);
+
+    if (cleanup.head().supportsRegions()) {
+        for (size_t r = 0; r < regions->size(); r++) {
+            cv::Mat maskRegion = mask((*regions)[r]);
+            cleanup.process(raw((*regions)[r]), maskRegion);
+            stageMs[3] += cleanup.stageMs(0);
+        }
+    }
+    else {
+        cleanup.process(raw, mask);
+        stageMs[3] = cleanup.stageMs(0);
+    }
+
+    for (int i = 0; i < Pipeline::StageCount; i++) {
+        governor.recordStage(i, stageMs[i]);
+        metrics.recordStage(i, stageMs[i]);
+    }
+}
+
+template <typename Pipeline>
+void setStaticParams(Pipeline &pipeline, const PipelineSettings::ToolParams &params)
+{
+    pipeline.template stage<0>().setParams(params.clahe);
+    pipeline.template stage<0>().setEnabled(params.claheEnabled);
+    if (pipeline.template stage<1>().fits(params.channels))
+        pipeline.template stage<1>().setParams(params.channels);
+    pipeline.template stage<2>().setParams(params.subtractor);
+    pipeline.template stage<3>().setParams(params.morphology);
+    pipeline.template stage<3>().setEnabled(params.morphologyEnabled);
+}
+
+// the per-stage times of a batch are amortized over its frames
+template <typename Pipeline>
+void runStaticBatch(Pipeline &pipeline, const std::vector<cv::Mat> &frames, std::vector<cv::Mat> &masks, PipelineMetrics &metrics)
+{
+    {
+        TRACE_SPAN("batch");
+        pipeline.processBatch(frames, masks);
+    }
+    for (int i = 0; i < Pipeline::StageCount; i++)
+        metrics.recordStage(i, pipeline.stageMs(i) / frames.size());
+}
+
+// One side of an A/B comparison: a subtractor configuration and the mask cleanup behind it
+struct ComparisonSide {
+    ComparisonSide() : ms(0), totalMs(0) {}
+
+    OpencvKernels::BackgroundSubtractorParams params;
+    OpencvKernels::MorphologyParams morphology;
+    OpencvKernels::BackgroundModel model;
+    cv::Mat raw;
+    cv::Mat mask;
+    double ms;
+    double totalMs;
+
+    void process(const cv::Mat &background, const cv::Mat &input)
+    {
+        int64 start = cv::getTickCount();
+        if (params.continuousModel)
+            model.apply(params, background, input, raw);
+        else
+            OpencvKernels::subtractBackground(params, background, input, raw);
+        OpencvKernels::cleanupMask(raw, mask, morphology);
+        ms = (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+        totalMs += ms;
+    }
+};
+
+// foreground of the current side only in red, of the candidate only in green, of both in white;
+// shadows (127) count as background as in compareMasks()
+void diffMasks(const cv::Mat &current, const cv::Mat &candidate, cv::Mat &diff)
+{
+    cv::Mat a = current > 127;
+    cv::Mat b = candidate > 127;
+    diff.create(current.size(), CV_8UC3);
+    diff.setTo(cv::Scalar::all(0));
+    diff.setTo(cv::Scalar(0, 0, 255), a & ~b);
+    diff.setTo(cv::Scalar(0, 255, 0), b & ~a);
+    diff.setTo(cv::Scalar::all(255), a & b);
+}
+
+}
+
+HeadlessProcessor::HeadlessProcessor(const QString &configPath, int stream) :
+    fSettings(configPath, QSettings::IniFormat),
+    fStream(stream),
+    fPackedMasks(false),
+    fBackgroundOverride(false),
+    fTracking(false),
+    fMotionGating(false),
+    fMetricsServer(&fMetrics),
+    fMetricsPort(0),
+    fBatchSize(1),
+    fDetections(0),
+    fWatchConfig(true),
+    fConfigWatcher(configPath, &HeadlessProcessor::subtractorReference),
+    fAppliedGeneration(0),
+    fAppliedReference(0),
+    fFullLevel(-1)
+{
+    // before anything is allocated or a worker started, so both stay on the stream's cores
+    fSettings.beginGroup(PipelineSettings::AffinityGroup);
+    QString cores = PipelineSettings::readStreamCores(&fSettings, stream);
+    fSettings.endGroup();
+    if (!cores.isEmpty()) {
+        if (ThreadAffinity::pinStream(ThreadAffinity::parseCores(cores.toStdString())))
+            qInfo().noquote() << QString("Stream %1 pinned to cores %2").arg(stream).arg(cores);
+        else
+            qWarning().noquote() << QString("Can't pin stream %1 to cores %2").arg(stream).arg(cores);
+    }
+
+    // the accounting goes in front of the arena
+    fSettings.beginGroup(PipelineSettings::FrameArenaGroup);
+    FrameArenaAllocator::Params arena = PipelineSettings::readFrameArenaParams(&fSettings);
+    fSettings.endGroup();
+    if (arena.enabled && !FrameArenaAllocator::instance().install(arena))
+        qWarning() << "Can't reserve" << arena.sizeMB << "MB for the frame arena";
+
+    fSettings.beginGroup(PipelineSettings::MemoryGroup);
+    setMemoryAccounting(PipelineSettings::readMemoryAccounting(&fSettings));
+    fSettings.endGroup();
+
+    PipelineSettings::ToolParams tools = PipelineSettings::readToolParams(&fSettings);
+    applyToolParams(tools);
+    fChainMismatch = chainMismatch(tools);
+    fSettings.beginGroup(PipelineSettings::SeparateChannelsGroup);
+    if (tools.channelsEnabled && PipelineSettings::readSeparateChannelsParams(&fSettings).channel >= 0 &&
+        tools.channels.channel < 0)
+        qWarning() << "The settings select a single channel, the subtractor models colour frames - all three planes are kept";
+    fSettings.endGroup();
+
+    fSettings.beginGroup(PipelineSettings::LatencyGovernorGroup);
+    fGovernor.setParams(PipelineSettings::readLatencyGovernorParams(&fSettings));
+    fSettings.endGroup();
+
+    fSettings.beginGroup(PipelineSettings::MetricsGroup);
+    fMetricsPort = PipelineSettings::readMetricsPort(&fSettings);
+    fSettings.endGroup();
+    fSettings.beginGroup(PipelineSettings::TracingGroup);
+    fTraceFile = PipelineSettings::readTraceFile(&fSettings);
+    fSettings.endGroup();
+    fSettings.beginGroup(PipelineSettings::DetectionLogGroup);
+    fDetectionLogFile = PipelineSettings::readDetectionLogFile(&fSettings);
+    fSettings.endGroup();
+    fSettings.beginGroup(PipelineSettings::OutputRingGroup);
+    fRingParams = PipelineSettings::readOutputRingParams(&fSettings);
+    fSettings.endGroup();
+    // named as the tools in the GUI
+    std::vector<std::string> stageNames;
+    stageNames.push_back("Glare suppression (CLAHE)");
+    stageNames.push_back("Separate Channels");
+    stageNames.push_back("Background subtractor");
+    stageNames.push_back("Mask cleanup");
+    fMetrics.setStageNames(stageNames);
+
+    if (!tools.backgroundImage.empty())
+        loadBackground(QString::fromStdString(tools.backgroundImage));
+}
+
+bool HeadlessProcessor::setBackground(const QString &path)
+{
+    fBackgroundOverride = true;
+    return loadBackground(path);
+}
+
+bool HeadlessProcessor::loadBackground(const QString &path)
+{
+    cv::Mat background = cv::imread( path.toStdString(), cv::IMREAD_UNCHANGED );
+    if (background.empty()) {
+        qWarning() << "Can't load background image" << path;
+        return false;
+    }
+    fBackground = background;
+    applyLevel();
+    return true;
+}
+
+void HeadlessProcessor::setLatencyGovernor(bool enabled, double deadlineMs)
+{
+    LatencyGovernor::Params params = fGovernor.params();
+    params.enabled = enabled;
+    if (deadlineMs > 0)
+        params.deadlineMs = deadlineMs;
+    fGovernor.setParams(params);
+    applyLevel();
+}
+
+void HeadlessProcessor::setMemoryAccounting(bool enabled)
+{
+    if (enabled && !MemoryAccounting::instance().isInstalled())
+        MemoryAccounting::instance().install();
+}
+
+void HeadlessProcessor::applyToolParams(const PipelineSettings::ToolParams &params)
+{
+    setStaticParams(fPipeline, params);
+    setStaticParams(fFallback, params);
+    fChannels = params.channels;
+    fTracker.setParams(params.tracker);
+    fGate.setParams(params.gate);
+}
+
+QString HeadlessProcessor::chainMismatch(const PipelineSettings::ToolParams &params)
+{
+    // the channels are configured at run time, a pipeline is compiled for either plane count;
+    // the other tools pass the frame on when switched off, the subtractor can not
+    QStringList differences;
+    if (!params.subtractorEnabled) {
+        differences << QString("%1 is switched off, the GUI's output is no mask")
+                       .arg(PipelineSettings::BackgroundSubtractorGroup);
+    }
+    const OpencvKernels::BackgroundAlgo algo = fPipeline.stage<2>().params().algo;
+    if (params.subtractor.algo != algo) {
+        differences << QString("%1 has algorithm %2, the compiled chain runs %3")
+                       .arg(PipelineSettings::BackgroundSubtractorGroup)
+                       .arg(int(params.subtractor.algo)).arg(int(algo));
+    }
+    return differences.join("\n");
+}
+
+void HeadlessProcessor::applyReloadedParams()
+{
+    if (!fConfigWatcher.isRunning() || fConfigWatcher.generation() == fAppliedGeneration)
+        return;
+    TRACE_SPAN("apply config");
+    std::shared_ptr<const ConfigWatcher::Snapshot> snapshot = fConfigWatcher.current();
+    fAppliedGeneration = snapshot->generation;
+    QString mismatch = chainMismatch(snapshot->params);
+    if (!mismatch.isEmpty()) {
+        qWarning().noquote() << mismatch;
+        qWarning() << "Not applying the reloaded settings, the masks would no longer match the GUI's";
+        return;
+    }
+    // the subtractors rebuild their models only when their own parameters differ,
+    // the algorithm is fixed by the stage
+    OpencvKernels::BackgroundSubtractorParams reloaded = snapshot->params.subtractor;
+    reloaded.algo = fPipeline.stage<2>().params().algo;
+    const bool modelChanged = reloaded != fPipeline.stage<2>().params();
+    applyToolParams(snapshot->params);
+    // the next frame runs whole, the raw mask of the previous one is of the old parameters
+    fFullLevel = -1;
+
+    // compared with the applied one, the snapshot that made it may have been replaced before this frame
+    bool newReference = snapshot->referenceGeneration != fAppliedReference;
+    if (newReference) {
+        fAppliedReference = snapshot->referenceGeneration;
+        if (!fBackgroundOverride && !snapshot->background.empty())
+            fBackground = snapshot->background;
+        if (!fBackgroundOverride && !snapshot->reference.empty() && fGovernor.currentLevel().downscale <= 1)
+            setSubtractorBackground(snapshot->reference);
+        else {
+            // scaled or given on the command line, made here once
+            applyLevel();
+        }
+    }
+    qInfo().noquote() << QString("Reloaded %1 from the settings%2")
+                         .arg(snapshot->changedGroups.join(", "))
+                         .arg(modelChanged || newReference ? ", background model rebuilt" : "");
+}
+
+cv::Mat HeadlessProcessor::subtractorReference(const PipelineSettings::ToolParams &params, const cv::Mat &background)
+{
+    // the background has to look like the frames reaching the subtractor
+    if (background.type() != CV_8UC3)
+        return background;
+    ClaheStage clahe;
+    clahe.setParams(params.clahe);
+    clahe.setEnabled(params.claheEnabled);
+    cv::Mat equalized, reference;
+    clahe.process(background, equalized);
+    if (params.channels.channel >= 0) {
+        SeparateChannelsStage<1> channels;
+        channels.setParams(params.channels);
+        channels.process(equalized, reference);
+    }
+    else {
+        SeparateChannelsStage<3> channels;
+        channels.setParams(params.channels);
+        channels.process(equalized, reference);
+    }
+    return reference;
+}
+
+void HeadlessProcessor::setSubtractorBackground(const cv::Mat &reference)
+{
+    fPipeline.stage<2>().setBackground(reference);
+    fFallback.stage<2>().setBackground(reference);
+}
+
+const cv::Mat &HeadlessProcessor::subtractorBackground()
+{
+    return fPipeline.stage<2>().background();
+}
+
+void HeadlessProcessor::prepareSubtractorInput(const cv::Mat &frame, cv::Mat &equalized, cv::Mat &input)
+{
+    fPipeline.stage<0>().process(frame, equalized);
+    fPipeline.stage<1>().process(equalized, input);
+}
+
+uint64_t HeadlessProcessor::modelResetCount()
+{
+    return fPipeline.stage<2>().modelResetCount() + fFallback.stage<2>().modelResetCount();
+}
+
+void HeadlessProcessor::applyLevel()
+{
+    LatencyGovernor::Level level = fGovernor.currentLevel();
+    cv::Mat background = fBackground;
+    if (level.downscale > 1 && !fBackground.empty())
+        cv::resize(fBackground, background, cv::Size(), 1. / level.downscale, 1. / level.downscale, cv::INTER_AREA);
+    PipelineSettings::ToolParams params;
+    params.clahe = fPipeline.stage<0>().params();
+    params.claheEnabled = fPipeline.stage<0>().enabled();
+    params.channels = fChannels;
+    setSubtractorBackground(subtractorReference(params, background));
+    fPipeline.setSkipOptional(level.skipOptional);
+    fFallback.setSkipOptional(level.skipOptional);
+}
+
+QStringList HeadlessProcessor::expandInputs(const QStringList &inputs, bool masks)
+{
+    const QStringList filters = masks ? QStringList() << "*_mask.png" << "*.pmask"
+                                      : QStringList() << "*.png" << "*.jpg" << "*.jpeg";
+    QStringList files;
+    foreach (const QString &input, inputs) {
+        QFileInfo info(input);
+        if (info.isDir()) {
+            QDir dir(input);
+            foreach (const QString &name, dir.entryList(filters, QDir::Files, QDir::Name))
+                files.append(dir.filePath(name));
+        }
+        else
+            files.append(input);
+    }
+    return files;
+}
+
+void HeadlessProcessor::runPipeline(const cv::Mat &frame, cv::Mat &mask, const std::vector<cv::Rect> *regions)
+{
+    if (fGovernor.currentLevel().fallbackAlgo)
+        runStaticPipeline(fFallback, frame, mask, regions, fEqualized, fSeparated, fGovernor, fMetrics);
+    else
+        runStaticPipeline(fPipeline, frame, mask, regions, fEqualized, fSeparated, fGovernor, fMetrics);
+}
+
+void HeadlessProcessor::logDetections(const cv::Mat &mask, int64_t timeUs)
+{
+    if (!fDetectionLog.isOpen())
+        return;
+    TRACE_SPAN("detection log");
+    const bool fallback = fGovernor.currentLevel().fallbackAlgo;
+    const OpencvKernels::BackgroundSubtractorParams &params = fallback ? fFallback.stage<2>().params()
+                                                                       : fPipeline.stage<2>().params();
+    Detection detection;
+    detection.timeUs = timeUs;
+    detection.stream = uint16_t(fStream);
+    detection.algo = uint8_t(params.algo);
+    detection.paramsHash = params.hash();
+
+    if (fTracking) {
+        const std::vector<PlateTracker::Track> &tracks = fTracker.tracks();
+        for (size_t i = 0; i < tracks.size(); i++) {
+            if (tracks[i].misses)
+                continue;
+            const cv::Rect &box = tracks[i].box;
+            detection.x = uint16_t(box.x);
+            detection.y = uint16_t(box.y);
+            detection.width = uint16_t(box.width);
+            detection.height = uint16_t(box.height);
+            detection.area = uint32_t(tracks[i].area);
+            fDetectionLog.append(detection);
+            fDetections++;
+        }
+        return;
+    }
+
+    cv::Mat binary = mask > 127;
+    int count = cv::connectedComponentsWithStats(binary, fLabels, fBlobStats, fCentroids, 8, CV_32S);
+    for (int i = 1; i < count; i++) {
+        const int *blob = fBlobStats.ptr<int>(i);
+        if (blob[cv::CC_STAT_AREA] < fTracker.params().minArea)
+            continue;
+        detection.x = uint16_t(blob[cv::CC_STAT_LEFT]);
+        detection.y = uint16_t(blob[cv::CC_STAT_TOP]);
+        detection.width = uint16_t(blob[cv::CC_STAT_WIDTH]);
+        detection.height = uint16_t(blob[cv::CC_STAT_HEIGHT]);
+        detection.area = uint32_t(blob[cv::CC_STAT_AREA]);
+        fDetectionLog.append(detection);
+        fDetections++;
+    }
+}
+
+void HeadlessProcessor::writeMask(const QString &input, const cv::Mat &mask) const
+{
+    QString base = QDir(fOutputDir).filePath(QFileInfo(input).completeBaseName());
+    bool written = fPackedMasks ? OpencvKernels::writeMask((base + "_mask.pmask").toStdString(), mask)
+                                : cv::imwrite( (base + "_mask.png").toStdString(), mask );
+    if (!written)
+        qWarning() << "Can't write the mask of" << input;
+}
+
+void HeadlessProcessor::publish(const cv::Mat &frame, const cv::Mat &mask, int64_t timeUs)
+{
+    if (!fRing.isOpen())
+        return;
+    TRACE_SPAN("publish");
+    if (!fRing.publish(ShmRing::payloadFrame, uint32_t(fStream), timeUs, frame) ||
+            !fRing.publish(ShmRing::payloadMask, uint32_t(fStream), timeUs, mask))
+        qWarning() << "Frame does not fit the output ring slots of" << fRingParams.slotKB << "KB";
+}
+
+void HeadlessProcessor::processFrame(const cv::Mat &frame, cv::Mat &mask)
+{
+    TRACE_SPAN("frame");
+    if (fMotionGating && fGate.planFrame(frame) == OpencvKernels::frameSkipDownstream && !mask.empty()) {
+        fMetrics.recordGatedFrame();
+        return;     // nothing moved, the previous mask still holds
+    }
+
+    int downscale = fGovernor.currentLevel().downscale;
+    if (downscale > 1) {
+        // regions of the tracker are in full resolution, a reduced frame always runs whole
+        cv::resize(frame, fScaledFrame, cv::Size(), 1. / downscale, 1. / downscale, cv::INTER_AREA);
+        runPipeline(fScaledFrame, fScaledMask, nullptr);
+        cv::resize(fScaledMask, mask, frame.size(), 0, 0, cv::INTER_NEAREST);
+        fFullLevel = -1;
+        if (fTracking)
+            fTracker.update(mask);
+        return;
+    }
+
+    OpencvKernels::FrameAction action = OpencvKernels::frameRunFull;
+    if (fTracking)
+        action = fTracker.planFrame(frame, &fRegions);
+    // the regions go into the raw mask of the previous frame, which has to come from the same
+    // pipeline and parameters; only per-pixel models give the whole frame's mask on a region
+    const bool fallback = fGovernor.currentLevel().fallbackAlgo;
+    const OpencvKernels::BackgroundSubtractorParams &subtractor = fallback ? fFallback.stage<2>().params()
+                                                                           : fPipeline.stage<2>().params();
+    if (action == OpencvKernels::frameRunRegions && (fFullLevel != fGovernor.level() || !OpencvKernels::backgroundSupportsRegions(subtractor)))
+        action = OpencvKernels::frameRunFull;
+
+    if (action == OpencvKernels::frameRunRegions)
+        runPipeline(frame, mask, &fRegions);
+    else if (action != OpencvKernels::frameSkipUpstream) {
+        runPipeline(frame, mask, nullptr);
+        fFullLevel = fGovernor.level();
+    }
+    else
+        fMetrics.recordGatedFrame();
+    if (fTracking)
+        fTracker.update(mask);
+}
+
+int HeadlessProcessor::benchmarkMixture(const QStringList &inputs)
+{
+    // half against float over the later half of the frames, where lost updates have added up
+    const double minHalfAgreement = 0.995;
+
+    const OpencvKernels::BackgroundSubtractorParams &p = fPipeline.stage<2>().params();
+    cv::Ptr<cv::BackgroundSubtractorMOG2> mog2 = cv::createBackgroundSubtractorMOG2(p.history, p.threshold, p.detectShadows);
+    mog2->setNMixtures(p.nmixtures);
+    OpencvKernels::SoaMixtureSubtractor soa(p.history, p.threshold, p.nmixtures, p.detectShadows, false);
+    OpencvKernels::SoaMixtureSubtractor soaHalf(p.history, p.threshold, p.nmixtures, p.detectShadows, true);
+
+    struct Model {
+        const char *name;
+        cv::BackgroundSubtractor *subtractor;
+        const OpencvKernels::SoaMixtureSubtractor *soa;
+        double ms;
+        double pixels;
+        double foregroundIoU;
+        cv::Mat mask;
+    };
+    Model models[] = {
+        { "MOG2", mog2.get(), nullptr, 0, 0, 0, cv::Mat() },
+        { "SoA MOG", &soa, &soa, 0, 0, 0, cv::Mat() },
+        { "SoA MOG half", &soaHalf, &soaHalf, 0, 0, 0, cv::Mat() }
+    };
+    const int modelCount = int(sizeof(models) / sizeof(models[0]));
+
+    int processed = 0;
+    int channels = 0;
+    std::vector<double> halfAgreement;
+    cv::Mat equalized, input;
+    cv::Mat background = subtractorBackground();
+    if (!background.empty()) {
+        for (int m = 0; m < modelCount; m++)
+            models[m].subtractor->apply(background, models[m].mask);
+    }
+    foreach (const QString &file, expandInputs(inputs)) {
+        cv::Mat frame = cv::imread( file.toStdString(), cv::IMREAD_UNCHANGED );
+        if (frame.empty() || frame.channels() != ProductionPipeline::InputChannels) {
+            qWarning() << "Skipping" << file;
+            continue;
+        }
+        prepareSubtractorInput(frame, equalized, input);
+        channels = input.channels();
+
+        for (int m = 0; m < modelCount; m++) {
+            int64 start = cv::getTickCount();
+            models[m].subtractor->apply(input, models[m].mask);
+            models[m].ms += (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+            OpencvKernels::MaskAgreement agreement = OpencvKernels::compareMasks(models[0].mask, models[m].mask);
+            models[m].pixels += agreement.pixels;
+            models[m].foregroundIoU += agreement.foregroundIoU;
+        }
+        halfAgreement.push_back(OpencvKernels::compareMasks(models[1].mask, models[2].mask).pixels);
+        processed++;
+    }
+    if (!processed) {
+        qWarning() << "No frames to benchmark";
+        return 1;
+    }
+
+    // MOG2 keeps weight, variance and the means per component plus a mode count per pixel
+    double pixels = double(input.total());
+    double mog2Bytes = pixels * (p.nmixtures * (2 + channels) * sizeof(float) + 1);
+    qInfo().noquote() << QString("%1 frames, %2 mixtures, %3 channels").arg(processed).arg(p.nmixtures).arg(channels);
+    for (int m = 0; m < modelCount; m++) {
+        const Model &model = models[m];
+        double bytes = model.soa ? double(model.soa->stateSize()) : mog2Bytes;
+        qInfo().noquote() << QString("%1: %2 ms per frame, state %3 MB, agreement with MOG2 %4%, foreground IoU %5")
+                             .arg(model.name, -13)
+                             .arg(model.ms / processed, 0, 'f', 2)
+                             .arg(bytes / (1024 * 1024), 0, 'f', 1)
+                             .arg(model.pixels / processed * 100, 0, 'f', 2)
+                             .arg(model.foregroundIoU / processed, 0, 'f', 3);
+    }
+
+    const int later = processed / 2;
+    double laterAgreement = 0;
+    for (int i = processed - later; i < processed; i++)
+        laterAgreement += halfAgreement[i];
+    laterAgreement = later ? laterAgreement / later : 1.;
+    qInfo().noquote() << QString("Half precision agrees with float on %1% of the pixels over the last %2 frames")
+                         .arg(laterAgreement * 100, 0, 'f', 2).arg(later);
+    if (laterAgreement < minHalfAgreement) {
+        qWarning().noquote() << QString("Half precision drifts from float, below %1%").arg(minHalfAgreement * 100, 0, 'f', 1);
+        return 1;
+    }
+    return 0;
+}
+
+void HeadlessProcessor::runBatches(const QStringList &files, std::vector<double> &frameMs, int &skipped)
+{
+    std::vector<cv::Mat> decoded;
+    QStringList names;
+    for (int first = 0; first < files.count(); first += fBatchSize) {
+        const int count = std::min(fBatchSize, files.count() - first);
+        fMetrics.setQueueDepth(files.count() - first);
+        applyReloadedParams();
+        decoded.assign(count, cv::Mat());
+        {
+            TRACE_SPAN("decode");
+            OpencvKernels::processFrames(count, true, [&](int i) {
+                decoded[i] = cv::imread( files[first + i].toStdString(), cv::IMREAD_UNCHANGED );
+            });
+        }
+        fBatchFrames.clear();
+        names.clear();
+        for (int i = 0; i < count; i++) {
+            if (decoded[i].empty() || decoded[i].channels() != ProductionPipeline::InputChannels) {
+                qWarning() << "Skipping" << files[first + i];
+                fMetrics.setDroppedFrames(++skipped);
+                continue;
+            }
+            fBatchFrames.push_back(decoded[i]);
+            names << files[first + i];
+        }
+        if (fBatchFrames.empty())
+            continue;
+
+        int64 start = cv::getTickCount();
+        runStaticBatch(fPipeline, fBatchFrames, fBatchMasks, fMetrics);
+        const int frames = int(fBatchFrames.size());
+        const double ms = (cv::getTickCount() - start) * 1000. / cv::getTickFrequency() / frames;
+        fMetrics.setModelResets(modelResetCount());
+
+        const int64_t timeUs = QDateTime::currentMSecsSinceEpoch() * 1000;
+        MemoryAccounting &memory = MemoryAccounting::instance();
+        for (int i = 0; i < frames; i++) {
+            logDetections(fBatchMasks[i], timeUs);
+            publish(fBatchFrames[i], fBatchMasks[i], timeUs);
+            frameMs.push_back(ms);
+            fMetrics.recordFrame(ms);
+            if (memory.isInstalled() && memory.endFrame())
+                qWarning().noquote() << "Memory keeps growing, possible leak:\n" << QString::fromStdString(memory.describe());
+        }
+        if (!fOutputDir.isEmpty()) {
+            TRACE_SPAN("encode");
+            OpencvKernels::processFrames(frames, true, [&](int i) { writeMask(names[i], fBatchMasks[i]); });
+        }
+        qInfo().noquote() << QString("%1 frames from %2: %3 ms per frame")
+                             .arg(frames).arg(QFileInfo(names[0]).fileName()).arg(ms, 0, 'f', 2);
+    }
+}
+
+int HeadlessProcessor::compareCandidate(const QString &candidateConfig, const QStringList &inputs)
+{
+    const cv::Mat &background = subtractorBackground();
+    if (background.empty()) {
+        qWarning() << "No background image, set it in the GUI or pass --background";
+        return 1;
+    }
+    if (!QFileInfo::exists(candidateConfig)) {
+        qWarning() << "Can't find candidate settings" << candidateConfig;
+        return 1;
+    }
+    QSettings candidateSettings(candidateConfig, QSettings::IniFormat);
+
+    // the production stage fixes the algorithm, both sides take it from the settings as the tool does
+    ComparisonSide current, candidate;
+    fSettings.beginGroup(PipelineSettings::BackgroundSubtractorGroup);
+    current.params = PipelineSettings::readBackgroundSubtractorParams(&fSettings);
+    fSettings.endGroup();
+    candidateSettings.beginGroup(PipelineSettings::BackgroundSubtractorGroup);
+    candidate.params = PipelineSettings::readBackgroundSubtractorParams(&candidateSettings);
+    candidateSettings.endGroup();
+    current.morphology = candidate.morphology = fPipeline.stage<3>().params();
+    if (current.params == candidate.params)
+        qWarning() << "The candidate configures the subtractor as the current settings do";
+    if (!fOutputDir.isEmpty())
+        QDir().mkpath(fOutputDir);
+
+    int processed = 0;
+    double sharedMs = 0;
+    double pixels = 0;
+    double foregroundIoU = 0;
+    cv::Mat equalized, input, diff;
+    foreach (const QString &file, expandInputs(inputs)) {
+        cv::Mat frame = cv::imread( file.toStdString(), cv::IMREAD_UNCHANGED );
+        if (frame.empty() || frame.channels() != ProductionPipeline::InputChannels) {
+            qWarning() << "Skipping" << file;
+            continue;
+        }
+
+        int64 start = cv::getTickCount();
+        prepareSubtractorInput(frame, equalized, input);
+        sharedMs += (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+
+        // each side alone on the whole worker pool; the order alternates, so neither
+        // always finds the caches warmed by the other
+        ComparisonSide *first = processed % 2 ? &candidate : &current;
+        ComparisonSide *second = processed % 2 ? &current : &candidate;
+        first->process(background, input);
+        second->process(background, input);
+
+        OpencvKernels::MaskAgreement agreement = OpencvKernels::compareMasks(current.mask, candidate.mask);
+        pixels += agreement.pixels;
+        foregroundIoU += agreement.foregroundIoU;
+        processed++;
+
+        if (!fOutputDir.isEmpty()) {
+            diffMasks(current.mask, candidate.mask, diff);
+            QString base = QDir(fOutputDir).filePath(QFileInfo(file).completeBaseName());
+            cv::imwrite( (base + "_current.png").toStdString(), current.mask );
+            cv::imwrite( (base + "_candidate.png").toStdString(), candidate.mask );
+            cv::imwrite( (base + "_diff.png").toStdString(), diff );
+        }
+        qInfo().noquote() << QString("%1: current %2 ms, candidate %3 ms, agreement %4%, foreground IoU %5")
+                             .arg(QFileInfo(file).fileName())
+                             .arg(current.ms, 0, 'f', 2)
+                             .arg(candidate.ms, 0, 'f', 2)
+                             .arg(agreement.pixels * 100, 0, 'f', 2)
+                             .arg(agreement.foregroundIoU, 0, 'f', 3);
+    }
+    if (!processed) {
+        qWarning() << "No frames to compare";
+        return 1;
+    }
+
+    double shared = sharedMs / processed;
+    double currentMs = current.totalMs / processed;
+    double candidateMs = candidate.totalMs / processed;
+    qInfo().noquote() << QString("%1 frames, shared stages %2 ms per frame")
+                         .arg(processed).arg(shared, 0, 'f', 2);
+    qInfo().noquote() << QString("current:   %1 ms per frame, %2 frames/s")
+                         .arg(currentMs, 0, 'f', 2).arg(1000. / (shared + currentMs), 0, 'f', 1);
+    qInfo().noquote() << QString("candidate: %1 ms per frame, %2 frames/s, %3% of the current latency")
+                         .arg(candidateMs, 0, 'f', 2).arg(1000. / (shared + candidateMs), 0, 'f', 1)
+                         .arg(currentMs > 0 ? candidateMs / currentMs * 100 : 0., 0, 'f', 1);
+    qInfo().noquote() << QString("agreement %1%, foreground IoU %2")
+                         .arg(pixels / processed * 100, 0, 'f', 2).arg(foregroundIoU / processed, 0, 'f', 3);
+    return 0;
+}
+
+int HeadlessProcessor::verifyChain(const QStringList &inputs)
+{
+    if (fBackground.empty()) {
+        qWarning() << "No background image, set it in the GUI or pass --background";
+        return 1;
+    }
+    if (fBackgroundOverride) {
+        qWarning() << "The GUI's plan takes the background image from the settings, verify without --background";
+        return 1;
+    }
+    if (!fChainMismatch.isEmpty())
+        qWarning().noquote() << fChainMismatch;
+    if (!fOutputDir.isEmpty())
+        QDir().mkpath(fOutputDir);
+
+    // the tools of the chain as the GUI creates and configures them, run by its plan;
+    // the gating tools are left out, the chain runs every frame whole
+    QList<OpencvBaseToolWidget*> tools;
+    tools << new OpencvClaheToolWidget() << new OpencvSeparateChannelsToolWidget()
+          << new OpencvBackgroundSubtractorToolWidget() << new OpencvMorphologyToolWidget();
+    foreach (OpencvBaseToolWidget *tool, tools) {
+        tool->loadSettings(&fSettings);
+        tool->loadEnabled(&fSettings);
+    }
+    PipelinePlan plan;
+
+    int processed = 0;
+    int differing = 0;
+    double differingPixels = 0;
+    cv::Mat chainMask, diff;
+    foreach (const QString &file, expandInputs(inputs)) {
+        cv::Mat frame = cv::imread( file.toStdString(), cv::IMREAD_UNCHANGED );
+        if (frame.empty() || frame.channels() != ProductionPipeline::InputChannels) {
+            qWarning() << "Skipping" << file;
+            continue;
+        }
+        fPipeline.process(frame, chainMask);
+
+        if (!plan.isCompiledFor(frame))
+            plan.compile(tools, frame);
+        plan.run(frame);
+        cv::Mat planMask = plan.result(tools.count() - 1);
+
+        processed++;
+        if (planMask.size() != chainMask.size() || planMask.type() != chainMask.type()) {
+            differing++;
+            differingPixels += double(chainMask.total());
+            qWarning().noquote() << QString("%1: the plan's output is no mask like the chain's").arg(QFileInfo(file).fileName());
+            continue;
+        }
+        int pixels = cv::countNonZero(chainMask != planMask);
+        if (!pixels)
+            continue;
+        differing++;
+        differingPixels += pixels;
+        qWarning().noquote() << QString("%1: %2 pixels differ").arg(QFileInfo(file).fileName()).arg(pixels);
+        if (!fOutputDir.isEmpty()) {
+            diffMasks(planMask, chainMask, diff);
+            QString base = QDir(fOutputDir).filePath(QFileInfo(file).completeBaseName());
+            cv::imwrite( (base + "_verify.png").toStdString(), diff );
+        }
+    }
+    qDeleteAll(tools);
+    if (!processed) {
+        qWarning() << "No frames to verify";
+        return 1;
+    }
+    if (differing) {
+        qWarning().noquote() << QString("%1 of %2 frames differ, %3 pixels per frame on average")
+                                .arg(differing).arg(processed).arg(differingPixels / differing, 0, 'f', 0);
+        return 1;
+    }
+    qInfo().noquote() << QString("%1 frames, the masks of the compiled chain and the GUI's plan are identical").arg(processed);
+    return 0;
+}
+
+int HeadlessProcessor::queryDetectionLog(const QString &path, int64_t fromUs, int64_t toUs, int stream)
+{
+    DetectionLogReader log;
+    if (!log.open(path)) {
+        qWarning() << "Can't read the detection log" << path;
+        return 1;
+    }
+    if (!log.indexed())
+        qInfo().noquote() << "No index at the end of the log, it is being written or was not closed";
+
+    int64 start = cv::getTickCount();
+    std::vector<Detection> detections = log.query(fromUs, toUs, stream);
+    double ms = (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+    for (size_t i = 0; i < detections.size(); i++) {
+        const Detection &d = detections[i];
+        qInfo().noquote() << QString("%1 stream %2 %3x%4+%5+%6 area %7 algo %8 params %9")
+                             .arg(QDateTime::fromMSecsSinceEpoch(d.timeUs / 1000).toString(Qt::ISODateWithMs))
+                             .arg(d.stream).arg(d.width).arg(d.height).arg(d.x).arg(d.y).arg(d.area).arg(int(d.algo))
+                             .arg(d.paramsHash, 16, 16, QChar('0'));
+    }
+    qInfo().noquote() << QString("%1 of %2 detections in %3 blocks match, %4 ms")
+                         .arg(detections.size()).arg(log.detectionCount()).arg(log.blocks().size()).arg(ms, 0, 'f', 2);
+    return 0;
+}
+
+int HeadlessProcessor::convertMasks(const QStringList &inputs, const QString &outputDir)
+{
+    QStringList files = expandInputs(inputs, true);
+    if (!outputDir.isEmpty())
+        QDir().mkpath(outputDir);
+    QStringList outputs;
+    foreach (const QString &file, files) {
+        QFileInfo info(file);
+        QString name = info.completeBaseName() + (info.suffix() == "pmask" ? ".png" : ".pmask");
+        outputs << (outputDir.isEmpty() ? info.dir().filePath(name) : QDir(outputDir).filePath(name));
+    }
+
+    std::vector<char> converted(files.size(), 0);
+    int64 start = cv::getTickCount();
+    OpencvKernels::processFrames(files.size(), true, [&](int i) {
+        cv::Mat mask;
+        if (QFileInfo(files[i]).suffix() == "pmask")
+            converted[i] = OpencvKernels::readMask(files[i].toStdString(), mask) &&
+                           cv::imwrite( outputs[i].toStdString(), mask );
+        else {
+            mask = cv::imread( files[i].toStdString(), cv::IMREAD_GRAYSCALE );
+            converted[i] = !mask.empty() && OpencvKernels::writeMask(outputs[i].toStdString(), mask);
+        }
+    });
+    double ms = (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+
+    int count = 0;
+    qint64 inputBytes = 0;
+    qint64 outputBytes = 0;
+    for (int i = 0; i < files.size(); i++) {
+        if (!converted[i]) {
+            qWarning() << "Can't convert" << files[i];
+            continue;
+        }
+        count++;
+        inputBytes += QFileInfo(files[i]).size();
+        outputBytes += QFileInfo(outputs[i]).size();
+    }
+    if (count) {
+        qInfo().noquote() << QString("%1 masks converted in %2 ms, %3 KB to %4 KB")
+                             .arg(count).arg(ms, 0, 'f', 1).arg(inputBytes / 1024).arg(outputBytes / 1024);
+    }
+    return count == files.size() && count ? 0 : 1;
+}
+
+int HeadlessProcessor::consumeRing(const QString &name, int seconds)
+{
+    ShmRing::Reader reader;
+    const int64 end = cv::getTickCount() + int64(seconds * cv::getTickFrequency());
+    while (!reader.open(name.toStdString())) {
+        if (cv::getTickCount() > end) {
+            qWarning() << "No output ring" << name;
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    uint64_t items = 0;
+    uint64_t torn = 0;
+    ShmRing::Reader::Item item;
+    while (cv::getTickCount() < end) {
+        if (!reader.next(item)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        // in place, as a consumer would, then checked
+        cv::Mat pixels = item.mat();
+        int nonZero = item.header.type == ShmRing::payloadMask ? cv::countNonZero(pixels) : -1;
+        if (!reader.isValid(item)) {
+            torn++;
+            continue;
+        }
+        items++;
+        double ageMs = (QDateTime::currentMSecsSinceEpoch() * 1000 - item.header.timeUs) / 1000.;
+        qInfo().noquote() << QString("#%1 stream %2 %3 %4x%5, %6 ms old%7")
+                             .arg(item.header.sequence).arg(item.header.stream)
+                             .arg(item.header.type == ShmRing::payloadMask ? "mask" : "frame")
+                             .arg(item.header.cols).arg(item.header.rows).arg(ageMs, 0, 'f', 1)
+                             .arg(nonZero >= 0 ? QString(", %1 foreground pixels").arg(nonZero) : QString());
+    }
+    qInfo().noquote() << QString("%1 items read, %2 skipped, %3 overwritten while read")
+                         .arg(items).arg(reader.skippedCount()).arg(torn);
+    return 0;
+}
+
+int HeadlessProcessor::run(const QStringList &inputs)
+{
+    if (subtractorBackground().empty()) {
+        qWarning() << "No background image, set it in the GUI or pass --background";
+        return 1;
+    }
+    if (!fChainMismatch.isEmpty()) {
+        qWarning().noquote() << fChainMismatch;
+        qWarning() << "The masks would not match the GUI's, not processing";
+        return 1;
+    }
+    if (!fOutputDir.isEmpty())
+        QDir().mkpath(fOutputDir);
+
+    if (fMetricsPort > 0)
+        fMetricsServer.start(quint16(fMetricsPort));
+    if (!fTraceFile.isEmpty()) {
+        Tracing::setThreadName("headless");
+        Tracing::setEnabled(true);
+    }
+    if (fWatchConfig) {
+        fConfigWatcher.start();
+        // what the constructor read
+        fAppliedGeneration = fConfigWatcher.generation();
+        std::shared_ptr<const ConfigWatcher::Snapshot> snapshot = fConfigWatcher.current();
+        if (snapshot)
+            fAppliedReference = snapshot->referenceGeneration;
+    }
+    if (!fDetectionLogFile.isEmpty() && !fDetectionLog.open(fDetectionLogFile))
+        qWarning() << "Can't open the detection log" << fDetectionLogFile;
+    if (!fRingParams.name.empty() && !fRing.open(fRingParams))
+        qWarning() << "Can't create the output ring" << QString::fromStdString(fRingParams.name);
+
+    QStringList files = expandInputs(inputs);
+    int processed = 0;
+    int skipped = 0;
+    double totalMs = 0;
+    std::vector<double> frameMs;
+    cv::Mat mask;
+    const bool batched = fBatchSize > 1 && !fTracking && !fMotionGating && !fGovernor.params().enabled;
+    if (fBatchSize > 1 && !batched)
+        qWarning() << "Tracking, motion gating and the latency governor need single frames, batching is off";
+    if (batched) {
+        runBatches(files, frameMs, skipped);
+        processed = int(frameMs.size());
+        for (size_t i = 0; i < frameMs.size(); i++)
+            totalMs += frameMs[i];
+    }
+    for (int f = 0; f < files.count() && !batched; f++) {
+        const QString &file = files[f];
+        fMetrics.setQueueDepth(files.count() - f);
+        applyReloadedParams();
+        cv::Mat frame;
+        {
+            TRACE_SPAN("decode");
+            frame = cv::imread( file.toStdString(), cv::IMREAD_UNCHANGED );
+        }
+        if (frame.empty() || frame.channels() != ProductionPipeline::InputChannels) {
+            qWarning() << "Skipping" << file;
+            fMetrics.setDroppedFrames(++skipped);
+            continue;
+        }
+
+        int64 start = cv::getTickCount();
+        processFrame(frame, mask);
+        double ms = (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+        totalMs += ms;
+        frameMs.push_back(ms);
+        processed++;
+        fMetrics.recordFrame(ms);
+        const int64_t timeUs = QDateTime::currentMSecsSinceEpoch() * 1000;
+        logDetections(mask, timeUs);
+        publish(frame, mask, timeUs);
+
+        double predictedMs = fGovernor.predictedMs();
+        int slowestStage = fGovernor.slowestStage();
+        int previousLevel = fGovernor.level();
+        if (fGovernor.endFrame(ms)) {
+            applyLevel();
+            bool down = fGovernor.level() > previousLevel;
+            QString message = QString("Latency governor: %1 to level %2 (%3), frame %4 ms, predicted %5 ms of %6 ms, slowest stage %7")
+                    .arg(down ? "stepped down" : "stepped up")
+                    .arg(fGovernor.level())
+                    .arg(QString::fromStdString(LatencyGovernor::describe(fGovernor.level())))
+                    .arg(ms, 0, 'f', 2)
+                    .arg(predictedMs, 0, 'f', 2)
+                    .arg(fGovernor.params().deadlineMs, 0, 'f', 2)
+                    .arg(slowestStage);
+            if (down)
+                qWarning().noquote() << message;
+            else
+                qInfo().noquote() << message;
+        }
+
+        MemoryAccounting &memory = MemoryAccounting::instance();
+        if (memory.isInstalled() && memory.endFrame())
+            qWarning().noquote() << "Memory keeps growing, possible leak:\n" << QString::fromStdString(memory.describe());
+
+        fMetrics.setModelResets(modelResetCount());
+        fMetrics.setDeadlineMisses(fGovernor.stats().missed);
+        fMetrics.setGovernorLevel(fGovernor.level());
+
+        if (!fOutputDir.isEmpty()) {
+            TRACE_SPAN("encode");
+            writeMask(file, mask);
+        }
+        if (memory.isInstalled())
+            qInfo().noquote() << QString("%1: %2 ms, %3 allocations").arg(QFileInfo(file).fileName()).arg(ms, 0, 'f', 2).arg(memory.frameAllocations());
+        else
+            qInfo().noquote() << QString("%1: %2 ms").arg(QFileInfo(file).fileName()).arg(ms, 0, 'f', 2);
+    }
+
+    fMetrics.setQueueDepth(0);
+    fConfigWatcher.stop();
+    if (fDetectionLog.isOpen()) {
+        fDetectionLog.close();
+        qInfo().noquote() << QString("%1 detections logged to %2").arg(fDetections).arg(fDetectionLogFile);
+    }
+    if (fRing.isOpen()) {
+        qInfo().noquote() << QString("%1 items published to the output ring %2")
+                             .arg(fRing.publishedCount()).arg(QString::fromStdString(fRingParams.name));
+        fRing.close();
+    }
+    if (Tracing::enabled()) {
+        Tracing::setEnabled(false);
+        if (Tracing::writeChromeTrace(fTraceFile.toStdString()))
+            qInfo().noquote() << "Trace written to" << fTraceFile;
+        else
+            qWarning() << "Can't write trace" << fTraceFile;
+    }
+    if (processed) {
+        qInfo().noquote() << QString("Processed %1 frames, %2 ms per frame").arg(processed).arg(totalMs / processed, 0, 'f', 2);
+        // jitter is what the core pinning is judged by
+        std::sort(frameMs.begin(), frameMs.end());
+        qInfo().noquote() << QString("Latency p50 %1 ms, p99 %2 ms, max %3 ms")
+                             .arg(frameMs[frameMs.size() / 2], 0, 'f', 2)
+                             .arg(frameMs[std::min(frameMs.size() - 1, frameMs.size() * 99 / 100)], 0, 'f', 2)
+                             .arg(frameMs.back(), 0, 'f', 2);
+    }
+    if (fTracking) {
+        const PlateTracker::Stats &stats = fTracker.stats();
+        qInfo().noquote() << QString("Tracker: %1 full, %2 region, %3 skipped frames")
+                             .arg(stats.full).arg(stats.regions).arg(stats.skipped);
+    }
+    if (fMotionGating) {
+        const MotionGate::Stats &stats = fGate.stats();
+        qInfo().noquote() << QString("Motion gate: %1 active, %2 idle, %3 model feed frames")
+                             .arg(stats.active).arg(stats.idle).arg(stats.fed);
+    }
+    const FrameArenaAllocator &arena = FrameArenaAllocator::instance();
+    if (arena.isInstalled()) {
+        FrameArenaAllocator::Stats stats = arena.stats();
+        qInfo().noquote() << QString("Frame arena: %1 MB reserved%2, peak %3 MB used, %4 buffers served, %5 did not fit")
+                             .arg(arena.reservedBytes() >> 20)
+                             .arg(arena.usesHugePages() ? " on huge pages" : "")
+                             .arg(stats.peakBytes / (1024. * 1024), 0, 'f', 1)
+                             .arg(stats.served).arg(stats.fallbacks);
+    }
+    const MemoryAccounting &memory = MemoryAccounting::instance();
+    if (memory.isInstalled()) {
+        qInfo().noquote() << QString("Memory: live %1 MB, peak %2 MB%3")
+                             .arg(memory.liveBytes() / (1024. * 1024), 0, 'f', 1)
+                             .arg(memory.peakBytes() / (1024. * 1024), 0, 'f', 1)
+                             .arg(memory.leakSuspected() ? ", growing steadily" : "");
+        foreach (const QString &line, QString::fromStdString(memory.describe()).split('\n')) {
+            if (!line.isEmpty())
+                qInfo().noquote() << "  " + line;
+        }
+    }
+    if (fGovernor.params().enabled) {
+        const LatencyGovernor::Stats &stats = fGovernor.stats();
+        qInfo().noquote() << QString("Latency governor: %1 of %2 frames over %3 ms, %4 steps down, %5 steps up")
+                             .arg(stats.missed).arg(stats.frames).arg(fGovernor.params().deadlineMs, 0, 'f', 2)
+                             .arg(stats.stepsDown).arg(stats.stepsUp);
+        for (int i = 0; i < LatencyGovernor::levelCount(); i++) {
+            if (stats.framesAtLevel[i])
+                qInfo().noquote() << QString("  level %1 (%2): %3 frames")
+                                     .arg(i).arg(QString::fromStdString(LatencyGovernor::describe(i))).arg(stats.framesAtLevel[i]);
+        }
+    }
+    return processed ? 0 : 1;
+}
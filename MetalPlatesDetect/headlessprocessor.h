@@ -0,0 +1,141 @@
+#ifndef HEADLESSPROCESSOR_H
+#define HEADLESSPROCESSOR_H
+
+#include <QSettings>
+#include <QStringList>
+#include <algorithm>
+#include "staticpipeline.h"
+#include "platetracker.h"
+#include "motiongate.h"
+#include "latencygovernor.h"
+#include "pipelinemetrics.h"
+#include "metricsserver.h"
+#include "memoryaccounting.h"
+#include "detectionlog.h"
+#include "shmring.h"
+#include "configwatcher.h"
+
+// Production path without any widgets: runs the compile-time pipeline over
+// image files with the parameters stored in config.ini by the GUI.
+class HeadlessProcessor
+{
+public:
+    // the stream selects the cores the processing is pinned to, see ThreadAffinity
+    explicit HeadlessProcessor(const QString &configPath, int stream = 0);
+
+    // overrides the background image of the settings, also when they are reloaded
+    bool setBackground(const QString &path);
+    void setOutputDir(const QString &path) { fOutputDir = path; }
+    // gate frames with the plate tracker configured in the GUI
+    void setTracking(bool enabled) { fTracking = enabled; }
+    // skip the pipeline on frames without motion, the last mask is kept
+    void setMotionGate(bool enabled) { fMotionGating = enabled; }
+    // degrade the processing when frames get close to the deadline, 0 keeps the configured budget
+    void setLatencyGovernor(bool enabled, double deadlineMs = 0);
+    // serve the metrics on the local port while frames are processed, 0 disables it
+    void setMetricsPort(int port) { fMetricsPort = port; }
+    // record tracing spans and write them as Chrome trace when the run ends, empty disables it
+    void setTraceFile(const QString &path) { fTraceFile = path; }
+    // count cv::Mat memory per stage and report it, cannot be turned off again
+    void setMemoryAccounting(bool enabled);
+    // frames decoded and pushed through the pipeline together, 1 processes them one by one;
+    // tracking, motion gating and the latency governor need single frames
+    void setBatchSize(int frames) { fBatchSize = std::max(frames, 1); }
+    // append every detected plate to the binary log, empty disables it
+    void setDetectionLogFile(const QString &path) { fDetectionLogFile = path; }
+    // write the masks 1 bit per pixel as .pmask instead of PNG, see MaskCodec
+    void setPackedMasks(bool enabled) { fPackedMasks = enabled; }
+    // publish every frame and its mask to the shared-memory ring of this name, empty disables it
+    void setOutputRing(const QString &name) { fRingParams.name = name.toStdString(); }
+    // apply edits of the tool parameters in the settings file between frames while running
+    void setWatchConfig(bool enabled) { fWatchConfig = enabled; }
+
+    // inputs are image files or directories, returns the process exit code
+    int run(const QStringList &inputs);
+    // runs MOG2 and the SoA mixture in float and half precision side by side
+    // on the frames as they reach the subtractor, prints time, memory and mask agreement;
+    // fails when the half precision masks drift away from the float ones
+    int benchmarkMixture(const QStringList &inputs);
+    // A/B run of the subtractor as configured against the one of another settings file:
+    // both share the decode and the stages in front of the subtractor, then each runs alone in
+    // alternating order; the masks of both and their difference are written, latency and agreement printed
+    int compareCandidate(const QString &candidateConfig, const QStringList &inputs);
+    // runs the compiled chain and the GUI's plan of the tool widgets, both configured from the
+    // settings, on the same frames and reports every frame their masks differ in;
+    // the widgets need a QApplication
+    int verifyChain(const QStringList &inputs);
+    // prints the logged detections with fromUs <= time < toUs, of one stream or of all with -1
+    static int queryDetectionLog(const QString &path, int64_t fromUs, int64_t toUs, int stream);
+    // PNG masks to .pmask and .pmask back to PNG, into the output directory or next to the inputs
+    static int convertMasks(const QStringList &inputs, const QString &outputDir);
+    // test consumer of the output ring: follows it and prints every item and the skipped ones
+    static int consumeRing(const QString &name, int seconds);
+
+private:
+    QSettings fSettings;
+    int fStream;
+    QString fOutputDir;
+    bool fPackedMasks;
+    ProductionPipeline fPipeline;
+    FallbackPipeline fFallback;
+    OpencvKernels::SeparateChannelsParams fChannels;
+    cv::Mat fBackground;
+    bool fBackgroundOverride;
+    bool fTracking;
+    PlateTracker fTracker;
+    bool fMotionGating;
+    MotionGate fGate;
+    std::vector<cv::Rect> fRegions;
+    LatencyGovernor fGovernor;
+    cv::Mat fScaledFrame;
+    cv::Mat fScaledMask;
+    cv::Mat fEqualized;
+    cv::Mat fSeparated;
+    PipelineMetrics fMetrics;
+    MetricsServer fMetricsServer;
+    int fMetricsPort;
+    QString fTraceFile;
+    int fBatchSize;
+    std::vector<cv::Mat> fBatchFrames;
+    std::vector<cv::Mat> fBatchMasks;
+    QString fDetectionLogFile;
+    DetectionLogWriter fDetectionLog;
+    uint64_t fDetections;
+    cv::Mat fLabels, fBlobStats, fCentroids;
+    ShmRing::Params fRingParams;
+    ShmRing::Producer fRing;
+    bool fWatchConfig;
+    ConfigWatcher fConfigWatcher;
+    uint64_t fAppliedGeneration;
+    uint64_t fAppliedReference;     // reference generation of the snapshots, snapshots in between may be skipped
+    QString fChainMismatch;
+    int fFullLevel;         // governor level the last whole frame ran at, -1 before the first
+
+    bool loadBackground(const QString &path);
+    void applyToolParams(const PipelineSettings::ToolParams &params);
+    // what the settings configure differently from the stages fixed at compile time, empty if nothing
+    QString chainMismatch(const PipelineSettings::ToolParams &params);
+    // takes the newest snapshot of the config watcher, if there is one
+    void applyReloadedParams();
+    void processFrame(const cv::Mat &frame, cv::Mat &mask);
+    // regions are null for a whole frame
+    void runPipeline(const cv::Mat &frame, cv::Mat &mask, const std::vector<cv::Rect> *regions);
+    void applyLevel();
+    void setSubtractorBackground(const cv::Mat &reference);
+    const cv::Mat &subtractorBackground();
+    // the stages in front of the subtractor as configured
+    void prepareSubtractorInput(const cv::Mat &frame, cv::Mat &equalized, cv::Mat &input);
+    uint64_t modelResetCount();
+    // appends the amortized time of every processed frame
+    void runBatches(const QStringList &files, std::vector<double> &frameMs, int &skipped);
+    // the tracks seen on the frame when tracking, else the blobs of the mask
+    void logDetections(const cv::Mat &mask, int64_t timeUs);
+    void writeMask(const QString &input, const cv::Mat &mask) const;
+    void publish(const cv::Mat &frame, const cv::Mat &mask, int64_t timeUs);
+
+    // directories give their images, or their masks when converting masks
+    static cv::Mat subtractorReference(const PipelineSettings::ToolParams &params, const cv::Mat &background);
+    static QStringList expandInputs(const QStringList &inputs, bool masks = false);
+};
+
+#endif // HEADLESSPROCESSOR_H
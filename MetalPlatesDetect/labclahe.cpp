@@ -0,0 +1,179 @@
+#include "labclahe.h"
+#include "tracing.h"
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace OpencvKernels {
+
+ClaheParams::ClaheParams() :
+    clipLimit(4),
+    tilesX(8),
+    tilesY(8)
+{
+}
+
+namespace {
+
+const int histSize = 256;
+
+// Converts the rows of a tile row to Lab in place in the destination and
+// builds the clipped, equalizing lookup table of every tile in it.
+class TileRowPass : public cv::ParallelLoopBody
+{
+public:
+    TileRowPass(const cv::Mat &src, cv::Mat &lab, double clipLimit,
+                const std::vector<int> &colEdges, const std::vector<int> &rowEdges, std::vector<uchar> &luts) :
+        fSrc(src), fLab(lab), fClipLimit(clipLimit), fColEdges(colEdges), fRowEdges(rowEdges), fLuts(luts) {}
+
+    void operator()(const cv::Range &range) const override
+    {
+        TRACE_SPAN("clahe tile rows");
+        const int tilesX = int(fColEdges.size()) - 1;
+        std::vector<int> hists(size_t(tilesX) * histSize);
+
+        for (int ty = range.start; ty < range.end; ty++) {
+            const int y0 = fRowEdges[ty], y1 = fRowEdges[ty + 1];
+            cv::Mat stripe = fLab.rowRange(y0, y1);
+            cv::cvtColor(fSrc.rowRange(y0, y1), stripe, cv::COLOR_BGR2Lab);
+
+            // one sweep along each row feeds the histograms of all tiles it crosses
+            std::fill(hists.begin(), hists.end(), 0);
+            for (int y = y0; y < y1; y++) {
+                const uchar *p = fLab.ptr<uchar>(y);
+                for (int tx = 0; tx < tilesX; tx++) {
+                    int *hist = &hists[size_t(tx) * histSize];
+                    for (int x = fColEdges[tx]; x < fColEdges[tx + 1]; x++)
+                        hist[p[3 * x]]++;
+                }
+            }
+
+            for (int tx = 0; tx < tilesX; tx++) {
+                const int area = (fColEdges[tx + 1] - fColEdges[tx]) * (y1 - y0);
+                buildLut(&hists[size_t(tx) * histSize], area, &fLuts[(size_t(ty) * tilesX + tx) * histSize]);
+            }
+        }
+    }
+
+private:
+    const cv::Mat &fSrc;
+    cv::Mat &fLab;
+    double fClipLimit;
+    const std::vector<int> &fColEdges;
+    const std::vector<int> &fRowEdges;
+    std::vector<uchar> &fLuts;
+
+    void buildLut(int *hist, int area, uchar *lut) const
+    {
+        // clip and hand the excess out evenly, the remainder spread over the range
+        if (fClipLimit > 0) {
+            const int clip = std::max(int(fClipLimit * area / histSize), 1);
+            int excess = 0;
+            for (int i = 0; i < histSize; i++) {
+                if (hist[i] > clip) {
+                    excess += hist[i] - clip;
+                    hist[i] = clip;
+                }
+            }
+            const int batch = excess / histSize;
+            int residual = excess - batch * histSize;
+            for (int i = 0; i < histSize; i++)
+                hist[i] += batch;
+            if (residual) {
+                const int step = std::max(histSize / residual, 1);
+                for (int i = 0; i < histSize && residual > 0; i += step, residual--)
+                    hist[i]++;
+            }
+        }
+
+        const float scale = 255.f / std::max(area, 1);
+        int sum = 0;
+        for (int i = 0; i < histSize; i++) {
+            sum += hist[i];
+            lut[i] = cv::saturate_cast<uchar>(sum * scale);
+        }
+    }
+};
+
+// Maps L through the bilinear blend of the four nearest tile tables and
+// converts the stripe back to BGR while it is still in cache.
+class MappingPass : public cv::ParallelLoopBody
+{
+public:
+    MappingPass(cv::Mat &dst, int tilesX, int tilesY, const std::vector<uchar> &luts) :
+        fDst(dst), fTilesX(tilesX), fTilesY(tilesY), fLuts(luts),
+        fTx1(dst.cols), fTx2(dst.cols), fXa(dst.cols)
+    {
+        const float tileWidth = float(dst.cols) / tilesX;
+        for (int x = 0; x < dst.cols; x++) {
+            float txf = (x + 0.5f) / tileWidth - 0.5f;
+            int tx1 = int(std::floor(txf));
+            fXa[x] = txf - tx1;
+            fTx1[x] = std::max(tx1, 0) * histSize;
+            fTx2[x] = std::min(tx1 + 1, tilesX - 1) * histSize;
+        }
+    }
+
+    void operator()(const cv::Range &range) const override
+    {
+        TRACE_SPAN("clahe mapping");
+        const float tileHeight = float(fDst.rows) / fTilesY;
+        const size_t lutRow = size_t(fTilesX) * histSize;
+
+        for (int y = range.start; y < range.end; y++) {
+            float tyf = (y + 0.5f) / tileHeight - 0.5f;
+            int ty1 = int(std::floor(tyf));
+            const float ya = tyf - ty1;
+            const uchar *top = &fLuts[std::max(ty1, 0) * lutRow];
+            const uchar *bottom = &fLuts[std::min(ty1 + 1, fTilesY - 1) * lutRow];
+
+            uchar *p = fDst.ptr<uchar>(y);
+            for (int x = 0; x < fDst.cols; x++) {
+                const int l = p[3 * x];
+                const float xa = fXa[x];
+                float t = top[fTx1[x] + l] + xa * (top[fTx2[x] + l] - top[fTx1[x] + l]);
+                float b = bottom[fTx1[x] + l] + xa * (bottom[fTx2[x] + l] - bottom[fTx1[x] + l]);
+                p[3 * x] = cv::saturate_cast<uchar>(t + ya * (b - t));
+            }
+        }
+
+        cv::Mat stripe = fDst.rowRange(range.start, range.end);
+        cv::cvtColor(stripe, stripe, cv::COLOR_Lab2BGR);
+    }
+
+private:
+    cv::Mat &fDst;
+    int fTilesX;
+    int fTilesY;
+    const std::vector<uchar> &fLuts;
+    std::vector<int> fTx1;
+    std::vector<int> fTx2;
+    std::vector<float> fXa;
+};
+
+}
+
+void claheLab(const cv::Mat &src, cv::Mat &dst, const ClaheParams &params)
+{
+    TRACE_SPAN("claheLab");
+    CV_Assert(src.type() == CV_8UC3);
+    dst.create(src.size(), src.type());
+    if (src.empty())
+        return;
+
+    const int tilesX = std::max(1, std::min(params.tilesX, src.cols));
+    const int tilesY = std::max(1, std::min(params.tilesY, src.rows));
+    std::vector<int> colEdges(tilesX + 1), rowEdges(tilesY + 1);
+    for (int i = 0; i <= tilesX; i++)
+        colEdges[i] = i * src.cols / tilesX;
+    for (int i = 0; i <= tilesY; i++)
+        rowEdges[i] = i * src.rows / tilesY;
+
+    std::vector<uchar> luts(size_t(tilesX) * tilesY * histSize);
+    cv::parallel_for_(cv::Range(0, tilesY), TileRowPass(src, dst, params.clipLimit, colEdges, rowEdges, luts));
+    cv::parallel_for_(cv::Range(0, src.rows), MappingPass(dst, tilesX, tilesY, luts));
+}
+
+} // namespace OpencvKernels
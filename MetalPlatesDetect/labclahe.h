@@ -0,0 +1,26 @@
+#ifndef LABCLAHE_H
+#define LABCLAHE_H
+
+#include <opencv2/core.hpp>
+
+// Contrast limited adaptive histogram equalization of the lightness of a BGR
+// frame, to flatten glare on metal. The Lab conversion, the per-tile
+// histograms and the interpolated mapping run fused in horizontal stripes,
+// with the destination frame as the only working buffer: no split, merge or
+// separate L plane. Only CV_8UC3 frames are supported.
+namespace OpencvKernels {
+
+struct ClaheParams {
+    ClaheParams();
+
+    double  clipLimit;      // histogram bins are clipped at this multiple of the uniform height
+    int     tilesX;
+    int     tilesY;
+};
+
+// src and dst may be the same frame
+void claheLab(const cv::Mat &src, cv::Mat &dst, const ClaheParams &params);
+
+} // namespace OpencvKernels
+
+#endif // LABCLAHE_H
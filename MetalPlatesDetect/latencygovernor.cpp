@@ -0,0 +1,160 @@
+#include "latencygovernor.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+// cheapest degradation first
+const LatencyGovernor::Level levels[] = {
+    { 1, false, false },
+    { 1, false, true },
+    { 1, true,  true },
+    { 2, true,  true },
+    { 4, true,  true }
+};
+
+const int levelsCount = int(sizeof(levels) / sizeof(levels[0]));
+
+}
+
+LatencyGovernor::Params::Params() :
+    enabled(false),
+    deadlineMs(40),
+    riskFraction(0.85),
+    headroomFraction(0.5),
+    stepUpAfter(30),
+    settleFrames(3),
+    smoothing(0.2),
+    maxLevel(levelsCount - 1)
+{
+}
+
+LatencyGovernor::LatencyGovernor() :
+    fLevel(0),
+    fSettle(0),
+    fHeadroomFrames(0),
+    fFrameMs(0)
+{
+    fStats.framesAtLevel.assign(levelsCount, 0);
+}
+
+void LatencyGovernor::setParams(const Params &params)
+{
+    fParams = params;
+    fParams.maxLevel = std::max(0, std::min(fParams.maxLevel, levelsCount - 1));
+    reset();
+}
+
+void LatencyGovernor::reset()
+{
+    fLevel = 0;
+    fSettle = 0;
+    fHeadroomFrames = 0;
+    fStageMs.clear();
+    fFrameMs = 0;
+}
+
+int LatencyGovernor::levelCount()
+{
+    return levelsCount;
+}
+
+LatencyGovernor::Level LatencyGovernor::levelAt(int level)
+{
+    return levels[std::max(0, std::min(level, levelsCount - 1))];
+}
+
+std::string LatencyGovernor::describe(int level)
+{
+    Level l = levelAt(level);
+    if (l.downscale == 1 && !l.fallbackAlgo && !l.skipOptional)
+        return "full quality";
+
+    std::ostringstream out;
+    const char *separator = "";
+    if (l.skipOptional) {
+        out << "optional stages skipped";
+        separator = ", ";
+    }
+    if (l.fallbackAlgo) {
+        out << separator << "fallback algorithm";
+        separator = ", ";
+    }
+    if (l.downscale > 1)
+        out << separator << "1/" << l.downscale << " resolution";
+    return out.str();
+}
+
+void LatencyGovernor::recordStage(int stage, double ms)
+{
+    if (stage < 0)
+        return;
+    if (stage >= int(fStageMs.size()))
+        fStageMs.resize(stage + 1, -1);
+    double &average = fStageMs[stage];
+    average = average < 0 ? ms : average + fParams.smoothing * (ms - average);
+}
+
+double LatencyGovernor::predictedMs() const
+{
+    double sum = 0;
+    for (size_t i = 0; i < fStageMs.size(); i++)
+        sum += std::max(fStageMs[i], 0.0);
+    // stages the caller does not report (decode, conversions) still count
+    return std::max(sum, fFrameMs);
+}
+
+int LatencyGovernor::slowestStage() const
+{
+    if (fStageMs.empty())
+        return -1;
+    return int(std::max_element(fStageMs.begin(), fStageMs.end()) - fStageMs.begin());
+}
+
+bool LatencyGovernor::endFrame(double frameMs)
+{
+    fStats.frames++;
+    fStats.framesAtLevel[fLevel]++;
+    bool missed = frameMs > fParams.deadlineMs;
+    if (missed)
+        fStats.missed++;
+    fFrameMs = fFrameMs <= 0 ? frameMs : fFrameMs + fParams.smoothing * (frameMs - fFrameMs);
+
+    if (!fParams.enabled)
+        return false;
+    if (fSettle > 0) {
+        fSettle--;
+        // a missed deadline does not wait for the averages to settle
+        if (!missed)
+            return false;
+    }
+
+    double predicted = predictedMs();
+    if ((missed || predicted > fParams.riskFraction * fParams.deadlineMs) && fLevel < fParams.maxLevel) {
+        fStats.stepsDown++;
+        changeLevel(fLevel + 1);
+        return true;
+    }
+
+    if (predicted < fParams.headroomFraction * fParams.deadlineMs && fLevel > 0) {
+        if (++fHeadroomFrames >= fParams.stepUpAfter) {
+            fStats.stepsUp++;
+            changeLevel(fLevel - 1);
+            return true;
+        }
+    }
+    else
+        fHeadroomFrames = 0;
+    return false;
+}
+
+void LatencyGovernor::changeLevel(int level)
+{
+    fLevel = level;
+    fHeadroomFrames = 0;
+    fSettle = fParams.settleFrames;
+    // the stage costs at the new level have to be measured again
+    fStageMs.clear();
+    fFrameMs = 0;
+}
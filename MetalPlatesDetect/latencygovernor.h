@@ -0,0 +1,78 @@
+#ifndef LATENCYGOVERNOR_H
+#define LATENCYGOVERNOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Keeps the per-frame latency under a deadline by walking a ladder of
+// degradation levels: skip optional stages, fall back to a cheaper
+// background model, then process at lower resolution. The next frame's cost
+// is predicted from smoothed per-stage times; the governor steps down when
+// the prediction or the last frame gets close to the deadline and steps back
+// up after enough frames with headroom.
+class LatencyGovernor
+{
+public:
+    struct Params {
+        Params();
+
+        bool    enabled;
+        double  deadlineMs;         // per-frame budget
+        double  riskFraction;       // step down when the prediction exceeds this share of the budget
+        double  headroomFraction;   // step up when the prediction stays below this share of the budget
+        int     stepUpAfter;        // frames with headroom needed before stepping up
+        int     settleFrames;       // frames measured after a level change before deciding again
+        double  smoothing;          // weight of the newest sample in the running averages
+        int     maxLevel;           // deepest level the governor may go to
+    };
+
+    struct Level {
+        int     downscale;          // processing resolution divisor
+        bool    fallbackAlgo;       // use the cheap background model
+        bool    skipOptional;       // leave out stages that only refine the result
+    };
+
+    struct Stats {
+        Stats() : frames(0), missed(0), stepsDown(0), stepsUp(0) {}
+        uint64_t frames;
+        uint64_t missed;            // frames over the deadline
+        uint64_t stepsDown;
+        uint64_t stepsUp;
+        std::vector<uint64_t> framesAtLevel;
+    };
+
+    LatencyGovernor();
+
+    void setParams(const Params &params);
+    const Params &params() const { return fParams; }
+    void reset();
+
+    static int levelCount();
+    static Level levelAt(int level);
+    static std::string describe(int level);
+
+    // time of one stage of the current frame, stages are numbered by the caller
+    void recordStage(int stage, double ms);
+    // closes the frame, returns true when the level for the next frame changed
+    bool endFrame(double frameMs);
+
+    int level() const { return fLevel; }
+    Level currentLevel() const { return levelAt(fLevel); }
+    double predictedMs() const;
+    int slowestStage() const;
+    const Stats &stats() const { return fStats; }
+
+private:
+    Params fParams;
+    int fLevel;
+    int fSettle;
+    int fHeadroomFrames;
+    std::vector<double> fStageMs;
+    double fFrameMs;
+    Stats fStats;
+
+    void changeLevel(int level);
+};
+
+#endif // LATENCYGOVERNOR_H
@@ -1,8 +1,129 @@
 #include "testmetaldetectwindow.h"
+#include "headlessprocessor.h"
+#include "perfregression.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QScopedPointer>
+#include <QDateTime>
+#include <limits>
+
+static bool hasOption(int argc, char *argv[], const char *option)
+{
+    for (int i = 1; i < argc; i++) {
+        if (qstrcmp(argv[i], option) == 0)
+            return true;
+    }
+    return false;
+}
+
+static int runHeadless(int argc, char *argv[])
+{
+    // --verify-chain runs the GUI's tool widgets, offscreen unless a platform is chosen
+    QScopedPointer<QCoreApplication> application;
+    if (hasOption(argc, argv, "--verify-chain")) {
+        if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+            qputenv("QT_QPA_PLATFORM", "offscreen");
+        application.reset(new QApplication(argc, argv));
+    }
+    else
+        application.reset(new QCoreApplication(argc, argv));
+    QCoreApplication &a = *application;
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs the production pipeline over image files without GUI.");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("headless", "Run without GUI."));
+    parser.addOption(QCommandLineOption("config", "Settings file.", "file", "config.ini"));
+    parser.addOption(QCommandLineOption("stream", "Camera stream, selects the cores from the Affinity settings.", "index", "0"));
+    parser.addOption(QCommandLineOption("background", "Background image, overrides the one from settings.", "file"));
+    parser.addOption(QCommandLineOption("output", "Directory for the masks.", "dir"));
+    parser.addOption(QCommandLineOption("packed-masks", "Write the masks 1 bit per pixel as .pmask instead of PNG."));
+    parser.addOption(QCommandLineOption("convert-masks", "Convert the PNG masks of the inputs to .pmask and .pmask back to PNG, "
+                                                         "into --output or next to them."));
+    parser.addOption(QCommandLineOption("output-ring", "Publish frames and masks to this shared-memory ring, overrides the settings.", "name"));
+    parser.addOption(QCommandLineOption("consume-ring", "Follow the shared-memory ring of this name and print what arrives.", "name"));
+    parser.addOption(QCommandLineOption("seconds", "How long --consume-ring follows the ring.", "seconds", "10"));
+    parser.addOption(QCommandLineOption("no-config-watch", "Ignore edits of the settings file while running."));
+    parser.addOption(QCommandLineOption("track", "Skip unchanged frames and regions with the plate tracker."));
+    parser.addOption(QCommandLineOption("motion-gate", "Skip the pipeline on frames without motion."));
+    parser.addOption(QCommandLineOption("deadline", "Per-frame budget, degrades the processing when it is at risk.", "ms"));
+    parser.addOption(QCommandLineOption("metrics-port", "Serve Prometheus metrics on this local port, overrides the settings.", "port"));
+    parser.addOption(QCommandLineOption("trace", "Write a Chrome trace of the run to this file, overrides the settings.", "file"));
+    parser.addOption(QCommandLineOption("detection-log", "Append the detections to this binary log, overrides the settings.", "file"));
+    parser.addOption(QCommandLineOption("query-log", "Print the detections of this binary log instead of processing.", "file"));
+    parser.addOption(QCommandLineOption("from", "First time printed by --query-log, ISO date.", "time"));
+    parser.addOption(QCommandLineOption("to", "End of the times printed by --query-log, ISO date.", "time"));
+    parser.addOption(QCommandLineOption("log-stream", "Only print this stream with --query-log.", "index", "-1"));
+    parser.addOption(QCommandLineOption("batch", "Decode and process this many frames together.", "frames", "1"));
+    parser.addOption(QCommandLineOption("memory-stats", "Count memory per stage and report it with the stats."));
+    parser.addOption(QCommandLineOption("benchmark-mixture", "Compare the SoA mixture model with MOG2 instead of writing masks, "
+                                                             "fail when its half precision drifts from float."));
+    parser.addOption(QCommandLineOption("compare", "Run the subtractor of this settings file next to the configured one, "
+                                                   "write both masks and their difference.", "file"));
+    parser.addOption(QCommandLineOption("verify-chain", "Run the compiled chain and the GUI's tool plan configured from the settings "
+                                                        "on the inputs, fail when their masks differ."));
+    parser.addOption(QCommandLineOption("perf-check", "Time the fixed perf configurations on synthetic frames, fail when slower than the baseline."));
+    parser.addOption(QCommandLineOption("perf-record", "Time the fixed perf configurations on synthetic frames and write them as the baseline."));
+    parser.addOption(QCommandLineOption("perf-baseline", "Baseline of the perf configurations, a directory holds one per CPU model.",
+                                        "path", "perf"));
+    parser.addOption(QCommandLineOption("perf-tolerance", "Slowdown tolerated by --perf-check.", "percent", "15"));
+    parser.addPositionalArgument("inputs", "Image files or directories.", "inputs...");
+    parser.process(a);
+
+    // independent of the settings, the frames and configurations are fixed
+    if (parser.isSet("perf-record"))
+        return PerfRegression::record(parser.value("perf-baseline"));
+    if (parser.isSet("perf-check"))
+        return PerfRegression::check(parser.value("perf-baseline"), parser.value("perf-tolerance").toDouble());
+    if (parser.isSet("consume-ring"))
+        return HeadlessProcessor::consumeRing(parser.value("consume-ring"), parser.value("seconds").toInt());
+    if (parser.isSet("convert-masks"))
+        return HeadlessProcessor::convertMasks(parser.positionalArguments(), parser.value("output"));
+    if (parser.isSet("query-log")) {
+        int64_t fromUs = std::numeric_limits<int64_t>::min();
+        int64_t toUs = std::numeric_limits<int64_t>::max();
+        if (parser.isSet("from"))
+            fromUs = QDateTime::fromString(parser.value("from"), Qt::ISODate).toMSecsSinceEpoch() * 1000;
+        if (parser.isSet("to"))
+            toUs = QDateTime::fromString(parser.value("to"), Qt::ISODate).toMSecsSinceEpoch() * 1000;
+        return HeadlessProcessor::queryDetectionLog(parser.value("query-log"), fromUs, toUs, parser.value("log-stream").toInt());
+    }
+
+    HeadlessProcessor processor(parser.value("config"), parser.value("stream").toInt());
+    if (parser.isSet("background") && !processor.setBackground(parser.value("background")))
+        return 1;
+    processor.setOutputDir(parser.value("output"));
+    processor.setPackedMasks(parser.isSet("packed-masks"));
+    processor.setWatchConfig(!parser.isSet("no-config-watch"));
+    if (parser.isSet("output-ring"))
+        processor.setOutputRing(parser.value("output-ring"));
+    processor.setTracking(parser.isSet("track"));
+    processor.setMotionGate(parser.isSet("motion-gate"));
+    if (parser.isSet("deadline"))
+        processor.setLatencyGovernor(true, parser.value("deadline").toDouble());
+    if (parser.isSet("metrics-port"))
+        processor.setMetricsPort(parser.value("metrics-port").toInt());
+    if (parser.isSet("trace"))
+        processor.setTraceFile(parser.value("trace"));
+    if (parser.isSet("detection-log"))
+        processor.setDetectionLogFile(parser.value("detection-log"));
+    processor.setBatchSize(parser.value("batch").toInt());
+    if (parser.isSet("memory-stats"))
+        processor.setMemoryAccounting(true);
+    if (parser.isSet("benchmark-mixture"))
+        return processor.benchmarkMixture(parser.positionalArguments());
+    if (parser.isSet("compare"))
+        return processor.compareCandidate(parser.value("compare"), parser.positionalArguments());
+    if (parser.isSet("verify-chain"))
+        return processor.verifyChain(parser.positionalArguments());
+    return processor.run(parser.positionalArguments());
+}
 
 int main(int argc, char *argv[])
 {
+    if (hasOption(argc, argv, "--headless"))
+        return runHeadless(argc, argv);
+
     QApplication a(argc, argv);
     TestMetalDetectWindow w;
     w.show();
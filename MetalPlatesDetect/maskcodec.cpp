@@ -0,0 +1,257 @@
+#include "maskcodec.h"
+#include "tracing.h"
+
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace OpencvKernels {
+
+namespace {
+
+// magic, version, encoding, 2 reserved bytes, columns and rows as uint32
+const char magic[4] = { 'M', 'P', 'M', 'K' };
+const uchar version = 1;
+const size_t headerSize = 16;
+// larger headers are taken for corrupt, 16384 x 16384
+const uint64_t maxMaskPixels = uint64_t(1) << 28;
+const uchar foregroundThreshold = 127;
+
+// bit i of byte x / 8 is pixel x, the order v_signmask gives
+void packRow(const uchar *src, int cols, uchar *dst)
+{
+    int x = 0;
+#if CV_SIMD128
+    const cv::v_uint8x16 threshold = cv::v_setall_u8(foregroundThreshold);
+    for (; x <= cols - 16; x += 16) {
+        int bits = cv::v_signmask(cv::v_load(src + x) > threshold);
+        dst[x / 8] = uchar(bits);
+        dst[x / 8 + 1] = uchar(bits >> 8);
+    }
+#endif
+    for (; x < cols; x += 8) {
+        uchar bits = 0;
+        for (int i = 0; i < 8 && x + i < cols; i++)
+            bits |= uchar((src[x + i] > foregroundThreshold) << i);
+        dst[x / 8] = bits;
+    }
+}
+
+// the 8 pixels of every byte value, copied as one word
+const uint64_t *unpackTable()
+{
+    static struct Table {
+        Table()
+        {
+            for (int value = 0; value < 256; value++) {
+                uchar pixels[8];
+                for (int i = 0; i < 8; i++)
+                    pixels[i] = (value >> i) & 1 ? 255 : 0;
+                memcpy(&words[value], pixels, 8);
+            }
+        }
+        uint64_t words[256];
+    } table;
+    return table.words;
+}
+
+void unpackRow(const uchar *src, int cols, uchar *dst)
+{
+    const uint64_t *table = unpackTable();
+    int x = 0;
+    for (; x <= cols - 8; x += 8)
+        memcpy(dst + x, &table[src[x / 8]], 8);
+    if (x < cols)
+        memcpy(dst + x, &table[src[x / 8]], cols - x);
+}
+
+void putVarint(std::vector<uchar> &out, uint32_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(uchar(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(uchar(value));
+}
+
+bool getVarint(const uchar *&p, const uchar *end, uint32_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        uchar byte = *p++;
+        value |= uint32_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+int trailingZeros(uint64_t word)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#elif defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return int(index);
+#else
+    int n = 0;
+    for (; !(word & 1); word >>= 1)
+        n++;
+    return n;
+#endif
+}
+
+// Runs of a packed row, starting with background, so a row that starts with
+// foreground begins with an empty run. The row is scanned 64 pixels at a
+// time for the next pixel of the other value.
+void runLengthRow(const uchar *bits, int cols, std::vector<uchar> &out)
+{
+    if (!cols)
+        return;
+    const int bytes = (cols + 7) / 8;
+    bool foreground = false;
+    uint32_t run = 0;
+    for (int x = 0; x < cols; x += 64) {
+        uint64_t word = 0;
+        memcpy(&word, bits + x / 8, std::min(8, bytes - x / 8));
+        const int valid = std::min(64, cols - x);
+        int bit = 0;
+        while (bit < valid) {
+            uint64_t other = (foreground ? ~word : word) >> bit;
+            int length = other ? std::min(trailingZeros(other), valid - bit) : valid - bit;
+            run += length;
+            bit += length;
+            if (bit < valid) {
+                putVarint(out, run);
+                foreground = !foreground;
+                run = 0;
+            }
+        }
+    }
+    putVarint(out, run);
+}
+
+void writeHeader(uchar *p, MaskEncoding encoding, int cols, int rows)
+{
+    uint32_t size[2] = { uint32_t(cols), uint32_t(rows) };
+    memcpy(p, magic, 4);
+    p[4] = version;
+    p[5] = uchar(encoding);
+    p[6] = p[7] = 0;
+    memcpy(p + 8, size, 8);
+}
+
+}
+
+void encodeMask(const cv::Mat &mask, std::vector<uchar> &encoded)
+{
+    TRACE_SPAN("encode mask");
+    CV_Assert(mask.type() == CV_8UC1);
+    const int rowBytes = (mask.cols + 7) / 8;
+    const size_t packedSize = size_t(rowBytes) * mask.rows;
+    encoded.resize(headerSize + packedSize);
+    uchar *packed = encoded.data() + headerSize;
+    for (int y = 0; y < mask.rows; y++)
+        packRow(mask.ptr<uchar>(y), mask.cols, packed + size_t(y) * rowBytes);
+
+    // the runs are dropped as soon as they get larger than the packed bits
+    std::vector<uchar> runs;
+    runs.reserve(packedSize / 4);
+    int y = 0;
+    for (; y < mask.rows && runs.size() < packedSize; y++)
+        runLengthRow(packed + size_t(y) * rowBytes, mask.cols, runs);
+    if (y == mask.rows && runs.size() < packedSize) {
+        encoded.resize(headerSize);
+        encoded.insert(encoded.end(), runs.begin(), runs.end());
+        writeHeader(encoded.data(), maskRunLength, mask.cols, mask.rows);
+    }
+    else {
+        writeHeader(encoded.data(), maskBitPacked, mask.cols, mask.rows);
+    }
+}
+
+int maskEncoding(const uchar *data, size_t size)
+{
+    if (size < headerSize || memcmp(data, magic, 4) != 0 || data[4] != version)
+        return 0;
+    return data[5] == maskBitPacked || data[5] == maskRunLength ? data[5] : 0;
+}
+
+bool decodeMask(const uchar *data, size_t size, cv::Mat &mask)
+{
+    TRACE_SPAN("decode mask");
+    const int encoding = maskEncoding(data, size);
+    if (!encoding)
+        return false;
+    uint32_t dims[2];
+    memcpy(dims, data + 8, 8);
+    if (dims[0] > uint32_t(INT_MAX) || dims[1] > uint32_t(INT_MAX) || uint64_t(dims[0]) * dims[1] > maxMaskPixels)
+        return false;
+    const int cols = int(dims[0]);
+    const int rows = int(dims[1]);
+    const uchar *p = data + headerSize;
+    const uchar *end = data + size;
+    const int rowBytes = (cols + 7) / 8;
+
+    if (encoding == maskBitPacked) {
+        if (size_t(end - p) < size_t(rowBytes) * rows)
+            return false;
+        mask.create(rows, cols, CV_8UC1);
+        for (int y = 0; y < rows; y++)
+            unpackRow(p + size_t(y) * rowBytes, cols, mask.ptr<uchar>(y));
+        return true;
+    }
+
+    // every row of runs takes at least a byte, checked before the header size is allocated
+    if (cols > 0 && size_t(rows) > size_t(end - p))
+        return false;
+    mask.create(rows, cols, CV_8UC1);
+    for (int y = 0; y < rows; y++) {
+        uchar *row = mask.ptr<uchar>(y);
+        bool foreground = false;
+        int x = 0;
+        while (x < cols) {
+            uint32_t run;
+            if (!getVarint(p, end, run) || run > uint32_t(cols - x))
+                return false;
+            memset(row + x, foreground ? 255 : 0, run);
+            x += int(run);
+            foreground = !foreground;
+        }
+    }
+    return true;
+}
+
+bool writeMask(const std::string &path, const cv::Mat &mask)
+{
+    std::vector<uchar> encoded;
+    encodeMask(mask, encoded);
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+    return fclose(file) == 0 && ok;
+}
+
+bool readMask(const std::string &path, cv::Mat &mask)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    std::vector<uchar> data;
+    uchar buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.insert(data.end(), buffer, buffer + n);
+    fclose(file);
+    return decodeMask(data.data(), data.size(), mask);
+}
+
+} // namespace OpencvKernels
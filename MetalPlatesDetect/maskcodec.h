@@ -0,0 +1,33 @@
+#ifndef MASKCODEC_H
+#define MASKCODEC_H
+
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+// Compact storage of foreground masks for the audit archive. Masks are
+// thresholded to one bit per pixel as binarize does in the mask cleanup, so
+// MOG2/KNN shadow values count as background, and stored either bit-packed,
+// 8 pixels per byte, or as the lengths of the alternating background and
+// foreground runs of every row, whichever is smaller. A mask with a few
+// plates takes a few bytes per row. Decoded masks are 0/255 CV_8UC1.
+namespace OpencvKernels {
+
+enum MaskEncoding {
+    maskBitPacked = 1,
+    maskRunLength = 2
+};
+
+// CV_8UC1 masks only; the encoding that was chosen is stored with the data
+void encodeMask(const cv::Mat &mask, std::vector<uchar> &encoded);
+// false when the data is no encoded mask or is cut short
+bool decodeMask(const uchar *data, size_t size, cv::Mat &mask);
+// the encoding of data from encodeMask, 0 when it is none
+int maskEncoding(const uchar *data, size_t size);
+
+bool writeMask(const std::string &path, const cv::Mat &mask);
+bool readMask(const std::string &path, cv::Mat &mask);
+
+} // namespace OpencvKernels
+
+#endif // MASKCODEC_H
@@ -0,0 +1,191 @@
+#include "memoryaccounting.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// stage of the StageScope alive on this thread, -1 outside of any
+thread_local int tStage = -1;
+
+}
+
+MemoryAccounting &MemoryAccounting::instance()
+{
+    // never destroyed, buffers counted by it may be released during static destruction
+    static MemoryAccounting *accounting = new MemoryAccounting;
+    return *accounting;
+}
+
+MemoryAccounting::MemoryAccounting() :
+    fBacking(cv::Mat::getStdAllocator()),
+    fInstalled(false),
+    fStageCount(1),
+    fLastStage(0),
+    fLive(0),
+    fPeak(0),
+    fFrameAllocations(0),
+    fFrames(0),
+    fLastFrameAllocations(0),
+    fWindowMin(0),
+    fPreviousWindowMin(-1),
+    fGrowingWindows(0)
+{
+    fStages[0].name.store("other", std::memory_order_relaxed);
+}
+
+void MemoryAccounting::install()
+{
+    fBacking = cv::Mat::getDefaultAllocator();
+    cv::Mat::setDefaultAllocator(this);
+    fInstalled.store(true, std::memory_order_relaxed);
+}
+
+int MemoryAccounting::stageId(const char *name)
+{
+    std::lock_guard<std::mutex> lock(fRegistryMutex);
+    int count = fStageCount.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+        if (std::strcmp(fStages[i].name.load(std::memory_order_relaxed), name) == 0)
+            return i;
+    }
+    if (count == maxStages)
+        return 0;
+    fStages[count].name.store(name, std::memory_order_relaxed);
+    fStageCount.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+MemoryAccounting::StageScope::StageScope(int stage) :
+    fPrevious(tStage),
+    fActive(instance().isInstalled())
+{
+    if (fActive) {
+        tStage = stage;
+        instance().fLastStage.store(stage, std::memory_order_relaxed);
+    }
+}
+
+MemoryAccounting::StageScope::StageScope(const char *name) :
+    fPrevious(tStage),
+    fActive(instance().isInstalled())
+{
+    if (fActive) {
+        tStage = instance().stageId(name);
+        instance().fLastStage.store(tStage, std::memory_order_relaxed);
+    }
+}
+
+MemoryAccounting::StageScope::~StageScope()
+{
+    if (fActive) {
+        tStage = fPrevious;
+        instance().fLastStage.store(std::max(fPrevious, 0), std::memory_order_relaxed);
+    }
+}
+
+int MemoryAccounting::currentStage() const
+{
+    return tStage >= 0 ? tStage : fLastStage.load(std::memory_order_relaxed);
+}
+
+void MemoryAccounting::raisePeak(std::atomic<int64_t> &peak, int64_t value)
+{
+    int64_t current = peak.load(std::memory_order_relaxed);
+    while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+cv::UMatData *MemoryAccounting::allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                                         cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const
+{
+    cv::UMatData *u = fBacking->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    if (!u)
+        return u;
+    u->currAllocator = this;
+    if (data)
+        return u;   // the caller's memory, nothing to count
+
+    int stage = currentStage();
+    u->allocatorFlags_ = stage + 1;
+    const int64_t size = int64_t(u->size);
+    const StageCounters &counters = fStages[stage];
+    raisePeak(counters.peak, counters.live.fetch_add(size, std::memory_order_relaxed) + size);
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.frameAllocations.fetch_add(1, std::memory_order_relaxed);
+    raisePeak(fPeak, fLive.fetch_add(size, std::memory_order_relaxed) + size);
+    fFrameAllocations.fetch_add(1, std::memory_order_relaxed);
+    return u;
+}
+
+bool MemoryAccounting::allocate(cv::UMatData *data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const
+{
+    return fBacking->allocate(data, accessFlags, usageFlags);
+}
+
+void MemoryAccounting::deallocate(cv::UMatData *u) const
+{
+    if (!u)
+        return;
+    if (u->allocatorFlags_ > 0) {
+        const int64_t size = int64_t(u->size);
+        fStages[u->allocatorFlags_ - 1].live.fetch_sub(size, std::memory_order_relaxed);
+        fLive.fetch_sub(size, std::memory_order_relaxed);
+    }
+    fBacking->deallocate(u);
+}
+
+bool MemoryAccounting::endFrame()
+{
+    fFrames++;
+    fLastFrameAllocations = fFrameAllocations.exchange(0, std::memory_order_relaxed);
+    int count = fStageCount.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++)
+        fStages[i].lastFrameAllocations = fStages[i].frameAllocations.exchange(0, std::memory_order_relaxed);
+
+    // the first window only sets the baseline, models and buffers fill up there
+    int64_t live = liveBytes();
+    fWindowMin = (fFrames - 1) % windowFrames == 0 ? live : std::min(fWindowMin, live);
+    if (fFrames % windowFrames)
+        return false;
+    if (fPreviousWindowMin >= 0 && fWindowMin > fPreviousWindowMin + leakGrowthBytes)
+        fGrowingWindows++;
+    else
+        fGrowingWindows = 0;
+    fPreviousWindowMin = fWindowMin;
+    return leakSuspected();
+}
+
+std::vector<MemoryAccounting::StageStats> MemoryAccounting::stageStats() const
+{
+    std::vector<StageStats> stats;
+    int count = fStageCount.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        const StageCounters &counters = fStages[i];
+        StageStats s;
+        s.name = counters.name.load(std::memory_order_relaxed);
+        s.liveBytes = counters.live.load(std::memory_order_relaxed);
+        s.peakBytes = counters.peak.load(std::memory_order_relaxed);
+        s.allocations = counters.allocations.load(std::memory_order_relaxed);
+        s.frameAllocations = counters.lastFrameAllocations;
+        stats.push_back(s);
+    }
+    return stats;
+}
+
+std::string MemoryAccounting::describe() const
+{
+    std::string text;
+    std::vector<StageStats> stats = stageStats();
+    for (size_t i = 0; i < stats.size(); i++) {
+        const StageStats &s = stats[i];
+        if (!s.allocations)
+            continue;
+        char line[256];
+        snprintf(line, sizeof(line), "%s: live %.1f MB, peak %.1f MB, %llu allocations, %llu in the last frame\n",
+                 s.name.c_str(), s.liveBytes / (1024. * 1024), s.peakBytes / (1024. * 1024),
+                 (unsigned long long)s.allocations, (unsigned long long)s.frameAllocations);
+        text += line;
+    }
+    return text;
+}
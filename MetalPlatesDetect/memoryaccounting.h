@@ -0,0 +1,116 @@
+#ifndef MEMORYACCOUNTING_H
+#define MEMORYACCOUNTING_H
+
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// cv::Mat allocator that counts every buffer against the stage that
+// allocated it. The buffers themselves come from the allocator that was the
+// default when it was installed (the standard one or the frame arena); the stage id is kept in the buffer's UMatData so the memory is
+// given back to the same stage however long the buffer lives.
+// A thread is in a stage while a StageScope is alive on it. Threads that
+// never enter one, like the workers of cv::parallel_for_, count against the
+// stage entered last by any thread.
+// Frames are closed by endFrame(), which also watches the live memory for
+// steady growth: the lowest live size of every window of frames is compared
+// with the previous window, a few growing windows in a row are reported.
+class MemoryAccounting : public cv::MatAllocator
+{
+public:
+    enum { maxStages = 32 };
+
+    struct StageStats {
+        std::string name;
+        int64_t     liveBytes;
+        int64_t     peakBytes;
+        uint64_t    allocations;
+        uint64_t    frameAllocations;   // during the last closed frame
+    };
+
+    static MemoryAccounting &instance();
+
+    // makes it the default allocator of cv::Mat in front of the current one,
+    // buffers allocated before are not counted
+    void install();
+    bool isInstalled() const { return fInstalled.load(std::memory_order_relaxed); }
+
+    // names must outlive the accounting; the same name always gives the same id, 0 is "other"
+    int stageId(const char *name);
+
+    class StageScope
+    {
+    public:
+        explicit StageScope(int stage);
+        explicit StageScope(const char *name);
+        ~StageScope();
+
+    private:
+        int fPrevious;
+        bool fActive;
+
+        StageScope(const StageScope&);
+        StageScope &operator=(const StageScope&);
+    };
+
+    // closes a frame, returns true when the live memory has kept growing for leakWindows windows
+    bool endFrame();
+    bool leakSuspected() const { return fGrowingWindows >= leakWindows; }
+
+    int64_t liveBytes() const { return fLive.load(std::memory_order_relaxed); }
+    int64_t peakBytes() const { return fPeak.load(std::memory_order_relaxed); }
+    uint64_t frameAllocations() const { return fLastFrameAllocations; }
+    uint64_t frames() const { return fFrames; }
+    std::vector<StageStats> stageStats() const;
+    // one line per stage that ever allocated
+    std::string describe() const;
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData *data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData *data) const override;
+
+private:
+    enum { windowFrames = 100, leakWindows = 3 };
+    static const int64_t leakGrowthBytes = 256 * 1024;     // per window
+
+    struct StageCounters {
+        StageCounters() : name(nullptr), live(0), peak(0), allocations(0), frameAllocations(0), lastFrameAllocations(0) {}
+        std::atomic<const char*> name;
+        mutable std::atomic<int64_t> live;
+        mutable std::atomic<int64_t> peak;
+        mutable std::atomic<uint64_t> allocations;
+        mutable std::atomic<uint64_t> frameAllocations;
+        uint64_t lastFrameAllocations;
+    };
+
+    MemoryAccounting();
+
+    int currentStage() const;
+    static void raisePeak(std::atomic<int64_t> &peak, int64_t value);
+
+    const cv::MatAllocator *fBacking;
+    std::atomic<bool> fInstalled;
+    std::mutex fRegistryMutex;
+    std::atomic<int> fStageCount;
+    StageCounters fStages[maxStages];
+    std::atomic<int> fLastStage;
+
+    mutable std::atomic<int64_t> fLive;
+    mutable std::atomic<int64_t> fPeak;
+    mutable std::atomic<uint64_t> fFrameAllocations;
+
+    // frame bookkeeping, only touched by endFrame()
+    uint64_t fFrames;
+    uint64_t fLastFrameAllocations;
+    int64_t fWindowMin;
+    int64_t fPreviousWindowMin;
+    int fGrowingWindows;
+
+    MemoryAccounting(const MemoryAccounting&);
+    MemoryAccounting &operator=(const MemoryAccounting&);
+};
+
+#endif // MEMORYACCOUNTING_H
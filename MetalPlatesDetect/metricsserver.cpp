@@ -0,0 +1,89 @@
+#include "metricsserver.h"
+#include "pipelinemetrics.h"
+#include <QTcpSocket>
+#include <QDebug>
+
+MetricsListener::MetricsListener(const PipelineMetrics *metrics, QObject *parent) :
+    QTcpServer(parent),
+    fMetrics(metrics)
+{
+    connect(this, SIGNAL(newConnection()), this, SLOT(acceptConnections()));
+}
+
+void MetricsListener::acceptConnections()
+{
+    while (QTcpSocket *socket = nextPendingConnection()) {
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void MetricsListener::readRequest()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket || !socket->canReadLine())
+        return;
+
+    // only the request line matters, the headers are dropped
+    QList<QByteArray> request = socket->readLine().trimmed().split(' ');
+    socket->readAll();
+    disconnect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+
+    QByteArray status = "200 OK";
+    QByteArray body;
+    if (request.count() < 2 || request[0] != "GET") {
+        status = "405 Method Not Allowed";
+    }
+    else if (request[1] == "/metrics") {
+        body = QByteArray::fromStdString(fMetrics->exposition());
+    }
+    else {
+        status = "404 Not Found";
+    }
+
+    QByteArray response = "HTTP/1.1 " + status + "\r\n"
+            "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+            "Connection: close\r\n\r\n" + body;
+    socket->write(response);
+    socket->disconnectFromHost();
+}
+
+MetricsServer::MetricsServer(const PipelineMetrics *metrics, QObject *parent) :
+    QThread(parent),
+    fMetrics(metrics),
+    fPort(0)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+}
+
+void MetricsServer::start(quint16 port)
+{
+    stop();
+    fPort = port;
+    QThread::start();
+}
+
+void MetricsServer::stop()
+{
+    if (isRunning()) {
+        quit();
+        wait();
+    }
+}
+
+void MetricsServer::run()
+{
+    // created here so its sockets belong to this thread's event loop
+    MetricsListener listener(fMetrics);
+    if (!listener.listen(QHostAddress::LocalHost, fPort)) {
+        qWarning() << "Metrics server can't listen on port" << fPort << ":" << listener.errorString();
+        return;
+    }
+    qInfo() << "Serving metrics on" << QString("http://127.0.0.1:%1/metrics").arg(listener.serverPort());
+    exec();
+}
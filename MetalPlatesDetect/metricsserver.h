@@ -0,0 +1,48 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QThread>
+#include <QTcpServer>
+
+class PipelineMetrics;
+
+// Answers GET /metrics with the Prometheus exposition of the metrics, any
+// other path with 404. One request per connection.
+class MetricsListener : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsListener(const PipelineMetrics *metrics, QObject *parent = nullptr);
+
+private:
+    const PipelineMetrics *fMetrics;
+
+private slots:
+    void acceptConnections();
+    void readRequest();
+};
+
+// Serves the metrics on the loopback interface from a thread of its own, so
+// scrapes are answered while the pipeline keeps the caller's thread busy:
+//   curl http://127.0.0.1:<port>/metrics
+class MetricsServer : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsServer(const PipelineMetrics *metrics, QObject *parent = nullptr);
+    ~MetricsServer();
+
+    void start(quint16 port);
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    const PipelineMetrics *fMetrics;
+    quint16 fPort;
+};
+
+#endif // METRICSSERVER_H
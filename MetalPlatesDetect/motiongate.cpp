@@ -0,0 +1,92 @@
+#include "motiongate.h"
+#include "tracing.h"
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+
+using namespace OpencvKernels;
+
+MotionGate::Params::Params() :
+    downscale(8),
+    pixelThreshold(20),
+    activateFraction(0.002),
+    releaseFraction(0.0005),
+    holdFrames(10),
+    feedEvery(25)
+{
+}
+
+MotionGate::MotionGate() :
+    fActive(true),
+    fQuietFrames(0),
+    fIdleFrames(0),
+    fMotion(0)
+{
+}
+
+void MotionGate::setParams(const Params &params)
+{
+    fParams = params;
+    reset();
+}
+
+void MotionGate::reset()
+{
+    fPrevious.release();
+    fActive = true;
+    fQuietFrames = 0;
+    fIdleFrames = 0;
+    fMotion = 0;
+}
+
+FrameAction MotionGate::planFrame(const cv::Mat &frame)
+{
+    TRACE_SPAN("MotionGate::planFrame");
+    // resize with INTER_AREA, absdiff, threshold and countNonZero are all SIMD paths in OpenCV
+    int downscale = std::max(fParams.downscale, 1);
+    cv::Size size(std::max(frame.cols / downscale, 1), std::max(frame.rows / downscale, 1));
+    cv::Mat small;
+    cv::resize(frame, small, size, 0, 0, cv::INTER_AREA);
+    if (small.channels() == 3)
+        cv::cvtColor(small, fCurrent, cv::COLOR_BGR2GRAY);
+    else if (small.channels() == 4)
+        cv::cvtColor(small, fCurrent, cv::COLOR_BGRA2GRAY);
+    else
+        small.copyTo(fCurrent);
+
+    if (fPrevious.size() != fCurrent.size()) {
+        cv::swap(fPrevious, fCurrent);
+        fActive = true;
+        fQuietFrames = 0;
+        fStats.active++;
+        return frameRunFull;
+    }
+
+    cv::absdiff(fCurrent, fPrevious, fDiff);
+    cv::threshold(fDiff, fDiff, fParams.pixelThreshold, 255, cv::THRESH_BINARY);
+    fMotion = double(cv::countNonZero(fDiff)) / fDiff.total();
+    cv::swap(fPrevious, fCurrent);
+
+    if (fActive) {
+        fQuietFrames = fMotion < fParams.releaseFraction ? fQuietFrames + 1 : 0;
+        if (fQuietFrames >= fParams.holdFrames) {
+            fActive = false;
+            fIdleFrames = 0;
+        }
+    }
+    else if (fMotion >= fParams.activateFraction) {
+        fActive = true;
+        fQuietFrames = 0;
+    }
+
+    if (fActive) {
+        fStats.active++;
+        return frameRunFull;
+    }
+    fStats.idle++;
+    if (fParams.feedEvery > 0 && ++fIdleFrames % fParams.feedEvery == 0) {
+        fStats.fed++;
+        return frameRunFull;
+    }
+    return frameSkipDownstream;
+}
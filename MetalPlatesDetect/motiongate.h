@@ -0,0 +1,56 @@
+#ifndef MOTIONGATE_H
+#define MOTIONGATE_H
+
+#include "opencvkernels.h"
+#include <cstdint>
+
+// Cheap idle detector in front of the expensive stages: differences of
+// consecutive downscaled gray frames with hysteresis. While idle the stages
+// after the gate are skipped, except for one frame every feedEvery frames
+// that keeps the background model learning.
+class MotionGate
+{
+public:
+    struct Params {
+        Params();
+
+        int     downscale;          // differencing runs on a frame this many times smaller
+        int     pixelThreshold;     // gray level difference counted as motion
+        double  activateFraction;   // share of moving pixels that wakes the gate up
+        double  releaseFraction;    // share below which the gate counts down to idle
+        int     holdFrames;         // quiet frames needed before going idle
+        int     feedEvery;          // idle frames between background model updates, 0 never
+    };
+
+    struct Stats {
+        Stats() : active(0), idle(0), fed(0) {}
+        uint64_t active;
+        uint64_t idle;
+        uint64_t fed;
+    };
+
+    MotionGate();
+
+    void setParams(const Params &params);
+    const Params &params() const { return fParams; }
+    void reset();
+
+    OpencvKernels::FrameAction planFrame(const cv::Mat &frame);
+
+    bool isActive() const { return fActive; }
+    double motionFraction() const { return fMotion; }
+    const Stats &stats() const { return fStats; }
+
+private:
+    Params fParams;
+    cv::Mat fPrevious;
+    cv::Mat fCurrent;
+    cv::Mat fDiff;
+    bool fActive;
+    int fQuietFrames;
+    int fIdleFrames;
+    double fMotion;
+    Stats fStats;
+};
+
+#endif // MOTIONGATE_H
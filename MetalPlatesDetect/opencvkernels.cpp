@@ -0,0 +1,319 @@
+#include "opencvkernels.h"
+#include "soamixture.h"
+#include "tracing.h"
+
+#include <opencv2/bgsegm.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace OpencvKernels {
+
+void bgr2mode(const cv::Mat &src, cv::Mat &dst, ColorMode mode)
+{
+    TRACE_SPAN("bgr2mode");
+    switch (mode) {
+    case modeBGR:
+        src.copyTo(dst);
+        break;
+    case modeBGR2Lab:
+        cv::cvtColor(src, dst, cv::COLOR_BGR2Lab);
+        break;
+    case modeBGR2YUV:
+        cv::cvtColor(src, dst, cv::COLOR_BGR2YUV);
+        break;
+    case modeBGR2HLS:
+        cv::cvtColor(src, dst, cv::COLOR_BGR2HLS);
+        break;
+    case modeBGR2Luv:
+        cv::cvtColor(src, dst, cv::COLOR_BGR2Luv);
+        break;
+    case modeBGR2HSV:
+        cv::cvtColor(src, dst, cv::COLOR_BGR2HSV);
+        break;
+    case modeBGR2YCrCb:
+        cv::cvtColor(src, dst, cv::COLOR_BGR2YCrCb);
+        break;
+    case modeBGR2XYZ:
+    default:
+        cv::cvtColor(src, dst, cv::COLOR_BGR2XYZ);
+        break;
+    }
+}
+
+void separateChannel(const cv::Mat &src, cv::Mat &dst, ColorMode mode, int channel)
+{
+    TRACE_SPAN("separateChannel");
+    if (channel < 0) {
+        bgr2mode(src, dst, mode);
+        return;
+    }
+    dst.create(src.size(), CV_8UC1);
+    if (mode == modeBGR) {
+        cv::extractChannel(src, dst, channel);
+        return;
+    }
+
+    const int stripeRows = 32;
+    int stripes = (src.rows + stripeRows - 1) / stripeRows;
+    cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range &range) {
+        cv::Mat converted;
+        for (int stripe = range.start; stripe < range.end; stripe++) {
+            int y0 = stripe * stripeRows;
+            int y1 = std::min(y0 + stripeRows, src.rows);
+            bgr2mode(src.rowRange(y0, y1), converted, mode);
+            cv::Mat plane = dst.rowRange(y0, y1);
+            cv::extractChannel(converted, plane, channel);
+        }
+    });
+}
+
+void mode2bgr(const cv::Mat &src, cv::Mat &dst, ColorMode mode)
+{
+    switch (mode) {
+    case modeBGR:
+        src.copyTo(dst);
+        break;
+    case modeBGR2Lab:
+        cv::cvtColor(src, dst, cv::COLOR_Lab2BGR);
+        break;
+    case modeBGR2YUV:
+        cv::cvtColor(src, dst, cv::COLOR_YUV2BGR);
+        break;
+    case modeBGR2HLS:
+        cv::cvtColor(src, dst, cv::COLOR_HLS2BGR);
+        break;
+    case modeBGR2Luv:
+        cv::cvtColor(src, dst, cv::COLOR_Luv2BGR);
+        break;
+    case modeBGR2HSV:
+        cv::cvtColor(src, dst, cv::COLOR_HSV2BGR);
+        break;
+    case modeBGR2YCrCb:
+        cv::cvtColor(src, dst, cv::COLOR_YCrCb2BGR);
+        break;
+    case modeBGR2XYZ:
+    default:
+        cv::cvtColor(src, dst, cv::COLOR_XYZ2BGR);
+        break;
+    }
+}
+
+SeparateChannelsParams::SeparateChannelsParams() :
+    mode(modeBGR),
+    channel(-1)
+{
+}
+
+BackgroundSubtractorParams::BackgroundSubtractorParams() :
+    algo(MOG2),
+    history(500),
+    threshold(16),
+    detectShadows(true),
+    minPixelStability(15),
+    maxPixelStability(15*60),
+    useHistory(true),
+    isParallel(true),
+    initializationFrames(120),
+    decisionThreshold(0.8),
+    motionCompensation(true),
+    nSamples(20),
+    replaceRate(0.003),
+    propagationRate(0.01),
+    hitsThreshold(32),
+    alpha(0.01),
+    beta(0.0022),
+    blinkingSupressionDecay(0.1),
+    blinkingSupressionMultiplier(0.01),
+    noiseRemovalThresholdFacBG(0.0004),
+    noiseRemovalThresholdFacFG(0.0008),
+    LSBPRadius(16),
+    Tlower(2.0),
+    Tupper(32.0),
+    Tinc(1),
+    Tdec(0.05),
+    Rscale(10),
+    Rincdec(10),
+    LSBPthreshold(8),
+    minCount(2),
+    nmixtures(5),
+    backgroundRatio(0.7),
+    noiseSigma(0),
+    halfPrecision(false),
+    continuousModel(false)
+{
+}
+
+bool BackgroundSubtractorParams::operator==(const BackgroundSubtractorParams &o) const
+{
+    return algo == o.algo
+            && history == o.history
+            && threshold == o.threshold
+            && detectShadows == o.detectShadows
+            && minPixelStability == o.minPixelStability
+            && maxPixelStability == o.maxPixelStability
+            && useHistory == o.useHistory
+            && isParallel == o.isParallel
+            && initializationFrames == o.initializationFrames
+            && decisionThreshold == o.decisionThreshold
+            && motionCompensation == o.motionCompensation
+            && nSamples == o.nSamples
+            && replaceRate == o.replaceRate
+            && propagationRate == o.propagationRate
+            && hitsThreshold == o.hitsThreshold
+            && alpha == o.alpha
+            && beta == o.beta
+            && blinkingSupressionDecay == o.blinkingSupressionDecay
+            && blinkingSupressionMultiplier == o.blinkingSupressionMultiplier
+            && noiseRemovalThresholdFacBG == o.noiseRemovalThresholdFacBG
+            && noiseRemovalThresholdFacFG == o.noiseRemovalThresholdFacFG
+            && LSBPRadius == o.LSBPRadius
+            && Tlower == o.Tlower
+            && Tupper == o.Tupper
+            && Tinc == o.Tinc
+            && Tdec == o.Tdec
+            && Rscale == o.Rscale
+            && Rincdec == o.Rincdec
+            && LSBPthreshold == o.LSBPthreshold
+            && minCount == o.minCount
+            && nmixtures == o.nmixtures
+            && backgroundRatio == o.backgroundRatio
+            && noiseSigma == o.noiseSigma
+            && halfPrecision == o.halfPrecision
+            && continuousModel == o.continuousModel;
+}
+
+// FNV-1a, fed field by field so padding never gets in
+class ParamsHash
+{
+public:
+    ParamsHash() : fHash(14695981039346656037ULL) {}
+    template <typename T>
+    ParamsHash &operator<<(T value)
+    {
+        unsigned char bytes[sizeof(T)];
+        memcpy(bytes, &value, sizeof(T));
+        for (size_t i = 0; i < sizeof(T); i++)
+            fHash = (fHash ^ bytes[i]) * 1099511628211ULL;
+        return *this;
+    }
+    uint64_t value() const { return fHash; }
+
+private:
+    uint64_t fHash;
+};
+
+uint64_t BackgroundSubtractorParams::hash() const
+{
+    ParamsHash h;
+    h << int(algo) << history << threshold << detectShadows
+      << minPixelStability << maxPixelStability << useHistory << isParallel
+      << initializationFrames << decisionThreshold
+      << motionCompensation << nSamples << replaceRate << propagationRate << hitsThreshold << alpha << beta
+      << blinkingSupressionDecay << blinkingSupressionMultiplier << noiseRemovalThresholdFacBG << noiseRemovalThresholdFacFG
+      << LSBPRadius << Tlower << Tupper << Tinc << Tdec << Rscale << Rincdec << LSBPthreshold << minCount
+      << nmixtures << backgroundRatio << noiseSigma
+      << halfPrecision << continuousModel;
+    return h.value();
+}
+
+cv::Ptr<cv::BackgroundSubtractor> createBackgroundSubtractor(const BackgroundSubtractorParams &p)
+{
+    switch (p.algo) {
+    case CNT:
+        return cv::bgsegm::createBackgroundSubtractorCNT(p.minPixelStability, p.useHistory, p.maxPixelStability, p.isParallel);
+    case GMG:
+        return cv::bgsegm::createBackgroundSubtractorGMG(p.initializationFrames, p.decisionThreshold);
+    case GSOC: {
+        int mc = p.motionCompensation ? cv::bgsegm::LSBP_CAMERA_MOTION_COMPENSATION_LK : cv::bgsegm::LSBP_CAMERA_MOTION_COMPENSATION_NONE;
+        return cv::bgsegm::createBackgroundSubtractorGSOC(mc, p.nSamples, float(p.replaceRate), float(p.propagationRate), p.hitsThreshold,
+                                                          float(p.alpha), float(p.beta), float(p.blinkingSupressionDecay), float(p.blinkingSupressionMultiplier),
+                                                          float(p.noiseRemovalThresholdFacBG), float(p.noiseRemovalThresholdFacFG));
+    }
+    case LSBP: {
+        int mc = p.motionCompensation ? cv::bgsegm::LSBP_CAMERA_MOTION_COMPENSATION_LK : cv::bgsegm::LSBP_CAMERA_MOTION_COMPENSATION_NONE;
+        return cv::bgsegm::createBackgroundSubtractorLSBP(mc, p.nSamples, p.LSBPRadius, float(p.Tlower), float(p.Tupper), float(p.Tinc), float(p.Tdec),
+                                                          float(p.Rscale), float(p.Rincdec), float(p.noiseRemovalThresholdFacBG), float(p.noiseRemovalThresholdFacFG),
+                                                          p.LSBPthreshold, p.minCount);
+    }
+    case MOG:
+        return cv::bgsegm::createBackgroundSubtractorMOG(p.history, p.nmixtures, p.backgroundRatio, p.noiseSigma);
+    case SOAMOG:
+        return cv::makePtr<SoaMixtureSubtractor>(p.history, p.threshold, p.nmixtures, p.detectShadows, p.halfPrecision);
+    case KNN:
+        return cv::createBackgroundSubtractorKNN(p.history, p.threshold, p.detectShadows);
+    case MOG2:
+    default:
+        return cv::createBackgroundSubtractorMOG2(p.history, p.threshold, p.detectShadows);
+    }
+}
+
+bool backgroundAlgoNeedsColor(BackgroundAlgo algo)
+{
+    return algo == GSOC || algo == LSBP;
+}
+
+bool backgroundAlgoIsPerPixel(BackgroundAlgo algo)
+{
+    return algo == MOG2 || algo == KNN || algo == CNT || algo == MOG || algo == SOAMOG;
+}
+
+bool backgroundSupportsRegions(const BackgroundSubtractorParams &params)
+{
+    return !params.continuousModel && backgroundAlgoIsPerPixel(params.algo);
+}
+
+static cv::Mat colorInput(const BackgroundSubtractorParams &params, const cv::Mat &src)
+{
+    if (src.channels() != 1 || !backgroundAlgoNeedsColor(params.algo))
+        return src;
+    cv::Mat color;
+    cv::cvtColor(src, color, cv::COLOR_GRAY2BGR);
+    return color;
+}
+
+void subtractBackground(const BackgroundSubtractorParams &params, const cv::Mat &background, const cv::Mat &src, cv::Mat &mask)
+{
+    TRACE_SPAN("subtractBackground");
+    cv::Ptr<cv::BackgroundSubtractor> pBackSub = createBackgroundSubtractor(params);
+    cv::Mat bg = background;
+    if (src.isSubmatrix() && !bg.empty()) {
+        cv::Size wholeSize;
+        cv::Point offset;
+        src.locateROI(wholeSize, offset);
+        if (wholeSize == bg.size())
+            bg = background(cv::Rect(offset, src.size()));
+    }
+    // mask doubles as scratch for the priming pass, so a preallocated mask is never reallocated
+    {
+        TRACE_SPAN("BackgroundSubtractor::apply background");
+        pBackSub->apply(colorInput(params, bg), mask);
+    }
+    TRACE_SPAN("BackgroundSubtractor::apply");
+    pBackSub->apply(colorInput(params, src), mask);
+}
+
+BackgroundModel::BackgroundModel() :
+    fType(-1),
+    fResets(0)
+{
+}
+
+void BackgroundModel::apply(const BackgroundSubtractorParams &params, const cv::Mat &background, const cv::Mat &src, cv::Mat &mask)
+{
+    if (!fModel || params != fParams || background.data != fBackground.data || src.size() != fSize || src.type() != fType) {
+        TRACE_SPAN("BackgroundModel reset");
+        fModel = createBackgroundSubtractor(params);
+        fParams = params;
+        fBackground = background;
+        fSize = src.size();
+        fType = src.type();
+        fResets++;
+        if (background.size() == src.size() && background.type() == src.type())
+            fModel->apply(colorInput(params, background), mask);
+    }
+    TRACE_SPAN("BackgroundSubtractor::apply");
+    fModel->apply(colorInput(params, src), mask);
+}
+
+} // namespace OpencvKernels
@@ -0,0 +1,170 @@
+#ifndef OPENCVKERNELS_H
+#define OPENCVKERNELS_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/video/background_segm.hpp>
+#include <cstdint>
+
+// Processing shared by the tool widgets and the compile-time pipelines,
+// free of any Qt dependency.
+namespace OpencvKernels {
+
+enum ColorMode {
+    modeBGR,
+    modeBGR2XYZ,  // COLOR_BGR2XYZ
+    modeBGR2Lab,  // COLOR_BGR2Lab
+    modeBGR2YUV,  // COLOR_BGR2YUV
+    modeBGR2HLS,  // COLOR_BGR2HLS
+    modeBGR2Luv,  // COLOR_BGR2Luv
+    modeBGR2HSV,  // COLOR_BGR2HSV
+    modeBGR2YCrCb // COLOR_BGR2YCrCb
+    // COLOR_BGR2GRAY
+};
+
+void bgr2mode(const cv::Mat &src, cv::Mat &dst, ColorMode mode);
+void mode2bgr(const cv::Mat &src, cv::Mat &dst, ColorMode mode);
+// converts to the mode and keeps one channel (0..2) as a single plane, or all of them (-1).
+// A single channel is converted in cache sized stripes, the full converted frame never exists.
+void separateChannel(const cv::Mat &src, cv::Mat &dst, ColorMode mode, int channel);
+
+// defaults match a fresh config.ini
+struct SeparateChannelsParams {
+    SeparateChannelsParams();
+
+    ColorMode   mode;
+    int         channel;    // 0..2, -1 forwards all planes
+
+    bool operator==(const SeparateChannelsParams &other) const { return mode == other.mode && channel == other.channel; }
+    bool operator!=(const SeparateChannelsParams &other) const { return !(*this == other); }
+};
+
+enum BackgroundAlgo {
+    MOG2 = 0,
+    KNN = 1,
+    CNT = 2,
+    GMG = 3,
+    GSOC = 4,
+    LSBP = 5,
+    MOG = 6,
+    SOAMOG = 7     // SoaMixtureSubtractor
+};
+
+// cheapest of the models, used when the latency budget is at risk
+const BackgroundAlgo cheapBackgroundAlgo = CNT;
+
+// GSOC and LSBP only model colour frames, single planes are replicated for them
+bool backgroundAlgoNeedsColor(BackgroundAlgo algo);
+// the models deciding every pixel on its own history; GSOC and LSBP look at
+// neighbourhoods and propagate samples, GMG smooths its output
+bool backgroundAlgoIsPerPixel(BackgroundAlgo algo);
+
+// defaults match a fresh config.ini
+struct BackgroundSubtractorParams {
+    BackgroundSubtractorParams();
+
+    BackgroundAlgo algo;
+
+    int     history;
+    double  threshold;
+    bool    detectShadows;
+
+    int     minPixelStability;
+    int     maxPixelStability;
+    bool    useHistory;
+    bool    isParallel;
+
+    int     initializationFrames;
+    double  decisionThreshold;
+
+    bool    motionCompensation;
+    int     nSamples;
+    double  replaceRate;
+    double  propagationRate;
+    int     hitsThreshold;
+    double  alpha;
+    double  beta;
+    double  blinkingSupressionDecay;
+    double  blinkingSupressionMultiplier;
+    double  noiseRemovalThresholdFacBG;
+    double  noiseRemovalThresholdFacFG;
+
+    int     LSBPRadius;
+    double  Tlower;
+    double  Tupper;
+    double  Tinc;
+    double  Tdec;
+    double  Rscale;
+    double  Rincdec;
+    int     LSBPthreshold;
+    int     minCount;
+
+    int     nmixtures;
+    double  backgroundRatio;
+    double  noiseSigma;
+
+    bool    halfPrecision;      // SOAMOG weights in 16-bit floats
+
+    // keep one model learning across frames instead of priming a fresh one per frame
+    bool    continuousModel;
+
+    bool operator==(const BackgroundSubtractorParams &other) const;
+    bool operator!=(const BackgroundSubtractorParams &other) const { return !(*this == other); }
+    // over the same fields as operator==, the same on every run and build
+    uint64_t hash() const;
+};
+
+cv::Ptr<cv::BackgroundSubtractor> createBackgroundSubtractor(const BackgroundSubtractorParams &params);
+// builds a fresh model, primes it with the background and writes the mask of src.
+// src may be a region of a frame of the background size, the matching part of the background is used then.
+void subtractBackground(const BackgroundSubtractorParams &params, const cv::Mat &background, const cv::Mat &src, cv::Mat &mask);
+// true if subtractBackground() on a region gives the mask of the whole frame there;
+// a continuous model has to see every whole frame
+bool backgroundSupportsRegions(const BackgroundSubtractorParams &params);
+
+// Model kept across frames, primed with the background when it is (re)built.
+// It is rebuilt when the parameters, the background or the frame format change.
+class BackgroundModel
+{
+public:
+    BackgroundModel();
+
+    void apply(const BackgroundSubtractorParams &params, const cv::Mat &background, const cv::Mat &src, cv::Mat &mask);
+    void reset() { fModel.reset(); }
+    uint64_t resetCount() const { return fResets; }
+
+private:
+    cv::Ptr<cv::BackgroundSubtractor> fModel;
+    BackgroundSubtractorParams fParams;
+    cv::Mat fBackground;
+    cv::Size fSize;
+    int fType;
+    uint64_t fResets;
+};
+
+// Calls fn(i) for every frame of a batch: spread over threads when the frames
+// are independent of each other, else in order on the calling thread
+template <typename Fn>
+void processFrames(int count, bool independent, const Fn &fn)
+{
+    if (!independent || count < 2) {
+        for (int i = 0; i < count; i++)
+            fn(i);
+        return;
+    }
+    cv::parallel_for_(cv::Range(0, count), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++)
+            fn(i);
+    });
+}
+
+// What a gating stage wants done with the current frame
+enum FrameAction {
+    frameRunFull,           // run every stage on the whole frame
+    frameRunRegions,        // run the stages before the gate only on the given regions
+    frameSkipUpstream,      // keep the previous output of the stages before the gate
+    frameSkipDownstream     // keep the previous output of the stages after the gate
+};
+
+} // namespace OpencvKernels
+
+#endif // OPENCVKERNELS_H
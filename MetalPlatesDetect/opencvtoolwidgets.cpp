@@ -1,4 +1,6 @@
 #include "opencvtoolwidgets.h"
+#include "pipelinesettings.h"
+#include "tracing.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QCheckBox>
@@ -12,19 +14,20 @@
 #include <QRadioButton>
 
 // opencv includes
-#include <opencv2/bgsegm.hpp>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 
+using namespace OpencvKernels;
+
 OpencvBaseToolWidget::OpencvBaseToolWidget(QWidget *parent) : QWidget(parent)
 {
     fEnabled = true;
     QVBoxLayout *vl = new QVBoxLayout;
     QHBoxLayout *hl = new QHBoxLayout;
-    QCheckBox *cb = new QCheckBox("On/Off");
-    cb->setChecked(true);
-    hl->addWidget(cb);
+    fEnabledBox = new QCheckBox("On/Off");
+    fEnabledBox->setChecked(true);
+    hl->addWidget(fEnabledBox);
     fMainLayout = new QVBoxLayout;
     QWidget *w = new QWidget;
     w->setLayout(fMainLayout);
@@ -32,7 +35,22 @@ OpencvBaseToolWidget::OpencvBaseToolWidget(QWidget *parent) : QWidget(parent)
     vl->addWidget(w);
     setLayout(vl);
 
-    connect(cb, SIGNAL(toggled(bool)), this, SLOT(enableChanged(bool)));
+    connect(fEnabledBox, SIGNAL(toggled(bool)), this, SLOT(enableChanged(bool)));
+}
+
+void OpencvBaseToolWidget::loadEnabled(QSettings *settings)
+{
+    settings->beginGroup(objectName());
+    // toggled only reports a change, the plan is not rebuilt for the same state
+    fEnabledBox->setChecked(PipelineSettings::readToolEnabled(settings));
+    settings->endGroup();
+}
+
+void OpencvBaseToolWidget::saveEnabled(QSettings *settings)
+{
+    settings->beginGroup(objectName());
+    PipelineSettings::writeToolEnabled(settings, fEnabled);
+    settings->endGroup();
 }
 
 void OpencvBaseToolWidget::enableChanged(bool v)
@@ -42,11 +60,35 @@ void OpencvBaseToolWidget::enableChanged(bool v)
         if (obj->isWidgetType())
             ((QWidget*)obj)->setEnabled(v);
     }
+    emit topologyChanged();
+}
+
+void OpencvBaseToolWidget::watchParameters()
+{
+    foreach (QSpinBox *box, findChildren<QSpinBox*>())
+        connect(box, SIGNAL(valueChanged(int)), this, SIGNAL(parametersChanged()), Qt::UniqueConnection);
+    foreach (QDoubleSpinBox *box, findChildren<QDoubleSpinBox*>())
+        connect(box, SIGNAL(valueChanged(double)), this, SIGNAL(parametersChanged()), Qt::UniqueConnection);
+    foreach (QCheckBox *box, findChildren<QCheckBox*>())
+        connect(box, SIGNAL(toggled(bool)), this, SIGNAL(parametersChanged()), Qt::UniqueConnection);
+    foreach (QComboBox *box, findChildren<QComboBox*>())
+        connect(box, SIGNAL(currentIndexChanged(int)), this, SIGNAL(parametersChanged()), Qt::UniqueConnection);
+    foreach (QRadioButton *button, findChildren<QRadioButton*>())
+        connect(button, SIGNAL(toggled(bool)), this, SIGNAL(parametersChanged()), Qt::UniqueConnection);
+}
+
+void OpencvBaseToolWidget::processBatch(const std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst)
+{
+    dst.resize(src.size());
+    for (size_t i = 0; i < src.size(); i++) {
+        cv::Mat frame = src[i];
+        process(&frame, &dst[i]);
+    }
 }
 
 OpencvBackgroundSubtractorToolWidget::OpencvBackgroundSubtractorToolWidget(QWidget *parent) : OpencvBaseToolWidget(parent)
 {
-    setObjectName("BackgroundSubtractorToolWidget");
+    setObjectName(PipelineSettings::BackgroundSubtractorGroup);
 
     QVBoxLayout* mainLayout = (QVBoxLayout*)layout();
     algoComboBox = new QComboBox();
@@ -57,6 +99,7 @@ OpencvBackgroundSubtractorToolWidget::OpencvBackgroundSubtractorToolWidget(QWidg
     algoComboBox->addItem("GSOC");
     algoComboBox->addItem("LSBP");
     algoComboBox->addItem("MOG");
+    algoComboBox->addItem("SoA MOG");
 
     fAlgo = MOG2;
 
@@ -157,6 +200,20 @@ OpencvBackgroundSubtractorToolWidget::OpencvBackgroundSubtractorToolWidget(QWidg
     createLSBPWidgets();
     createMOGWidgets();
 
+    hl = new QHBoxLayout;
+    fHalfPrecision = new QCheckBox("Half precision weights");
+    fHalfPrecision->setChecked(false);
+    hl->addWidget(fHalfPrecision);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fContinuousModel = new QCheckBox("Continuous model (keep learning across frames)");
+    fContinuousModel->setChecked(false);
+    hl->addWidget(fContinuousModel);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
     hl = new QHBoxLayout;
     fBgButton = new QPushButton("Load background");
     fBgLabel = new QLabel("");
@@ -172,180 +229,152 @@ OpencvBackgroundSubtractorToolWidget::OpencvBackgroundSubtractorToolWidget(QWidg
     connect(algoComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(algoChanged(int)));
     connect(fBgButton, SIGNAL(clicked(bool)), this, SLOT(openBgImage()));
     algoChanged(algoComboBox->currentIndex());
+
+    watchParameters();
 }
 
 void OpencvBackgroundSubtractorToolWidget::loadSettings(QSettings *settings)
 {
     settings->beginGroup(objectName());
-    {
-        fAlgo = (ALGO)(settings->value("algorithm", MOG2).toInt());
-        fHistory->setValue(         settings->value("History",          500).toInt());
-        fThreshold->setValue(       settings->value("Threshold",        16).toDouble());
-        fDetectShadows->setChecked( settings->value("DetectShadows",    true).toBool());
-
-        fMinPixelStability->setValue(   settings->value("MinPixelStability",    15).toInt());
-        fMaxPixelStability->setValue(   settings->value("MaxPixelStability",    15*60).toInt());
-        fUseHistory->setChecked(        settings->value("UseHistory",           true).toBool());
-        fIsParallel->setChecked(        settings->value("IsParallel",           true).toBool());
-
-        fInitializationFrames->setValue(settings->value("InitializationFrames", 120).toInt());
-        fDecisionThreshold->setValue(   settings->value("DecisionThreshold",    0.8).toDouble());
-
-        fMotionCompensation->setChecked(        settings->value("MotionCompensation",           true).toBool());
-        fNSamples->setValue(                    settings->value("NSamples",                     20).toInt());
-        fReplaceRate->setValue(                 settings->value("ReplaceRate",                  0.003).toDouble());
-        fPropagationRate->setValue(             settings->value("PropagationRate",              0.01).toDouble());
-        fHitsThreshold->setValue(               settings->value("HitsThreshold",                32).toInt());
-        fAlpha->setValue(                       settings->value("Alpha",                        0.01).toDouble());
-        fBeta->setValue(                        settings->value("Beta",                         0.0022).toDouble());
-        fBlinkingSupressionDecay->setValue(     settings->value("BlinkingSupressionDecay",      0.1).toDouble());
-        fBlinkingSupressionMultiplier->setValue(settings->value("BlinkingSupressionMultiplier", 0.01).toDouble());
-        fNoiseRemovalThresholdFacBG->setValue(  settings->value("NoiseRemovalThresholdFacBG",   0.0004).toDouble());
-        fNoiseRemovalThresholdFacFG->setValue(  settings->value("NoiseRemovalThresholdFacFG",   0.0008).toDouble());
-
-        fLSBPRadius->setValue(      settings->value("LSBPRadius",       16).toInt());
-        fTlower->setValue(          settings->value("Tlower",           2.0).toDouble());
-        fTupper->setValue(          settings->value("Tupper",           32.0).toDouble());
-        fTinc->setValue(            settings->value("Tinc",             1).toDouble());
-        fTdec->setValue(            settings->value("Tdec",             0.05).toDouble());
-        fRscale->setValue(          settings->value("Rscale",           10).toDouble());
-        fRincdec->setValue(         settings->value("Rincdec",          10).toDouble());
-        fLSBPthreshold->setValue(   settings->value("LSBPthreshold",    8).toInt());
-        fMinCount->setValue(        settings->value("MinCount",         2).toInt());
-
-        fNmixtures->setValue(       settings->value("Nmixtures",        5).toInt());
-        fBackgroundRatio->setValue( settings->value("BackgroundRatio",  0.7).toDouble());
-        fNoiseSigma->setValue(      settings->value("NoiseSigma",       0).toDouble());
-    }
+    setParams(PipelineSettings::readBackgroundSubtractorParams(settings));
+    QString bgImagePath = settings->value("BackgroundImage").toString();
     settings->endGroup();
 
-    algoComboBox->setCurrentIndex(fAlgo);
+    // reloaded on every edit of the settings, the image is only read again when another one is set
+    if (!bgImagePath.isEmpty() && bgImagePath != fBgImagePath)
+        loadBgImage(bgImagePath);
 }
 
 void OpencvBackgroundSubtractorToolWidget::saveSettings(QSettings *settings)
 {
     settings->beginGroup(objectName());
-    settings->setValue("algorithm", fAlgo);
-    settings->setValue("History", fHistory->value());
-    settings->setValue("Threshold", fThreshold->value());
-    settings->setValue("DetectShadows", fDetectShadows->isChecked());
-
-    settings->setValue("MinPixelStability", fMinPixelStability->value());
-    settings->setValue("MaxPixelStability", fMaxPixelStability->value());
-    settings->setValue("UseHistory", fUseHistory->isChecked());
-    settings->setValue("IsParallel", fIsParallel->isChecked());
-
-    settings->setValue("InitializationFrames", fInitializationFrames->value());
-    settings->setValue("DecisionThreshold", fDecisionThreshold->value());
-
-    settings->setValue("MotionCompensation", fMotionCompensation->isChecked());
-    settings->setValue("NSamples", fNSamples->value());
-    settings->setValue("ReplaceRate", fReplaceRate->value());
-    settings->setValue("PropagationRate", fPropagationRate->value());
-    settings->setValue("HitsThreshold", fHitsThreshold->value());
-    settings->setValue("Alpha", fAlpha->value());
-    settings->setValue("Beta", fBeta->value());
-    settings->setValue("BlinkingSupressionDecay", fBlinkingSupressionDecay->value());
-    settings->setValue("BlinkingSupressionMultiplier", fBlinkingSupressionMultiplier->value());
-    settings->setValue("NoiseRemovalThresholdFacBG", fNoiseRemovalThresholdFacBG->value());
-    settings->setValue("NoiseRemovalThresholdFacFG", fNoiseRemovalThresholdFacFG->value());
-
-    settings->setValue("LSBPRadius", fLSBPRadius->value());
-    settings->setValue("Tlower", fTlower->value());
-    settings->setValue("Tupper", fTupper->value());
-    settings->setValue("Tinc", fTinc->value());
-    settings->setValue("Tdec", fTdec->value());
-    settings->setValue("Rscale", fRscale->value());
-    settings->setValue("Rincdec", fRincdec->value());
-    settings->setValue("LSBPthreshold", fLSBPthreshold->value());
-    settings->setValue("MinCount", fMinCount->value());
-
-    settings->setValue("Nmixtures", fNmixtures->value());
-    settings->setValue("BackgroundRatio", fBackgroundRatio->value());
-    settings->setValue("NoiseSigma", fNoiseSigma->value());
+    PipelineSettings::writeBackgroundSubtractorParams(settings, params());
+    settings->setValue("BackgroundImage", fBgImagePath);
     settings->endGroup();
 }
 
-void OpencvBackgroundSubtractorToolWidget::process(cv::Mat *src, cv::Mat *dst)
+BackgroundSubtractorParams OpencvBackgroundSubtractorToolWidget::params() const
 {
-    cv::Ptr<cv::BackgroundSubtractor> pBackSub;
-    switch (fAlgo) {
-    case CNT:{
-        int minPixelStability = fMinPixelStability->value();
-        int maxPixelStability = fMaxPixelStability->value();
-        bool useHistory = fUseHistory->isChecked();
-        bool isParallel = fIsParallel->isChecked();
-        pBackSub = cv::bgsegm::createBackgroundSubtractorCNT(minPixelStability, useHistory, maxPixelStability, isParallel);
-    }
-        break;
-    case GMG:{
-        int initializationFrames = fInitializationFrames->value();
-        double decisionThreshold = fDecisionThreshold->value();
-        pBackSub = cv::bgsegm::createBackgroundSubtractorGMG(initializationFrames, decisionThreshold);
-    }
-        break;
-    case GSOC:{
-        int mc = fMotionCompensation->isChecked() ? cv::bgsegm::LSBP_CAMERA_MOTION_COMPENSATION_LK : cv::bgsegm::LSBP_CAMERA_MOTION_COMPENSATION_NONE;
-        int nSamples = fNSamples->value();
-        float replaceRate = fReplaceRate->value();
-        float propagationRate = fPropagationRate->value();
-        int hitsThreshold = fHitsThreshold->value();
-        float alpha = fAlpha->value();
-        float beta = fBeta->value();
-        float blinkingSupressionDecay = fBlinkingSupressionDecay->value();
-        float blinkingSupressionMultiplier = fBlinkingSupressionMultiplier->value();
-        float noiseRemovalThresholdFacBG = fNoiseRemovalThresholdFacBG->value();
-        float noiseRemovalThresholdFacFG = fNoiseRemovalThresholdFacFG->value();
-        pBackSub = cv::bgsegm::createBackgroundSubtractorGSOC(mc, nSamples, replaceRate, propagationRate, hitsThreshold, alpha, beta, blinkingSupressionDecay, blinkingSupressionMultiplier, noiseRemovalThresholdFacBG, noiseRemovalThresholdFacFG);
-    }
-        break;
-    case LSBP:{
-        int mc = fMotionCompensation->isChecked() ? cv::bgsegm::LSBP_CAMERA_MOTION_COMPENSATION_LK : cv::bgsegm::LSBP_CAMERA_MOTION_COMPENSATION_NONE;
-        int nSamples = fNSamples->value();
-        float noiseRemovalThresholdFacBG = fNoiseRemovalThresholdFacBG->value();
-        float noiseRemovalThresholdFacFG = fNoiseRemovalThresholdFacFG->value();
-        int LSBPRadius = fLSBPRadius->value();
-        double Tlower = fTlower->value();
-        double Tupper = fTupper->value();
-        double Tinc = fTinc->value();
-        double Tdec = fTdec->value();
-        double Rscale = fRscale->value();
-        double Rincdec = fRincdec->value();
-        int LSBPthreshold = fLSBPthreshold->value();
-        int minCount = fMinCount->value();
-        pBackSub = cv::bgsegm::createBackgroundSubtractorLSBP(mc, nSamples, LSBPRadius, Tlower, Tupper, Tinc, Tdec, Rscale, Rincdec, noiseRemovalThresholdFacBG, noiseRemovalThresholdFacFG, LSBPthreshold, minCount);
-    }
-        break;
-    case MOG:{
-        int history = fHistory->value();
-        int nmixtures = fNmixtures->value();
-        double backgroundRatio = fBackgroundRatio->value();
-        double noiseSigma = fNoiseSigma->value();
-        pBackSub = cv::bgsegm::createBackgroundSubtractorMOG(history, nmixtures, backgroundRatio, noiseSigma);
-    }
-        break;
-    case KNN: {int history = fHistory->value();
-        double varThreshold = fThreshold->value();
-        bool detectShadows = fDetectShadows->isChecked();
-        pBackSub = cv::createBackgroundSubtractorKNN(history, varThreshold, detectShadows);
-    }
-        break;
-    case MOG2:
-    default:{
-        int history = fHistory->value();
-        double varThreshold = fThreshold->value();
-        bool detectShadows = fDetectShadows->isChecked();
-        pBackSub = cv::createBackgroundSubtractorMOG2(history, varThreshold, detectShadows);
-    }
-        break;
-    }
+    BackgroundSubtractorParams p;
+    p.algo = fAlgo;
+    p.history = fHistory->value();
+    p.threshold = fThreshold->value();
+    p.detectShadows = fDetectShadows->isChecked();
+
+    p.minPixelStability = fMinPixelStability->value();
+    p.maxPixelStability = fMaxPixelStability->value();
+    p.useHistory = fUseHistory->isChecked();
+    p.isParallel = fIsParallel->isChecked();
+
+    p.initializationFrames = fInitializationFrames->value();
+    p.decisionThreshold = fDecisionThreshold->value();
+
+    p.motionCompensation = fMotionCompensation->isChecked();
+    p.nSamples = fNSamples->value();
+    p.replaceRate = fReplaceRate->value();
+    p.propagationRate = fPropagationRate->value();
+    p.hitsThreshold = fHitsThreshold->value();
+    p.alpha = fAlpha->value();
+    p.beta = fBeta->value();
+    p.blinkingSupressionDecay = fBlinkingSupressionDecay->value();
+    p.blinkingSupressionMultiplier = fBlinkingSupressionMultiplier->value();
+    p.noiseRemovalThresholdFacBG = fNoiseRemovalThresholdFacBG->value();
+    p.noiseRemovalThresholdFacFG = fNoiseRemovalThresholdFacFG->value();
+
+    p.LSBPRadius = fLSBPRadius->value();
+    p.Tlower = fTlower->value();
+    p.Tupper = fTupper->value();
+    p.Tinc = fTinc->value();
+    p.Tdec = fTdec->value();
+    p.Rscale = fRscale->value();
+    p.Rincdec = fRincdec->value();
+    p.LSBPthreshold = fLSBPthreshold->value();
+    p.minCount = fMinCount->value();
+
+    p.nmixtures = fNmixtures->value();
+    p.backgroundRatio = fBackgroundRatio->value();
+    p.noiseSigma = fNoiseSigma->value();
+
+    p.halfPrecision = fHalfPrecision->isChecked();
+
+    p.continuousModel = fContinuousModel->isChecked();
+    return p;
+}
+
+void OpencvBackgroundSubtractorToolWidget::setParams(const BackgroundSubtractorParams &p)
+{
+    // through the combo box, algoChanged() only reports a new topology when the algorithm changes it
+    algoComboBox->setCurrentIndex(p.algo);
+    fHistory->setValue(p.history);
+    fThreshold->setValue(p.threshold);
+    fDetectShadows->setChecked(p.detectShadows);
+
+    fMinPixelStability->setValue(p.minPixelStability);
+    fMaxPixelStability->setValue(p.maxPixelStability);
+    fUseHistory->setChecked(p.useHistory);
+    fIsParallel->setChecked(p.isParallel);
+
+    fInitializationFrames->setValue(p.initializationFrames);
+    fDecisionThreshold->setValue(p.decisionThreshold);
+
+    fMotionCompensation->setChecked(p.motionCompensation);
+    fNSamples->setValue(p.nSamples);
+    fReplaceRate->setValue(p.replaceRate);
+    fPropagationRate->setValue(p.propagationRate);
+    fHitsThreshold->setValue(p.hitsThreshold);
+    fAlpha->setValue(p.alpha);
+    fBeta->setValue(p.beta);
+    fBlinkingSupressionDecay->setValue(p.blinkingSupressionDecay);
+    fBlinkingSupressionMultiplier->setValue(p.blinkingSupressionMultiplier);
+    fNoiseRemovalThresholdFacBG->setValue(p.noiseRemovalThresholdFacBG);
+    fNoiseRemovalThresholdFacFG->setValue(p.noiseRemovalThresholdFacFG);
+
+    fLSBPRadius->setValue(p.LSBPRadius);
+    fTlower->setValue(p.Tlower);
+    fTupper->setValue(p.Tupper);
+    fTinc->setValue(p.Tinc);
+    fTdec->setValue(p.Tdec);
+    fRscale->setValue(p.Rscale);
+    fRincdec->setValue(p.Rincdec);
+    fLSBPthreshold->setValue(p.LSBPthreshold);
+    fMinCount->setValue(p.minCount);
+
+    fNmixtures->setValue(p.nmixtures);
+    fBackgroundRatio->setValue(p.backgroundRatio);
+    fNoiseSigma->setValue(p.noiseSigma);
+
+    fHalfPrecision->setChecked(p.halfPrecision);
+
+    fContinuousModel->setChecked(p.continuousModel);
+}
 
-    cv::Mat fgMask;
+bool OpencvBackgroundSubtractorToolWidget::supportsRegions(int) const
+{
+    return backgroundSupportsRegions(params());
+}
 
-    //update the background model
-    pBackSub->apply(bgImage, fgMask);
-    pBackSub->apply(*src, fgMask);
-    fgMask.copyTo(*dst);
+void OpencvBackgroundSubtractorToolWidget::process(cv::Mat *src, cv::Mat *dst)
+{
+    BackgroundSubtractorParams p = params();
+    const cv::Mat &background = fStageReference.empty() ? bgImage : fStageReference;
+    if (p.continuousModel)
+        fModel.apply(p, background, *src, *dst);
+    else
+        subtractBackground(p, background, *src, *dst);
+}
+
+void OpencvBackgroundSubtractorToolWidget::processBatch(const std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst)
+{
+    // a continuous model has to see the frames in order, fresh models per frame do not
+    const BackgroundSubtractorParams p = params();
+    const cv::Mat background = fStageReference.empty() ? bgImage : fStageReference;
+    dst.resize(src.size());
+    processFrames(int(src.size()), !p.continuousModel, [&](int i) {
+        if (p.continuousModel)
+            fModel.apply(p, background, src[i], dst[i]);
+        else
+            subtractBackground(p, background, src[i], dst[i]);
+    });
 }
 
 void OpencvBackgroundSubtractorToolWidget::createGSOCWidgets()
@@ -629,23 +658,33 @@ void OpencvBackgroundSubtractorToolWidget::createMOGWidgets()
 
 void OpencvBackgroundSubtractorToolWidget::algoChanged(int algoIndex)
 {
+    const bool neededColor = needsColorInput();
     fAlgo = (ALGO)algoIndex;
     updateWidget((ALGO)algoIndex);
+    if (needsColorInput() != neededColor)
+        emit topologyChanged();
 }
 
 void OpencvBackgroundSubtractorToolWidget::openBgImage()
 {
     QString bgFileName = QFileDialog::getOpenFileName( nullptr, "Background image", ".", "Images (*.png *.jpg *.jpeg)" );
-    if( !bgFileName.isEmpty() ) {
-        bgImage = cv::imread( bgFileName.toStdString(), cv::IMREAD_UNCHANGED );
+    if( !bgFileName.isEmpty() )
+        loadBgImage(bgFileName);
+}
+
+void OpencvBackgroundSubtractorToolWidget::loadBgImage(const QString &path)
+{
+    fBgImagePath = path;
+    bgImage = cv::imread( path.toStdString(), cv::IMREAD_UNCHANGED );
+    fStageReference.release();
+    emit topologyChanged();
 //        QImage resultImg;
 //        resultImg = QImage( bgImage.data, bgImage.cols, bgImage.rows, bgImage.step, QImage::Format_RGB888 ).copy();
 //        fBgButton->setIcon(QIcon(bgFileName));
-        QPixmap pix;
-        pix.load(bgFileName);
-        pix = pix.scaled(64,64,Qt::KeepAspectRatio, Qt::SmoothTransformation);
-        fBgLabel->setPixmap(pix);
-    }
+    QPixmap pix;
+    pix.load(path);
+    pix = pix.scaled(64,64,Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    fBgLabel->setPixmap(pix);
 }
 
 void OpencvBackgroundSubtractorToolWidget::updateWidget(OpencvBackgroundSubtractorToolWidget::ALGO algo)
@@ -686,6 +725,8 @@ void OpencvBackgroundSubtractorToolWidget::updateWidget(OpencvBackgroundSubtract
     fBackgroundRatio->setVisible(false);
     fNoiseSigma->setVisible(false);
 
+    fHalfPrecision->setVisible(false);
+
     switch (algo) {
     case CNT:
         fMinPixelStability->setVisible(true);
@@ -731,6 +772,13 @@ void OpencvBackgroundSubtractorToolWidget::updateWidget(OpencvBackgroundSubtract
         fBackgroundRatio->setVisible(true);
         fNoiseSigma->setVisible(true);
         break;
+    case SOAMOG:
+        fHistory->setVisible(true);
+        fThreshold->setVisible(true);
+        fDetectShadows->setVisible(true);
+        fNmixtures->setVisible(true);
+        fHalfPrecision->setVisible(true);
+        break;
     case MOG2:
     case KNN:
     default:
@@ -741,9 +789,11 @@ void OpencvBackgroundSubtractorToolWidget::updateWidget(OpencvBackgroundSubtract
     }
 }
 
-OpencvSeparateChannelsToolWidget::OpencvSeparateChannelsToolWidget(QWidget *parent) : OpencvBaseToolWidget(parent)
+OpencvSeparateChannelsToolWidget::OpencvSeparateChannelsToolWidget(QWidget *parent) :
+    OpencvBaseToolWidget(parent),
+    fColorRequired(false)
 {
-    setObjectName("SeparateChannelsToolWidget");
+    setObjectName(PipelineSettings::SeparateChannelsGroup);
 
     QVBoxLayout* mainLayout = (QVBoxLayout*)layout();
     modeComboBox = new QComboBox();
@@ -776,6 +826,20 @@ OpencvSeparateChannelsToolWidget::OpencvSeparateChannelsToolWidget(QWidget *pare
     hl->addStretch();
     mainLayout->addLayout(hl);
 
+    hl = new QHBoxLayout;
+    QPushButton *analyzeButton = new QPushButton("Analyze channels");
+    analyzeButton->setToolTip("Scores every channel of every mode against the background");
+    hl->addWidget(analyzeButton);
+    fUseBestButton = new QPushButton("Use best");
+    fUseBestButton->setEnabled(false);
+    hl->addWidget(fUseBestButton);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    fAnalysisLabel = new QLabel;
+    fAnalysisLabel->setTextFormat(Qt::PlainText);
+    mainLayout->addWidget(fAnalysisLabel);
+
     hl = new QHBoxLayout;
     imageSize = new QSpinBox();
     imageSize->setMinimum(64);
@@ -815,6 +879,17 @@ OpencvSeparateChannelsToolWidget::OpencvSeparateChannelsToolWidget(QWidget *pare
     outputChannel1 = new QRadioButton("Output");
     outputChannel2 = new QRadioButton("Output");
     outputChannel3 = new QRadioButton("Output");
+    outputAllChannels = new QRadioButton("Output all planes");
+    outputAllChannels->setChecked(true);
+
+    hl = new QHBoxLayout;
+    hl->addWidget(outputAllChannels);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    fColorLabel = new QLabel("The background subtractor models colour frames, all planes are output");
+    fColorLabel->setVisible(false);
+    mainLayout->addWidget(fColorLabel);
 
     hl = new QHBoxLayout;
     hl->addWidget(labelChannel1);
@@ -840,234 +915,201 @@ OpencvSeparateChannelsToolWidget::OpencvSeparateChannelsToolWidget(QWidget *pare
     mainLayout->addStretch();
     connect(modeComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(modeChanged(int)));
     connect(separateButton, SIGNAL(clicked(bool)), this, SLOT(separate()));
+    connect(analyzeButton, SIGNAL(clicked(bool)), this, SLOT(analyzeChannels()));
+    connect(outputChannel1, SIGNAL(toggled(bool)), this, SLOT(outputChanged(bool)));
+    connect(outputChannel2, SIGNAL(toggled(bool)), this, SLOT(outputChanged(bool)));
+    connect(outputChannel3, SIGNAL(toggled(bool)), this, SLOT(outputChanged(bool)));
+    connect(outputAllChannels, SIGNAL(toggled(bool)), this, SLOT(outputChanged(bool)));
+    connect(fUseBestButton, SIGNAL(clicked(bool)), this, SLOT(useBestChannel()));
     connect(imageSize, SIGNAL(valueChanged(int)), this, SLOT(imageSizeChanged(int)));
     modeChanged(modeComboBox->currentIndex());
+
+    watchParameters();
 }
 
 void OpencvSeparateChannelsToolWidget::loadSettings(QSettings *settings)
 {
     settings->beginGroup(objectName());
-    mode = (MODE)(settings->value("Mode", 0).toInt());
+    SeparateChannelsParams p = PipelineSettings::readSeparateChannelsParams(settings);
     imageSize->setValue(settings->value("ImageSize", 128).toInt());
     colored->setChecked(settings->value("Colored", false).toBool());
     settings->endGroup();
 
+    mode = p.mode;
+    QRadioButton *outputs[] = { outputAllChannels, outputChannel1, outputChannel2, outputChannel3 };
+    outputs[p.channel + 1]->setChecked(true);
     modeComboBox->setCurrentIndex(mode);
     imageSizeChanged(imageSize->value());
 }
 
 void OpencvSeparateChannelsToolWidget::saveSettings(QSettings *settings)
 {
+    SeparateChannelsParams p;
+    p.mode = mode;
+    p.channel = selectedChannel();
     settings->beginGroup(objectName());
-    settings->setValue("Mode", mode);
+    PipelineSettings::writeSeparateChannelsParams(settings, p);
     settings->setValue("ImageSize", imageSize->value());
     settings->setValue("Colored", colored->isChecked());
     settings->endGroup();
 }
 
-void OpencvSeparateChannelsToolWidget::process(cv::Mat *src, cv::Mat *dst)
+void OpencvSeparateChannelsToolWidget::setColorRequired(bool required)
 {
-    src->copyTo(*dst);
-    src->copyTo(originImage);
-    separate();
+    if (required != fColorRequired)
+        fFrameConverted.release();
+    fColorRequired = required;
+    fColorLabel->setVisible(fColorRequired && selectedChannel() >= 0);
 }
 
-void OpencvSeparateChannelsToolWidget::updateWidget(OpencvSeparateChannelsToolWidget::MODE mode)
+int OpencvSeparateChannelsToolWidget::outputChannel() const
 {
-    switch (mode) {
-    case modeBGR: {
-        labelChannel1->setText("B");
-        labelChannel2->setText("G");
-        labelChannel3->setText("R");
-        break;
-    }
-    case modeBGR2Lab: {
-        labelChannel1->setText("L");
-        labelChannel2->setText("a");
-        labelChannel3->setText("b");
-    }
-        break;
-    case modeBGR2YUV: {
-        labelChannel1->setText("Y");
-        labelChannel2->setText("U");
-        labelChannel3->setText("V");
-    }
-        break;
-    case modeBGR2HLS: {
-        labelChannel1->setText("H");
-        labelChannel2->setText("L");
-        labelChannel3->setText("S");
-    }
-        break;
-    case modeBGR2Luv: {
-        labelChannel1->setText("L");
-        labelChannel2->setText("u");
-        labelChannel3->setText("v");
-    }
-        break;
-    case modeBGR2HSV: {
-        labelChannel1->setText("H");
-        labelChannel2->setText("S");
-        labelChannel3->setText("V");
-    }
-        break;
-    case modeBGR2YCrCb: {
-        labelChannel1->setText("Y");
-        labelChannel2->setText("Cr");
-        labelChannel3->setText("Cb");
-    }
-        break;
-    case modeBGR2XYZ:
-    default: {
-        labelChannel1->setText("X");
-        labelChannel2->setText("Y");
-        labelChannel3->setText("Z");
-    }
-        break;
-    }
+    return fColorRequired ? -1 : selectedChannel();
 }
 
-void OpencvSeparateChannelsToolWidget::updateLabel(QLabel *label, cv::Mat *mat)
+int OpencvSeparateChannelsToolWidget::selectedChannel() const
 {
-    QImage resultImg;
-    if (colored->isChecked())
-        resultImg = QImage( mat->data, mat->cols, mat->rows, mat->step, QImage::Format_RGB888 ).copy().rgbSwapped();
-    else
-        resultImg = QImage( mat->data, mat->cols, mat->rows, mat->step, QImage::Format_Grayscale8 ).copy();
-
-    label->setPixmap(
-        QPixmap::fromImage( resultImg ).scaled(
-            label->size(),
-            Qt::KeepAspectRatio,
-            Qt::SmoothTransformation
-        )
-                );
-}
-
-std::vector<cv::Mat> OpencvSeparateChannelsToolWidget::coloredSeparatedChannels(std::vector<cv::Mat> channels)
-{
-    std::vector<cv::Mat> separatedChannels;
-    // создаем по одному изображению на каждый канал
-    for ( int i = 0 ; i < 3 ; i++){
-        cv::Mat zer = cv::Mat::zeros( channels[0].rows, channels[0].cols, channels[0].type());
-        std::vector<cv::Mat> aux;
-        for (int j=0; j < 3 ; j++) {
-            if(j==i)
-                aux.push_back(channels[i]);
-            else
-                aux.push_back(zer);
-        }
-        cv::Mat chann;
-        merge(aux,chann);
-        separatedChannels.push_back(chann);
-    }
-    return separatedChannels;
+    if (outputChannel1->isChecked())
+        return 0;
+    if (outputChannel2->isChecked())
+        return 1;
+    if (outputChannel3->isChecked())
+        return 2;
+    return -1;
 }
 
-cv::Mat OpencvSeparateChannelsToolWidget::rgb2mode(cv::Mat mat)
+int OpencvSeparateChannelsToolWidget::outputType(int srcType) const
 {
-    cv::Mat convertedImage;
-    switch (mode) {
-    case modeBGR:
-        mat.copyTo(convertedImage);
-        break;
-    case modeBGR2Lab:
-        cv::cvtColor(mat, convertedImage, cv::COLOR_BGR2Lab);
-        break;
-    case modeBGR2YUV:
-        cv::cvtColor(mat, convertedImage, cv::COLOR_BGR2YUV);
-        break;
-    case modeBGR2HLS:
-        cv::cvtColor(mat, convertedImage, cv::COLOR_BGR2HLS);
-        break;
-    case modeBGR2Luv:
-        cv::cvtColor(mat, convertedImage, cv::COLOR_BGR2Luv);
-        break;
-    case modeBGR2HSV:
-        cv::cvtColor(mat, convertedImage, cv::COLOR_BGR2HSV);
-        break;
-    case modeBGR2YCrCb:
-        cv::cvtColor(mat, convertedImage, cv::COLOR_BGR2YCrCb);
-        break;
-    case modeBGR2XYZ:
-    default: {
-        cv::cvtColor(mat, convertedImage, cv::COLOR_BGR2XYZ);
-    }
-        break;
-    }
-    return convertedImage;
+    return outputChannel() < 0 ? srcType : CV_8UC1;
 }
 
-cv::Mat OpencvSeparateChannelsToolWidget::mode2rgb(cv::Mat mat)
+bool OpencvSeparateChannelsToolWidget::forwardsInput() const
 {
-    cv::Mat convertedImage;
-    switch (mode) {
-    case modeBGR:
-        mat.copyTo(convertedImage);
-        break;
-    case modeBGR2Lab:
-        cv::cvtColor(mat, convertedImage, cv::COLOR_Lab2BGR);
-        break;
-    case modeBGR2YUV:
-        cv::cvtColor(mat, convertedImage, cv::COLOR_YUV2BGR);
-        break;
-    case modeBGR2HLS:
-        cv::cvtColor(mat, convertedImage, cv::COLOR_HLS2BGR);
-        break;
-    case modeBGR2Luv:
-        cv::cvtColor(mat, convertedImage, cv::COLOR_Luv2BGR);
-        break;
-    case modeBGR2HSV:
-        cv::cvtColor(mat, convertedImage, cv::COLOR_HSV2BGR);
-        break;
-    case modeBGR2YCrCb:
-        cv::cvtColor(mat, convertedImage, cv::COLOR_YCrCb2BGR);
-        break;
-    case modeBGR2XYZ:
-    default: {
-        cv::cvtColor(mat, convertedImage, cv::COLOR_XYZ2BGR);
-    }
-        break;
-    }
-    return convertedImage;
+    return mode == modeBGR && outputChannel() < 0;
 }
 
-void OpencvSeparateChannelsToolWidget::separate()
+void OpencvSeparateChannelsToolWidget::transformReference(const cv::Mat &src, cv::Mat &dst)
 {
-    if (originImage.empty()) return;
+    if (src.type() == CV_8UC3)
+        separateChannel(src, dst, mode, outputChannel());
+    else
+        dst = src;
+}
 
-    cv::Mat convertedImage = rgb2mode(originImage);
+void OpencvSeparateChannelsToolWidget::process(cv::Mat *src, cv::Mat *dst)
+{
+    if (src->type() != CV_8UC3)
+        src->copyTo(*dst);
+    else if (dst->data != src->data)
+        separateChannel(*src, *dst, mode, outputChannel());
+    // previews are only refreshed from whole frames, not from gated regions
+    if (src->isSubmatrix())
+        return;
+    originImage = *src;
+    if (src->type() == CV_8UC3 && outputChannel() < 0)
+        fFrameConverted = *dst;
+    else
+        fFrameConverted.release();
+    // hidden, they are built when the page is shown or Separate is pressed
+    if (isVisible())
+        separate();
+}
 
-    std::vector<cv::Mat> image_planes(3);
-    cv::split(convertedImage, image_planes);
+void OpencvSeparateChannelsToolWidget::showEvent(QShowEvent *event)
+{
+    OpencvBaseToolWidget::showEvent(event);
+    separate();
+}
 
-    if (colored->isChecked()) {
-        std::vector<cv::Mat> separatedChannels = coloredSeparatedChannels(image_planes);
-        for (int i = 0; i < 3; i++) {
-            if (mode == modeBGR2HSV || mode == modeBGR2HLS || mode == modeBGR2Lab || mode == modeBGR2Luv)
-                image_planes[i] = convertedImage.clone();
-            else
-                image_planes[i] = mode2rgb(separatedChannels[i]);
-        }
-    }
+QString OpencvSeparateChannelsToolWidget::channelName(MODE mode, int channel)
+{
+    static const char * const names[][3] = {
+        { "B", "G", "R" },      // modeBGR
+        { "X", "Y", "Z" },      // modeBGR2XYZ
+        { "L", "a", "b" },      // modeBGR2Lab
+        { "Y", "U", "V" },      // modeBGR2YUV
+        { "H", "L", "S" },      // modeBGR2HLS
+        { "L", "u", "v" },      // modeBGR2Luv
+        { "H", "S", "V" },      // modeBGR2HSV
+        { "Y", "Cr", "Cb" }     // modeBGR2YCrCb
+    };
+    if (mode < 0 || mode >= colorModeCount || channel < 0 || channel > 2)
+        return QString();
+    return names[mode][channel];
+}
 
-    updateLabel( channel1, &image_planes[0] );
-    updateLabel( channel2, &image_planes[1] );
-    updateLabel( channel3, &image_planes[2] );
+void OpencvSeparateChannelsToolWidget::updateWidget(OpencvSeparateChannelsToolWidget::MODE mode)
+{
+    labelChannel1->setText(channelName(mode, 0));
+    labelChannel2->setText(channelName(mode, 1));
+    labelChannel3->setText(channelName(mode, 2));
+}
 
-    channel1Image = image_planes[0].clone();
-    channel2Image = image_planes[1].clone();
-    channel3Image = image_planes[2].clone();
+void OpencvSeparateChannelsToolWidget::separate()
+{
+    if (originImage.empty()) return;
+    TRACE_SPAN("channel thumbnails");
+
+    // the converted frame is area-downsampled once to the label size and split there,
+    // everything else works on the thumbnails in the reused buffers; Qt only gets those
+    cv::Mat converted = fFrameConverted;
+    if (converted.empty()) {
+        bgr2mode(originImage, fConverted, mode);
+        converted = fConverted;
+    }
+    const int side = imageSize->value();
+    const double scale = std::min(double(side) / converted.cols, double(side) / converted.rows);
+    const cv::Size size(std::max(1, cvRound(converted.cols * scale)), std::max(1, cvRound(converted.rows * scale)));
+    const bool coloredPlanes = colored->isChecked();
+    // these modes have no meaningful colour per channel, the whole converted image is shown instead
+    const bool wholeImage = mode == modeBGR2HSV || mode == modeBGR2HLS || mode == modeBGR2Lab || mode == modeBGR2Luv;
+
+    cv::resize(converted, fSmallConverted, size, 0, 0, cv::INTER_AREA);
+    cv::split(fSmallConverted, fThumbnails);
+    if (coloredPlanes && !wholeImage) {
+        cv::parallel_for_(cv::Range(0, 3), [&](const cv::Range &range) {
+            for (int c = range.start; c < range.end; c++) {
+                // the plane alone with the others zeroed, back in BGR and then swapped for QImage
+                cv::Mat zeros = cv::Mat::zeros(size, CV_8UC1);
+                cv::Mat planes[3] = { zeros, zeros, zeros };
+                planes[c] = fThumbnails[c];
+                cv::Mat merged;
+                cv::merge(planes, 3, merged);
+                mode2bgr(merged, merged, mode);
+                cv::cvtColor(merged, fColoredThumbnails[c], cv::COLOR_BGR2RGB);
+            }
+        });
+    }
+    else if (coloredPlanes) {
+        cv::cvtColor(fSmallConverted, fColoredThumbnails[0], cv::COLOR_BGR2RGB);
+        fColoredThumbnails[1] = fColoredThumbnails[2] = fColoredThumbnails[0];
+    }
 
-//    cv::imshow( "Foreground 0", image_planes[0] );
-//    cv::imshow( "Foreground 1", image_planes[1] );
-//    cv::imshow( "Foreground 2", image_planes[2] );
+    QLabel *labels[3] = { channel1, channel2, channel3 };
+    for (int c = 0; c < 3; c++) {
+        const cv::Mat &thumbnail = coloredPlanes ? fColoredThumbnails[c] : fThumbnails[c];
+        QImage image( thumbnail.data, thumbnail.cols, thumbnail.rows, int(thumbnail.step),
+                      thumbnail.channels() == 3 ? QImage::Format_RGB888 : QImage::Format_Grayscale8 );
+        labels[c]->setPixmap(QPixmap::fromImage(image));
+    }
 }
 
 void OpencvSeparateChannelsToolWidget::modeChanged(int _mode)
 {
     mode = (MODE)_mode;
     updateWidget(mode);
+    fFrameConverted.release();
+    emit topologyChanged();
+}
+
+void OpencvSeparateChannelsToolWidget::outputChanged(bool checked)
+{
+    // the radio being unchecked reports too, one signal per switch is enough
+    if (checked) {
+        fFrameConverted.release();
+        fColorLabel->setVisible(fColorRequired && selectedChannel() >= 0);
+        emit topologyChanged();
+    }
 }
 
 void OpencvSeparateChannelsToolWidget::imageSizeChanged(int)
@@ -1087,3 +1129,600 @@ void OpencvSeparateChannelsToolWidget::imageSizeChanged(int)
     channel3->setMaximumHeight(size);
     channel3->setMaximumWidth(size);
 }
+
+void OpencvSeparateChannelsToolWidget::analyzeChannels()
+{
+    if (originImage.empty()) {
+        fAnalysisLabel->setText("Process a frame first");
+        return;
+    }
+
+    int64 start = cv::getTickCount();
+    fScores = scoreChannels(originImage, fStageReference);
+    double ms = (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+
+    QStringList lines;
+    if (fStageReference.empty())
+        lines << "No background, ranked by contrast and entropy only";
+    for (size_t i = 0; i < fScores.size() && i < 5; i++) {
+        const ChannelScore &s = fScores[i];
+        lines << QString("%1 %2: %3 (separation %4, contrast %5, entropy %6)")
+                 .arg(modeComboBox->itemText(s.mode))
+                 .arg(channelName(s.mode, s.channel))
+                 .arg(s.score, 0, 'f', 3)
+                 .arg(s.separation, 0, 'f', 3)
+                 .arg(s.contrast, 0, 'f', 3)
+                 .arg(s.entropy, 0, 'f', 3);
+    }
+    lines << QString("Analyzed in %1 ms").arg(ms, 0, 'f', 1);
+    fAnalysisLabel->setText(lines.join("\n"));
+    fUseBestButton->setEnabled(!fScores.empty());
+}
+
+void OpencvSeparateChannelsToolWidget::useBestChannel()
+{
+    if (fScores.empty())
+        return;
+    const ChannelScore &best = fScores.front();
+    modeComboBox->setCurrentIndex(best.mode);
+    QRadioButton *outputs[] = { outputChannel1, outputChannel2, outputChannel3 };
+    outputs[best.channel]->setChecked(true);
+    separate();
+}
+
+OpencvClaheToolWidget::OpencvClaheToolWidget(QWidget *parent) : OpencvBaseToolWidget(parent)
+{
+    setObjectName(PipelineSettings::ClaheGroup);
+
+    QVBoxLayout* mainLayout = (QVBoxLayout*)layout();
+    ClaheParams d;
+
+    QHBoxLayout *hl = new QHBoxLayout;
+    fClipLimit = new QDoubleSpinBox;
+    fClipLimit->setMinimum(0);
+    fClipLimit->setMaximum(40);
+    fClipLimit->setSingleStep(0.5);
+    fClipLimit->setValue(d.clipLimit);
+    fClipLimit->setPrefix("Clip limit: ");
+    hl->addWidget(fClipLimit);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fTilesX = new QSpinBox;
+    fTilesX->setMinimum(1);
+    fTilesX->setMaximum(64);
+    fTilesX->setValue(d.tilesX);
+    fTilesX->setPrefix("Tiles: ");
+    hl->addWidget(fTilesX);
+    fTilesY = new QSpinBox;
+    fTilesY->setMinimum(1);
+    fTilesY->setMaximum(64);
+    fTilesY->setValue(d.tilesY);
+    fTilesY->setPrefix("x ");
+    hl->addWidget(fTilesY);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    mainLayout->addStretch();
+    // the background of the subtractor goes through the same equalization
+    connect(fClipLimit, SIGNAL(valueChanged(double)), this, SIGNAL(topologyChanged()));
+    connect(fTilesX, SIGNAL(valueChanged(int)), this, SIGNAL(topologyChanged()));
+    connect(fTilesY, SIGNAL(valueChanged(int)), this, SIGNAL(topologyChanged()));
+
+    watchParameters();
+}
+
+void OpencvClaheToolWidget::loadSettings(QSettings *settings)
+{
+    settings->beginGroup(objectName());
+    setParams(PipelineSettings::readClaheParams(settings));
+    settings->endGroup();
+}
+
+void OpencvClaheToolWidget::saveSettings(QSettings *settings)
+{
+    settings->beginGroup(objectName());
+    PipelineSettings::writeClaheParams(settings, params());
+    settings->endGroup();
+}
+
+ClaheParams OpencvClaheToolWidget::params() const
+{
+    ClaheParams p;
+    p.clipLimit = fClipLimit->value();
+    p.tilesX = fTilesX->value();
+    p.tilesY = fTilesY->value();
+    return p;
+}
+
+void OpencvClaheToolWidget::setParams(const ClaheParams &p)
+{
+    fClipLimit->setValue(p.clipLimit);
+    fTilesX->setValue(p.tilesX);
+    fTilesY->setValue(p.tilesY);
+}
+
+void OpencvClaheToolWidget::process(cv::Mat *src, cv::Mat *dst)
+{
+    if (src->type() == CV_8UC3)
+        claheLab(*src, *dst, params());
+    else
+        src->copyTo(*dst);
+}
+
+void OpencvClaheToolWidget::processBatch(const std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst)
+{
+    const ClaheParams p = params();
+    dst.resize(src.size());
+    processFrames(int(src.size()), true, [&](int i) {
+        if (src[i].type() == CV_8UC3)
+            claheLab(src[i], dst[i], p);
+        else
+            src[i].copyTo(dst[i]);
+    });
+}
+
+void OpencvClaheToolWidget::transformReference(const cv::Mat &src, cv::Mat &dst)
+{
+    if (src.type() == CV_8UC3)
+        claheLab(src, dst, params());
+    else
+        dst = src;
+}
+
+OpencvMorphologyToolWidget::OpencvMorphologyToolWidget(QWidget *parent) : OpencvBaseToolWidget(parent)
+{
+    setObjectName(PipelineSettings::MorphologyGroup);
+
+    QVBoxLayout* mainLayout = (QVBoxLayout*)layout();
+
+    QHBoxLayout *hl = new QHBoxLayout;
+    fBinarize = new QCheckBox("Binarize (drop shadows)");
+    fBinarize->setChecked(true);
+    hl->addWidget(fBinarize);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fOpen = new QCheckBox("Opening");
+    fOpen->setChecked(true);
+    hl->addWidget(fOpen);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fClose = new QCheckBox("Closing");
+    fClose->setChecked(true);
+    hl->addWidget(fClose);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fFillHoles = new QCheckBox("Fill holes");
+    fFillHoles->setChecked(false);
+    hl->addWidget(fFillHoles);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    fShape = new QComboBox();
+    fShape->addItem("Rectangle");
+    fShape->addItem("Horizontal line");
+    fShape->addItem("Vertical line");
+
+    hl = new QHBoxLayout;
+    hl->addWidget(new QLabel("Structuring element:"));
+    hl->addWidget(fShape);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fWidth = new QSpinBox;
+    fWidth->setMinimum(1);
+    fWidth->setMaximum(1001);
+    fWidth->setValue(5);
+    fWidth->setPrefix("Width: ");
+    hl->addWidget(fWidth);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fHeight = new QSpinBox;
+    fHeight->setMinimum(1);
+    fHeight->setMaximum(1001);
+    fHeight->setValue(5);
+    fHeight->setPrefix("Height: ");
+    hl->addWidget(fHeight);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    mainLayout->addStretch();
+    connect(fShape, SIGNAL(currentIndexChanged(int)), this, SLOT(shapeChanged(int)));
+    shapeChanged(fShape->currentIndex());
+
+    watchParameters();
+}
+
+void OpencvMorphologyToolWidget::loadSettings(QSettings *settings)
+{
+    settings->beginGroup(objectName());
+    setParams(PipelineSettings::readMorphologyParams(settings));
+    settings->endGroup();
+}
+
+void OpencvMorphologyToolWidget::saveSettings(QSettings *settings)
+{
+    settings->beginGroup(objectName());
+    PipelineSettings::writeMorphologyParams(settings, params());
+    settings->endGroup();
+}
+
+MorphologyParams OpencvMorphologyToolWidget::params() const
+{
+    MorphologyParams p;
+    p.binarize = fBinarize->isChecked();
+    p.open = fOpen->isChecked();
+    p.close = fClose->isChecked();
+    p.fillHoles = fFillHoles->isChecked();
+    p.shape = (MorphShape)fShape->currentIndex();
+    p.width = fWidth->value();
+    p.height = fHeight->value();
+    return p;
+}
+
+void OpencvMorphologyToolWidget::setParams(const MorphologyParams &p)
+{
+    fBinarize->setChecked(p.binarize);
+    fOpen->setChecked(p.open);
+    fClose->setChecked(p.close);
+    fFillHoles->setChecked(p.fillHoles);
+    fShape->setCurrentIndex(p.shape);
+    fWidth->setValue(p.width);
+    fHeight->setValue(p.height);
+}
+
+void OpencvMorphologyToolWidget::process(cv::Mat *src, cv::Mat *dst)
+{
+    // a region of the plan's buffers reads the mask around it
+    if (src->isSubmatrix())
+        cleanupMaskRegion(*src, *dst, params());
+    else
+        cleanupMask(*src, *dst, params());
+}
+
+void OpencvMorphologyToolWidget::processBatch(const std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst)
+{
+    const MorphologyParams p = params();
+    dst.resize(src.size());
+    processFrames(int(src.size()), true, [&](int i) { cleanupMask(src[i], dst[i], p); });
+}
+
+void OpencvMorphologyToolWidget::shapeChanged(int shape)
+{
+    fWidth->setVisible(shape != morphVerticalLine);
+    fHeight->setVisible(shape != morphHorizontalLine);
+}
+
+OpencvPlateTrackerToolWidget::OpencvPlateTrackerToolWidget(QWidget *parent) : OpencvBaseToolWidget(parent)
+{
+    setObjectName(PipelineSettings::PlateTrackerGroup);
+
+    QVBoxLayout* mainLayout = (QVBoxLayout*)layout();
+    PlateTracker::Params d;
+
+    QHBoxLayout *hl = new QHBoxLayout;
+    fRevalidateEvery = new QSpinBox;
+    fRevalidateEvery->setMinimum(1);
+    fRevalidateEvery->setMaximum(10000);
+    fRevalidateEvery->setValue(d.revalidateEvery);
+    fRevalidateEvery->setPrefix("Full detection every: ");
+    fRevalidateEvery->setSuffix(" frames");
+    hl->addWidget(fRevalidateEvery);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fChangeThreshold = new QSpinBox;
+    fChangeThreshold->setMinimum(0);
+    fChangeThreshold->setMaximum(255);
+    fChangeThreshold->setValue(d.changeThreshold);
+    fChangeThreshold->setPrefix("Change threshold: ");
+    hl->addWidget(fChangeThreshold);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fDownscale = new QSpinBox;
+    fDownscale->setMinimum(1);
+    fDownscale->setMaximum(32);
+    fDownscale->setValue(d.downscale);
+    fDownscale->setPrefix("Change detection downscale: ");
+    hl->addWidget(fDownscale);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fRegionMargin = new QSpinBox;
+    fRegionMargin->setMinimum(0);
+    fRegionMargin->setMaximum(1000);
+    fRegionMargin->setValue(d.regionMargin);
+    fRegionMargin->setPrefix("Region margin: ");
+    hl->addWidget(fRegionMargin);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fMaxRegionFraction = new QDoubleSpinBox;
+    fMaxRegionFraction->setMinimum(0);
+    fMaxRegionFraction->setMaximum(1);
+    fMaxRegionFraction->setSingleStep(0.05);
+    fMaxRegionFraction->setValue(d.maxRegionFraction);
+    fMaxRegionFraction->setPrefix("Max region fraction: ");
+    hl->addWidget(fMaxRegionFraction);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fMinArea = new QSpinBox;
+    fMinArea->setMinimum(0);
+    fMinArea->setMaximum(10000000);
+    fMinArea->setValue(d.minArea);
+    fMinArea->setPrefix("Min plate area: ");
+    hl->addWidget(fMinArea);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fMatchOverlap = new QDoubleSpinBox;
+    fMatchOverlap->setMinimum(0);
+    fMatchOverlap->setMaximum(1);
+    fMatchOverlap->setSingleStep(0.05);
+    fMatchOverlap->setValue(d.matchOverlap);
+    fMatchOverlap->setPrefix("Match overlap: ");
+    hl->addWidget(fMatchOverlap);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fMaxMisses = new QSpinBox;
+    fMaxMisses->setMinimum(0);
+    fMaxMisses->setMaximum(1000);
+    fMaxMisses->setValue(d.maxMisses);
+    fMaxMisses->setPrefix("Max misses: ");
+    hl->addWidget(fMaxMisses);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    fStatsLabel = new QLabel;
+    mainLayout->addWidget(fStatsLabel);
+
+    mainLayout->addStretch();
+    connect(fRevalidateEvery, SIGNAL(valueChanged(int)), this, SLOT(paramsChanged()));
+    connect(fChangeThreshold, SIGNAL(valueChanged(int)), this, SLOT(paramsChanged()));
+    connect(fDownscale, SIGNAL(valueChanged(int)), this, SLOT(paramsChanged()));
+    connect(fRegionMargin, SIGNAL(valueChanged(int)), this, SLOT(paramsChanged()));
+    connect(fMaxRegionFraction, SIGNAL(valueChanged(double)), this, SLOT(paramsChanged()));
+    connect(fMinArea, SIGNAL(valueChanged(int)), this, SLOT(paramsChanged()));
+    connect(fMatchOverlap, SIGNAL(valueChanged(double)), this, SLOT(paramsChanged()));
+    connect(fMaxMisses, SIGNAL(valueChanged(int)), this, SLOT(paramsChanged()));
+    paramsChanged();
+
+    watchParameters();
+}
+
+void OpencvPlateTrackerToolWidget::loadSettings(QSettings *settings)
+{
+    settings->beginGroup(objectName());
+    setParams(PipelineSettings::readPlateTrackerParams(settings));
+    settings->endGroup();
+}
+
+void OpencvPlateTrackerToolWidget::saveSettings(QSettings *settings)
+{
+    settings->beginGroup(objectName());
+    PipelineSettings::writePlateTrackerParams(settings, params());
+    settings->endGroup();
+}
+
+PlateTracker::Params OpencvPlateTrackerToolWidget::params() const
+{
+    PlateTracker::Params p;
+    p.revalidateEvery = fRevalidateEvery->value();
+    p.changeThreshold = fChangeThreshold->value();
+    p.downscale = fDownscale->value();
+    p.regionMargin = fRegionMargin->value();
+    p.maxRegionFraction = fMaxRegionFraction->value();
+    p.minArea = fMinArea->value();
+    p.matchOverlap = fMatchOverlap->value();
+    p.maxMisses = fMaxMisses->value();
+    return p;
+}
+
+void OpencvPlateTrackerToolWidget::setParams(const PlateTracker::Params &p)
+{
+    fRevalidateEvery->setValue(p.revalidateEvery);
+    fChangeThreshold->setValue(p.changeThreshold);
+    fDownscale->setValue(p.downscale);
+    fRegionMargin->setValue(p.regionMargin);
+    fMaxRegionFraction->setValue(p.maxRegionFraction);
+    fMinArea->setValue(p.minArea);
+    fMatchOverlap->setValue(p.matchOverlap);
+    fMaxMisses->setValue(p.maxMisses);
+}
+
+FrameAction OpencvPlateTrackerToolWidget::planFrame(const cv::Mat &frame, std::vector<cv::Rect> *regions)
+{
+    return fTracker.planFrame(frame, regions);
+}
+
+void OpencvPlateTrackerToolWidget::process(cv::Mat *src, cv::Mat *dst)
+{
+    fTracker.update(*src);
+    if (dst->data != src->data)
+        src->copyTo(*dst);
+
+    const PlateTracker::Stats &stats = fTracker.stats();
+    fStatsLabel->setText(QString("Plates: %1\nFrames full: %2, regions: %3, skipped: %4")
+                         .arg(fTracker.tracks().size())
+                         .arg(stats.full)
+                         .arg(stats.regions)
+                         .arg(stats.skipped));
+}
+
+void OpencvPlateTrackerToolWidget::paramsChanged()
+{
+    fTracker.setParams(params());
+}
+
+OpencvMotionGateToolWidget::OpencvMotionGateToolWidget(QWidget *parent) : OpencvBaseToolWidget(parent)
+{
+    setObjectName(PipelineSettings::MotionGateGroup);
+
+    QVBoxLayout* mainLayout = (QVBoxLayout*)layout();
+    MotionGate::Params d;
+
+    QHBoxLayout *hl = new QHBoxLayout;
+    fDownscale = new QSpinBox;
+    fDownscale->setMinimum(1);
+    fDownscale->setMaximum(64);
+    fDownscale->setValue(d.downscale);
+    fDownscale->setPrefix("Downscale: ");
+    hl->addWidget(fDownscale);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fPixelThreshold = new QSpinBox;
+    fPixelThreshold->setMinimum(0);
+    fPixelThreshold->setMaximum(255);
+    fPixelThreshold->setValue(d.pixelThreshold);
+    fPixelThreshold->setPrefix("Pixel threshold: ");
+    hl->addWidget(fPixelThreshold);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fActivateFraction = new QDoubleSpinBox;
+    fActivateFraction->setMinimum(0);
+    fActivateFraction->setMaximum(1);
+    fActivateFraction->setDecimals(4);
+    fActivateFraction->setSingleStep(0.0005);
+    fActivateFraction->setValue(d.activateFraction);
+    fActivateFraction->setPrefix("Activate at: ");
+    hl->addWidget(fActivateFraction);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fReleaseFraction = new QDoubleSpinBox;
+    fReleaseFraction->setMinimum(0);
+    fReleaseFraction->setMaximum(1);
+    fReleaseFraction->setDecimals(4);
+    fReleaseFraction->setSingleStep(0.0005);
+    fReleaseFraction->setValue(d.releaseFraction);
+    fReleaseFraction->setPrefix("Release below: ");
+    hl->addWidget(fReleaseFraction);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fHoldFrames = new QSpinBox;
+    fHoldFrames->setMinimum(0);
+    fHoldFrames->setMaximum(10000);
+    fHoldFrames->setValue(d.holdFrames);
+    fHoldFrames->setPrefix("Hold: ");
+    fHoldFrames->setSuffix(" frames");
+    hl->addWidget(fHoldFrames);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    hl = new QHBoxLayout;
+    fFeedEvery = new QSpinBox;
+    fFeedEvery->setMinimum(0);
+    fFeedEvery->setMaximum(10000);
+    fFeedEvery->setValue(d.feedEvery);
+    fFeedEvery->setPrefix("Feed model every: ");
+    fFeedEvery->setSuffix(" idle frames");
+    hl->addWidget(fFeedEvery);
+    hl->addStretch();
+    mainLayout->addLayout(hl);
+
+    fStatsLabel = new QLabel;
+    mainLayout->addWidget(fStatsLabel);
+
+    mainLayout->addStretch();
+    connect(fDownscale, SIGNAL(valueChanged(int)), this, SLOT(paramsChanged()));
+    connect(fPixelThreshold, SIGNAL(valueChanged(int)), this, SLOT(paramsChanged()));
+    connect(fActivateFraction, SIGNAL(valueChanged(double)), this, SLOT(paramsChanged()));
+    connect(fReleaseFraction, SIGNAL(valueChanged(double)), this, SLOT(paramsChanged()));
+    connect(fHoldFrames, SIGNAL(valueChanged(int)), this, SLOT(paramsChanged()));
+    connect(fFeedEvery, SIGNAL(valueChanged(int)), this, SLOT(paramsChanged()));
+    paramsChanged();
+
+    watchParameters();
+}
+
+void OpencvMotionGateToolWidget::loadSettings(QSettings *settings)
+{
+    settings->beginGroup(objectName());
+    setParams(PipelineSettings::readMotionGateParams(settings));
+    settings->endGroup();
+}
+
+void OpencvMotionGateToolWidget::saveSettings(QSettings *settings)
+{
+    settings->beginGroup(objectName());
+    PipelineSettings::writeMotionGateParams(settings, params());
+    settings->endGroup();
+}
+
+MotionGate::Params OpencvMotionGateToolWidget::params() const
+{
+    MotionGate::Params p;
+    p.downscale = fDownscale->value();
+    p.pixelThreshold = fPixelThreshold->value();
+    p.activateFraction = fActivateFraction->value();
+    p.releaseFraction = fReleaseFraction->value();
+    p.holdFrames = fHoldFrames->value();
+    p.feedEvery = fFeedEvery->value();
+    return p;
+}
+
+void OpencvMotionGateToolWidget::setParams(const MotionGate::Params &p)
+{
+    fDownscale->setValue(p.downscale);
+    fPixelThreshold->setValue(p.pixelThreshold);
+    fActivateFraction->setValue(p.activateFraction);
+    fReleaseFraction->setValue(p.releaseFraction);
+    fHoldFrames->setValue(p.holdFrames);
+    fFeedEvery->setValue(p.feedEvery);
+}
+
+FrameAction OpencvMotionGateToolWidget::planFrame(const cv::Mat &frame, std::vector<cv::Rect> *)
+{
+    FrameAction action = fGate.planFrame(frame);
+    updateStats();
+    return action;
+}
+
+void OpencvMotionGateToolWidget::process(cv::Mat *src, cv::Mat *dst)
+{
+    if (dst->data != src->data)
+        src->copyTo(*dst);
+}
+
+void OpencvMotionGateToolWidget::paramsChanged()
+{
+    fGate.setParams(params());
+}
+
+void OpencvMotionGateToolWidget::updateStats()
+{
+    const MotionGate::Stats &stats = fGate.stats();
+    fStatsLabel->setText(QString("%1, motion %2%\nFrames active: %3, idle: %4, fed: %5")
+                         .arg(fGate.isActive() ? "Active" : "Idle")
+                         .arg(fGate.motionFraction() * 100, 0, 'f', 3)
+                         .arg(stats.active)
+                         .arg(stats.idle)
+                         .arg(stats.fed));
+}
@@ -3,6 +3,12 @@
 
 #include <QWidget>
 #include <opencv2/core.hpp>
+#include "opencvkernels.h"
+#include "fastmorphology.h"
+#include "labclahe.h"
+#include "channelscore.h"
+#include "platetracker.h"
+#include "motiongate.h"
 
 class QSpinBox;
 class QDoubleSpinBox;
@@ -20,14 +26,56 @@ public:
     explicit OpencvBaseToolWidget(QWidget *parent = nullptr);
     QLayout *layout() const { return fMainLayout; }
     bool toolIsEnabled() const { return fEnabled; }
+    // the On/Off state, in the group named as the tool
+    void loadEnabled(QSettings *settings);
+    void saveEnabled(QSettings *settings);
     virtual void loadSettings(QSettings*) = 0;
     virtual void saveSettings(QSettings*) = 0;
+    // type of the image process() writes for a source of the given type
+    virtual int outputType(int srcType) const { return srcType; }
+    // frame gating, asked by the plan before every frame; regions are filled for frameRunRegions
+    virtual OpencvKernels::FrameAction planFrame(const cv::Mat &, std::vector<cv::Rect> *) { return OpencvKernels::frameRunFull; }
+    // true if processing a region padded by margin pixels gives the same result there as processing the whole frame
+    virtual bool supportsRegions(int /*margin*/) const { return false; }
+    // pixels a gating tool pads its regions with
+    virtual int regionMargin() const { return 0; }
+    // true if process() leaves the frame as it is, the plan then passes the source on without a buffer
+    virtual bool forwardsInput() const { return false; }
+    // does to a reference image of a later tool (a background) what process() does to frames
+    virtual void transformReference(const cv::Mat &src, cv::Mat &dst) { dst = src; }
+    // image the tool compares frames with, empty if it has none
+    virtual cv::Mat referenceImage() const { return cv::Mat(); }
+    // the reference image as it looks at the input of this tool, set by the plan
+    virtual void setStageReference(const cv::Mat &) {}
+    // times a model kept across frames was rebuilt, for the metrics
+    virtual uint64_t modelResetCount() const { return 0; }
+    // processes a batch of whole frames, dst is resized to src; tools override it to read their
+    // parameters once and spread frames that do not depend on each other over threads
+    virtual void processBatch(const std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst);
+    // true if the tool has to see every frame (it keeps state from it), a plan then
+    // runs it and the tools in front of it even when no later output is looked at
+    virtual bool isSink() const { return false; }
+    // true if the tool models colour frames, the tools in front of it keep their planes
+    virtual bool needsColorInput() const { return false; }
+    // set by the plan when a later enabled tool needs colour frames
+    virtual void setColorRequired(bool) {}
+
+signals:
+    // enabled state, output format or reference transform changed, compiled plans must be rebuilt
+    void topologyChanged();
+    // a parameter control changed, the tool's output has to be computed again
+    void parametersChanged();
+
+protected:
+    // connects the spin boxes, check boxes, combo boxes and radio buttons of the tool to parametersChanged()
+    void watchParameters();
 
 public slots:
     virtual void process(cv::Mat *src, cv::Mat *dst) = 0;
 
 private:
     QLayout *fMainLayout;
+    QCheckBox *fEnabledBox;
     bool fEnabled;
 
 private slots:
@@ -41,6 +89,15 @@ public:
     explicit OpencvBackgroundSubtractorToolWidget(QWidget *parent = nullptr);
     void loadSettings(QSettings*) override;
     void saveSettings(QSettings*) override;
+    int outputType(int) const override { return CV_8UC1; }
+    bool supportsRegions(int margin) const override;
+    cv::Mat referenceImage() const override { return bgImage; }
+    void setStageReference(const cv::Mat &reference) override { fStageReference = reference; }
+    uint64_t modelResetCount() const override { return fModel.resetCount(); }
+    void processBatch(const std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst) override;
+    bool needsColorInput() const override { return OpencvKernels::backgroundAlgoNeedsColor(fAlgo); }
+    OpencvKernels::BackgroundSubtractorParams params() const;
+    void setParams(const OpencvKernels::BackgroundSubtractorParams &params);
 
 public slots:
     void process(cv::Mat *src, cv::Mat *dst) override;
@@ -53,15 +110,8 @@ private slots:
     void openBgImage();
 
 private:
-    enum ALGO {
-        MOG2 = 0,
-        KNN = 1,
-        CNT = 2,
-        GMG = 3,
-        GSOC = 4,
-        LSBP = 5,
-        MOG = 6
-    };
+    typedef OpencvKernels::BackgroundAlgo ALGO;
+
     QSpinBox*       fHistory;
     QDoubleSpinBox* fThreshold;
     QCheckBox*      fDetectShadows;
@@ -100,7 +150,14 @@ private:
     QDoubleSpinBox* fBackgroundRatio;
     QDoubleSpinBox* fNoiseSigma;
 
+    QCheckBox*      fHalfPrecision;
+
+    QCheckBox*      fContinuousModel;
+    OpencvKernels::BackgroundModel fModel;
+
     cv::Mat bgImage;
+    cv::Mat fStageReference;
+    QString fBgImagePath;
     QPushButton* fBgButton;
     QLabel* fBgLabel;
 
@@ -108,6 +165,7 @@ private:
     QComboBox *algoComboBox;
 
     void updateWidget(ALGO algo);
+    void loadBgImage(const QString &path);
 };
 
 class OpencvSeparateChannelsToolWidget : public OpencvBaseToolWidget
@@ -117,22 +175,25 @@ public:
     explicit OpencvSeparateChannelsToolWidget(QWidget *parent = nullptr);
     void loadSettings(QSettings*) override;
     void saveSettings(QSettings*) override;
+    int outputType(int srcType) const override;
+    bool supportsRegions(int) const override { return true; }
+    bool forwardsInput() const override;
+    void transformReference(const cv::Mat &src, cv::Mat &dst) override;
+    void setStageReference(const cv::Mat &reference) override { fStageReference = reference; }
+    void setColorRequired(bool required) override;
+    // selected channel 0..2, -1 forwards all planes; all planes while a later tool needs colour
+    int outputChannel() const;
 
 public slots:
     void process(cv::Mat *src, cv::Mat *dst) override;
 
+protected:
+    void showEvent(QShowEvent *event) override;
+
 private:
-    enum MODE {
-        modeBGR,
-        modeBGR2XYZ,  // COLOR_BGR2XYZ
-        modeBGR2Lab,  // COLOR_BGR2Lab
-        modeBGR2YUV,  // COLOR_BGR2YUV
-        modeBGR2HLS,  // COLOR_BGR2HLS
-        modeBGR2Luv,  // COLOR_BGR2Luv
-        modeBGR2HSV,  // COLOR_BGR2HSV
-        modeBGR2YCrCb // COLOR_BGR2YCrCb
-        // COLOR_BGR2GRAY
-    };
+    typedef OpencvKernels::ColorMode MODE;
+
+    static QString channelName(MODE mode, int channel);
 
     QComboBox *modeComboBox;
     MODE mode;
@@ -145,24 +206,155 @@ private:
     QRadioButton *outputChannel1;
     QRadioButton *outputChannel2;
     QRadioButton *outputChannel3;
+    QRadioButton *outputAllChannels;
     QSpinBox *imageSize;
     QCheckBox *colored;
+    QLabel *fColorLabel;
+    bool fColorRequired;
 
+    // the last whole frame and, with all planes output, its conversion: the plan's
+    // buffers, not copies
     cv::Mat originImage;
-    cv::Mat channel1Image;
-    cv::Mat channel2Image;
-    cv::Mat channel3Image;
+    cv::Mat fFrameConverted;
+    // preview buffers, reused from frame to frame
+    cv::Mat fConverted;
+    cv::Mat fSmallConverted;
+    cv::Mat fThumbnails[3];
+    cv::Mat fColoredThumbnails[3];
+
+    cv::Mat fStageReference;
+    QPushButton *fUseBestButton;
+    QLabel *fAnalysisLabel;
+    std::vector<OpencvKernels::ChannelScore> fScores;
 
     void updateWidget(MODE mode);
-    void updateLabel(QLabel *label, cv::Mat *mat);
-    std::vector<cv::Mat> coloredSeparatedChannels(std::vector<cv::Mat> channels);
-    cv::Mat rgb2mode(cv::Mat mat);
-    cv::Mat mode2rgb(cv::Mat mat);
+    // the checked radio button, what the settings keep
+    int selectedChannel() const;
 
 private slots:
     void separate();
     void modeChanged(int);
     void imageSizeChanged(int);
+    void analyzeChannels();
+    void useBestChannel();
+    void outputChanged(bool);
+};
+
+class OpencvClaheToolWidget : public OpencvBaseToolWidget
+{
+    Q_OBJECT
+public:
+    explicit OpencvClaheToolWidget(QWidget *parent = nullptr);
+    void loadSettings(QSettings*) override;
+    void saveSettings(QSettings*) override;
+    void transformReference(const cv::Mat &src, cv::Mat &dst) override;
+    void processBatch(const std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst) override;
+    OpencvKernels::ClaheParams params() const;
+    void setParams(const OpencvKernels::ClaheParams &params);
+
+public slots:
+    void process(cv::Mat *src, cv::Mat *dst) override;
+
+private:
+    QDoubleSpinBox* fClipLimit;
+    QSpinBox*       fTilesX;
+    QSpinBox*       fTilesY;
+};
+
+class OpencvMorphologyToolWidget : public OpencvBaseToolWidget
+{
+    Q_OBJECT
+public:
+    explicit OpencvMorphologyToolWidget(QWidget *parent = nullptr);
+    void loadSettings(QSettings*) override;
+    void saveSettings(QSettings*) override;
+    int outputType(int) const override { return CV_8UC1; }
+    bool supportsRegions(int) const override { return params().supportsRegions(); }
+    void processBatch(const std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst) override;
+    OpencvKernels::MorphologyParams params() const;
+    void setParams(const OpencvKernels::MorphologyParams &params);
+
+public slots:
+    void process(cv::Mat *src, cv::Mat *dst) override;
+
+private slots:
+    void shapeChanged(int);
+
+private:
+    QCheckBox*  fBinarize;
+    QCheckBox*  fOpen;
+    QCheckBox*  fClose;
+    QCheckBox*  fFillHoles;
+    QComboBox*  fShape;
+    QSpinBox*   fWidth;
+    QSpinBox*   fHeight;
+};
+
+class OpencvPlateTrackerToolWidget : public OpencvBaseToolWidget
+{
+    Q_OBJECT
+public:
+    explicit OpencvPlateTrackerToolWidget(QWidget *parent = nullptr);
+    void loadSettings(QSettings*) override;
+    void saveSettings(QSettings*) override;
+    OpencvKernels::FrameAction planFrame(const cv::Mat &frame, std::vector<cv::Rect> *regions) override;
+    int regionMargin() const override { return fTracker.params().regionMargin; }
+    bool forwardsInput() const override { return true; }
+    bool isSink() const override { return true; }
+    PlateTracker::Params params() const;
+    void setParams(const PlateTracker::Params &params);
+    const PlateTracker &tracker() const { return fTracker; }
+
+public slots:
+    void process(cv::Mat *src, cv::Mat *dst) override;
+
+private slots:
+    void paramsChanged();
+
+private:
+    QSpinBox*       fRevalidateEvery;
+    QSpinBox*       fChangeThreshold;
+    QSpinBox*       fDownscale;
+    QSpinBox*       fRegionMargin;
+    QDoubleSpinBox* fMaxRegionFraction;
+    QSpinBox*       fMinArea;
+    QDoubleSpinBox* fMatchOverlap;
+    QSpinBox*       fMaxMisses;
+    QLabel*         fStatsLabel;
+
+    PlateTracker fTracker;
+};
+
+class OpencvMotionGateToolWidget : public OpencvBaseToolWidget
+{
+    Q_OBJECT
+public:
+    explicit OpencvMotionGateToolWidget(QWidget *parent = nullptr);
+    void loadSettings(QSettings*) override;
+    void saveSettings(QSettings*) override;
+    OpencvKernels::FrameAction planFrame(const cv::Mat &frame, std::vector<cv::Rect> *regions) override;
+    bool forwardsInput() const override { return true; }
+    MotionGate::Params params() const;
+    void setParams(const MotionGate::Params &params);
+
+public slots:
+    void process(cv::Mat *src, cv::Mat *dst) override;
+
+private slots:
+    void paramsChanged();
+
+private:
+    QSpinBox*       fDownscale;
+    QSpinBox*       fPixelThreshold;
+    QDoubleSpinBox* fActivateFraction;
+    QDoubleSpinBox* fReleaseFraction;
+    QSpinBox*       fHoldFrames;
+    QSpinBox*       fFeedEvery;
+    QLabel*         fStatsLabel;
+
+    MotionGate fGate;
+
+    void updateStats();
 };
 
 #endif // OPENCVTOOLWIDGETS_H
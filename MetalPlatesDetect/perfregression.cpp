@@ -0,0 +1,316 @@
+#include "perfregression.h"
+#include "staticpipeline.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSettings>
+#include <QStringList>
+#include <QSysInfo>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+namespace PerfRegression {
+
+namespace {
+
+const int frameWidth = 960;
+const int frameHeight = 540;
+const int warmupFrames = 5;     // model priming and first-touch allocations
+const int timedFrames = 30;
+const uint64 seed = 0x4d504c54;
+
+const char *environmentGroup = "Environment";
+
+struct Configuration {
+    const char *name;
+    bool onMasks;   // runs on foreground masks instead of colour frames
+    std::function<void(const cv::Mat &src, cv::Mat &dst)> run;
+};
+
+// a conveyor with a gradient and some texture, plates crossing it at
+// different speeds and sensor noise on every frame
+void makeFrames(cv::Mat &background, std::vector<cv::Mat> &frames)
+{
+    cv::RNG rng(seed);
+    background.create(frameHeight, frameWidth, CV_8UC3);
+    for (int y = 0; y < frameHeight; y++) {
+        cv::Vec3b *row = background.ptr<cv::Vec3b>(y);
+        for (int x = 0; x < frameWidth; x++)
+            row[x] = cv::Vec3b(uchar(60 + x * 80 / frameWidth), uchar(70 + y * 60 / frameHeight), 90);
+    }
+    cv::Mat noise(background.size(), CV_8UC3);
+    rng.fill(noise, cv::RNG::UNIFORM, 0, 24);
+    background += noise;
+
+    frames.resize(warmupFrames + timedFrames);
+    for (int i = 0; i < int(frames.size()); i++) {
+        cv::Mat &frame = frames[i];
+        background.copyTo(frame);
+        for (int p = 0; p < 3; p++) {
+            int x = (p * 330 + i * (12 + 5 * p)) % frameWidth;
+            cv::Rect plate(x - 120, 80 + p * 150, 240, 110);
+            cv::rectangle(frame, plate, cv::Scalar(200 - 30 * p, 205, 210), cv::FILLED);
+            for (int line = 0; line < 3; line++)
+                cv::line(frame, plate.tl() + cv::Point(20, 25 + 30 * line), plate.tl() + cv::Point(220, 25 + 30 * line),
+                         cv::Scalar(40, 40, 40), 4);
+        }
+        rng.fill(noise, cv::RNG::UNIFORM, 0, 12);
+        frame += noise;
+        frame -= cv::Scalar::all(6);
+    }
+}
+
+Configuration subtractor(const char *name, OpencvKernels::BackgroundAlgo algo, const cv::Mat &background)
+{
+    OpencvKernels::BackgroundSubtractorParams params;
+    params.algo = algo;
+    params.continuousModel = true;
+    std::shared_ptr<OpencvKernels::BackgroundModel> model = std::make_shared<OpencvKernels::BackgroundModel>();
+    Configuration configuration = { name, false, [=](const cv::Mat &src, cv::Mat &dst) { model->apply(params, background, src, dst); } };
+    return configuration;
+}
+
+// never change the parameters of an existing entry, add a new one instead,
+// the baseline only means something for the same work
+std::vector<Configuration> configurations(const cv::Mat &background)
+{
+    using namespace OpencvKernels;
+    std::vector<Configuration> list;
+    list.push_back({ "cvtColor_Lab", false, [](const cv::Mat &src, cv::Mat &dst) { bgr2mode(src, dst, modeBGR2Lab); } });
+    list.push_back({ "cvtColor_HSV", false, [](const cv::Mat &src, cv::Mat &dst) { bgr2mode(src, dst, modeBGR2HSV); } });
+    list.push_back({ "cvtColor_YCrCb", false, [](const cv::Mat &src, cv::Mat &dst) { bgr2mode(src, dst, modeBGR2YCrCb); } });
+    list.push_back({ "separateChannel_Lab_L", false, [](const cv::Mat &src, cv::Mat &dst) { separateChannel(src, dst, modeBGR2Lab, 0); } });
+    list.push_back({ "claheLab", false, [](const cv::Mat &src, cv::Mat &dst) { claheLab(src, dst, ClaheParams()); } });
+    list.push_back(subtractor("GSOC", GSOC, background));
+    list.push_back(subtractor("LSBP", LSBP, background));
+    list.push_back(subtractor("MOG2", MOG2, background));
+    list.push_back(subtractor("SoaMOG", SOAMOG, background));
+    list.push_back({ "cleanupMask", true, [](const cv::Mat &src, cv::Mat &dst) { cleanupMask(src, dst, MorphologyParams()); } });
+
+    // the whole chain as a fresh config.ini sets it up
+    std::shared_ptr<ProductionPipeline> pipeline = std::make_shared<ProductionPipeline>();
+    pipeline->stage<2>().setBackground(background);
+    list.push_back({ "ProductionPipeline", false, [=](const cv::Mat &src, cv::Mat &dst) { pipeline->process(src, dst); } });
+    return list;
+}
+
+// plain scalar work over the frame, only depends on the compiler and the box
+uint64 calibrationLoop(const cv::Mat &frame)
+{
+    uint64 sum = 0;
+    for (int y = 0; y < frame.rows; y++) {
+        const uchar *row = frame.ptr<uchar>(y);
+        const int n = frame.cols * frame.channels();
+        for (int x = 3; x < n - 3; x++)
+            sum += unsigned(row[x - 3] + 2 * row[x] + row[x + 3]) >> 2;
+    }
+    return sum;
+}
+
+// as the kernel names it, the architecture where it doesn't
+QString cpuModel()
+{
+    QFile cpuinfo("/proc/cpuinfo");
+    if (cpuinfo.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        foreach (const QByteArray &line, cpuinfo.readAll().split('\n')) {
+            const int colon = line.indexOf(':');
+            if (line.startsWith("model name") && colon >= 0)
+                return QString::fromLatin1(line.mid(colon + 1)).trimmed();
+        }
+    }
+    return QSysInfo::currentCpuArchitecture();
+}
+
+double median(std::vector<double> values)
+{
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+double elapsedMs(int64 start)
+{
+    return (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+}
+
+void printResults(const std::vector<Result> &results)
+{
+    qInfo().noquote() << QString("%1 %2 %3").arg("configuration", -24).arg("ms", 10).arg("relative", 10);
+    for (size_t i = 0; i < results.size(); i++) {
+        qInfo().noquote() << QString("%1 %2 %3")
+                             .arg(QString::fromStdString(results[i].name), -24)
+                             .arg(results[i].ms, 10, 'f', 3)
+                             .arg(results[i].relative, 10, 'f', 3);
+    }
+}
+
+}
+
+QString baselineFile(const QString &baselinePath)
+{
+    if (baselinePath.endsWith(".ini"))
+        return baselinePath;
+    QString name = cpuModel().toLower();
+    name.replace(QRegularExpression("[^a-z0-9]+"), "-");
+    name.remove(QRegularExpression("^-+|-+$"));
+    return QDir(baselinePath).filePath(name + ".ini");
+}
+
+std::vector<Result> measure()
+{
+    cv::Mat background;
+    std::vector<cv::Mat> frames;
+    makeFrames(background, frames);
+    std::vector<cv::Mat> masks(frames.size());
+    cv::Mat difference;
+    for (size_t i = 0; i < frames.size(); i++) {
+        cv::absdiff(frames[i], background, difference);
+        cv::cvtColor(difference, difference, cv::COLOR_BGR2GRAY);
+        cv::threshold(difference, masks[i], 30, 255, cv::THRESH_BINARY);
+    }
+
+    // the core count of the box must not show in the timings
+    const int threads = cv::getNumThreads();
+    cv::setNumThreads(1);
+
+    std::vector<Result> results;
+    std::vector<double> times;
+    volatile uint64 sink = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        int64 start = cv::getTickCount();
+        sink = sink + calibrationLoop(frames[i]);
+        if (int(i) >= warmupFrames)
+            times.push_back(elapsedMs(start));
+    }
+    const double calibrationMs = std::max(median(times), 1e-6);
+    Result calibration = { "calibration", calibrationMs, 1 };
+    results.push_back(calibration);
+
+    std::vector<Configuration> list = configurations(background);
+    cv::Mat output;
+    for (size_t c = 0; c < list.size(); c++) {
+        const std::vector<cv::Mat> &inputs = list[c].onMasks ? masks : frames;
+        times.clear();
+        for (size_t i = 0; i < inputs.size(); i++) {
+            int64 start = cv::getTickCount();
+            list[c].run(inputs[i], output);
+            if (int(i) >= warmupFrames)
+                times.push_back(elapsedMs(start));
+        }
+        double ms = median(times);
+        Result result = { list[c].name, ms, ms / calibrationMs };
+        results.push_back(result);
+    }
+
+    cv::setNumThreads(threads);
+    return results;
+}
+
+int record(const QString &baselinePath)
+{
+    std::vector<Result> results = measure();
+    printResults(results);
+
+    const QString path = baselineFile(baselinePath);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSettings baseline(path, QSettings::IniFormat);
+    baseline.clear();
+    baseline.beginGroup(environmentGroup);
+    baseline.setValue("CPU", cpuModel());
+    baseline.setValue("OpenCV", QString::fromStdString(cv::getVersionString()));
+    baseline.setValue("Width", frameWidth);
+    baseline.setValue("Height", frameHeight);
+    baseline.setValue("Frames", timedFrames);
+    baseline.endGroup();
+    for (size_t i = 0; i < results.size(); i++) {
+        baseline.beginGroup(QString::fromStdString(results[i].name));
+        baseline.setValue("ms", results[i].ms);
+        baseline.setValue("relative", results[i].relative);
+        baseline.endGroup();
+    }
+    baseline.sync();
+    if (baseline.status() != QSettings::NoError) {
+        qWarning() << "Cannot write the baseline" << path;
+        return 1;
+    }
+    qInfo().noquote() << "Baseline written to" << path;
+    return 0;
+}
+
+int check(const QString &baselinePath, double tolerancePercent)
+{
+    const QString path = baselineFile(baselinePath);
+    if (!QFile::exists(path)) {
+        qInfo().noquote() << QString("No baseline for %1 at %2 yet, this run is recorded as it; "
+                                     "run the check again after the change under test").arg(cpuModel(), path);
+        return record(baselinePath);
+    }
+    QSettings baseline(path, QSettings::IniFormat);
+    baseline.beginGroup(environmentGroup);
+    const QString baselineVersion = baseline.value("OpenCV").toString();
+    const QString baselineCpu = baseline.value("CPU").toString();
+    if (baselineCpu != cpuModel()) {
+        qWarning().noquote() << QString("The baseline was recorded on %1, this is %2; expect differences beyond the tolerance")
+                                .arg(baselineCpu.isEmpty() ? QString("an unknown CPU") : baselineCpu, cpuModel());
+    }
+    if (baseline.value("Width").toInt() != frameWidth || baseline.value("Height").toInt() != frameHeight ||
+            baseline.value("Frames").toInt() != timedFrames) {
+        qWarning().noquote() << "The baseline was recorded on other frames, record it again with --perf-record";
+        return 1;
+    }
+    baseline.endGroup();
+
+    std::vector<Result> results = measure();
+    qInfo().noquote() << QString("OpenCV %1 against a baseline from OpenCV %2, tolerance %3%")
+                         .arg(QString::fromStdString(cv::getVersionString()), baselineVersion)
+                         .arg(tolerancePercent);
+    qInfo().noquote() << QString("calibration loop %1 ms, %2 ms in the baseline, timings below are relative to it")
+                         .arg(results[0].ms, 0, 'f', 3)
+                         .arg(baseline.value("calibration/ms").toDouble(), 0, 'f', 3);
+    qInfo().noquote() << QString("%1 %2 %3 %4").arg("configuration", -24).arg("baseline", 10).arg("current", 10).arg("change", 9);
+
+    int slower = 0;
+    QStringList measured;
+    for (size_t i = 1; i < results.size(); i++) {
+        const Result &result = results[i];
+        const QString name = QString::fromStdString(result.name);
+        measured << name;
+        QString line = QString("%1 ").arg(name, -24);
+        const double reference = baseline.value(name + "/relative").toDouble();
+        if (reference <= 0) {
+            qInfo().noquote() << line + QString("%1 %2 %3  new").arg("-", 10).arg(result.relative, 10, 'f', 3).arg("", 9);
+            continue;
+        }
+        const double change = (result.relative / reference - 1) * 100;
+        const char *status = "";
+        if (change > tolerancePercent) {
+            status = "  SLOWER";
+            slower++;
+        }
+        else if (change < -tolerancePercent) {
+            status = "  faster, consider recording the baseline again";
+        }
+        qInfo().noquote() << line + QString("%1 %2 %3%4")
+                             .arg(reference, 10, 'f', 3)
+                             .arg(result.relative, 10, 'f', 3)
+                             .arg(QString("%1%2%").arg(change >= 0 ? "+" : "").arg(change, 0, 'f', 1), 9)
+                             .arg(status);
+    }
+    foreach (const QString &group, baseline.childGroups()) {
+        if (group != environmentGroup && group != "calibration" && !measured.contains(group))
+            qInfo().noquote() << QString("%1 no longer measured").arg(group, -24);
+    }
+
+    if (slower) {
+        qWarning().noquote() << QString("%1 of %2 configurations slower than the baseline").arg(slower).arg(measured.size());
+        return 1;
+    }
+    qInfo().noquote() << "No regressions";
+    return 0;
+}
+
+} // namespace PerfRegression
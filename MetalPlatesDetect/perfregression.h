@@ -0,0 +1,36 @@
+#ifndef PERFREGRESSION_H
+#define PERFREGRESSION_H
+
+#include <QString>
+#include <string>
+#include <vector>
+
+// Times a fixed set of pipeline configurations on synthetic frames that are
+// the same on every run, to catch OpenCV upgrades that make cvtColor or the
+// subtractors slower. Timings are the median per frame on one thread,
+// divided by the time of a plain C++ loop over the same frames. That takes
+// out the clock but not the microarchitecture, so baselines are kept per CPU
+// model: a directory holds one file for every model recorded on.
+namespace PerfRegression {
+
+struct Result {
+    std::string name;
+    double      ms;
+    double      relative;   // ms over the calibration loop
+};
+
+// the calibration loop comes first
+std::vector<Result> measure();
+
+// the file of this box's CPU model for a directory, else the path itself
+QString baselineFile(const QString &baselinePath);
+
+// both return the process exit code
+int record(const QString &baselinePath);
+// fails when a configuration got slower than the baseline by more than the tolerance;
+// without a baseline for this CPU model it records one and succeeds
+int check(const QString &baselinePath, double tolerancePercent);
+
+} // namespace PerfRegression
+
+#endif // PERFREGRESSION_H
@@ -0,0 +1,126 @@
+#include "pipelinemetrics.h"
+
+#include <algorithm>
+#include <cstdio>
+
+const double PipelineMetrics::bucketBoundsMs[bucketCount] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 };
+
+namespace {
+
+uint64_t toUs(double ms)
+{
+    return ms > 0 ? uint64_t(ms * 1000 + 0.5) : 0;
+}
+
+std::string seconds(uint64_t us)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.6f", us / 1e6);
+    return text;
+}
+
+std::string quoted(const std::string &label)
+{
+    std::string escaped;
+    for (size_t i = 0; i < label.size(); i++) {
+        if (label[i] == '\\' || label[i] == '"')
+            escaped += '\\';
+        if (label[i] == '\n')
+            escaped += "\\n";
+        else
+            escaped += label[i];
+    }
+    return '"' + escaped + '"';
+}
+
+void header(std::string &out, const char *name, const char *type, const char *help)
+{
+    out += std::string("# HELP ") + name + ' ' + help + '\n';
+    out += std::string("# TYPE ") + name + ' ' + type + '\n';
+}
+
+}
+
+PipelineMetrics::PipelineMetrics() :
+    fFrameUs(0),
+    fGatedFrames(0),
+    fQueueDepth(0),
+    fDroppedFrames(0),
+    fModelResets(0),
+    fDeadlineMisses(0),
+    fGovernorLevel(0)
+{
+    for (int i = 0; i <= bucketCount; i++)
+        fFrameBuckets[i].store(0, std::memory_order_relaxed);
+}
+
+void PipelineMetrics::setStageNames(const std::vector<std::string> &names)
+{
+    fStageNames.assign(names.begin(), names.begin() + std::min<size_t>(names.size(), maxStages));
+}
+
+void PipelineMetrics::recordStage(int stage, double ms)
+{
+    if (stage < 0 || stage >= maxStages)
+        return;
+    uint64_t us = toUs(ms);
+    StageCounters &counters = fStages[stage];
+    counters.runs.fetch_add(1, std::memory_order_relaxed);
+    counters.totalUs.fetch_add(us, std::memory_order_relaxed);
+    counters.lastUs.store(us, std::memory_order_relaxed);
+}
+
+void PipelineMetrics::recordFrame(double ms)
+{
+    int bucket = int(std::lower_bound(bucketBoundsMs, bucketBoundsMs + bucketCount, ms) - bucketBoundsMs);
+    fFrameBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    fFrameUs.fetch_add(toUs(ms), std::memory_order_relaxed);
+}
+
+std::string PipelineMetrics::exposition() const
+{
+    std::string out;
+
+    header(out, "metalplates_stage_runs_total", "counter", "Times the stage ran.");
+    for (size_t i = 0; i < fStageNames.size(); i++)
+        out += "metalplates_stage_runs_total{stage=" + quoted(fStageNames[i]) + "} "
+                + std::to_string(fStages[i].runs.load(std::memory_order_relaxed)) + '\n';
+    header(out, "metalplates_stage_seconds_total", "counter", "Time spent in the stage.");
+    for (size_t i = 0; i < fStageNames.size(); i++)
+        out += "metalplates_stage_seconds_total{stage=" + quoted(fStageNames[i]) + "} "
+                + seconds(fStages[i].totalUs.load(std::memory_order_relaxed)) + '\n';
+    header(out, "metalplates_stage_last_seconds", "gauge", "Time the last run of the stage took.");
+    for (size_t i = 0; i < fStageNames.size(); i++)
+        out += "metalplates_stage_last_seconds{stage=" + quoted(fStageNames[i]) + "} "
+                + seconds(fStages[i].lastUs.load(std::memory_order_relaxed)) + '\n';
+
+    // the buckets are counted separately and summed up here, so a scrape may
+    // see a frame in a bucket before it is in the count; the count is the sum
+    header(out, "metalplates_frame_seconds", "histogram", "Processing time per frame.");
+    uint64_t cumulative = 0;
+    for (int i = 0; i <= bucketCount; i++) {
+        cumulative += fFrameBuckets[i].load(std::memory_order_relaxed);
+        char bound[32];
+        if (i < bucketCount)
+            snprintf(bound, sizeof(bound), "%g", bucketBoundsMs[i] / 1000);
+        else
+            snprintf(bound, sizeof(bound), "+Inf");
+        out += std::string("metalplates_frame_seconds_bucket{le=\"") + bound + "\"} " + std::to_string(cumulative) + '\n';
+    }
+    out += "metalplates_frame_seconds_sum " + seconds(fFrameUs.load(std::memory_order_relaxed)) + '\n';
+    out += "metalplates_frame_seconds_count " + std::to_string(cumulative) + '\n';
+
+    header(out, "metalplates_frames_gated_total", "counter", "Frames a gate left to the previous results.");
+    out += "metalplates_frames_gated_total " + std::to_string(fGatedFrames.load(std::memory_order_relaxed)) + '\n';
+    header(out, "metalplates_frames_dropped_total", "counter", "Frames dropped before their result was shown or written.");
+    out += "metalplates_frames_dropped_total " + std::to_string(fDroppedFrames.load(std::memory_order_relaxed)) + '\n';
+    header(out, "metalplates_queue_depth", "gauge", "Frames waiting to be processed or shown.");
+    out += "metalplates_queue_depth " + std::to_string(fQueueDepth.load(std::memory_order_relaxed)) + '\n';
+    header(out, "metalplates_model_resets_total", "counter", "Times the background model was rebuilt.");
+    out += "metalplates_model_resets_total " + std::to_string(fModelResets.load(std::memory_order_relaxed)) + '\n';
+    header(out, "metalplates_deadline_misses_total", "counter", "Frames over the latency governor deadline.");
+    out += "metalplates_deadline_misses_total " + std::to_string(fDeadlineMisses.load(std::memory_order_relaxed)) + '\n';
+    header(out, "metalplates_governor_level", "gauge", "Degradation level of the latency governor, 0 is full quality.");
+    out += "metalplates_governor_level " + std::to_string(fGovernorLevel.load(std::memory_order_relaxed)) + '\n';
+    return out;
+}
@@ -0,0 +1,65 @@
+#ifndef PIPELINEMETRICS_H
+#define PIPELINEMETRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Health counters of the processing, written by the thread that runs the
+// pipeline and read by the metrics server. Every counter is a relaxed atomic,
+// recording never locks or allocates. Counters that are kept elsewhere (frames
+// dropped by the display, model resets, deadline misses) are mirrored from
+// their owners' totals after every frame.
+class PipelineMetrics
+{
+public:
+    enum { maxStages = 16 };
+
+    PipelineMetrics();
+
+    // stage names are fixed before the metrics are served, stages are numbered by the caller
+    void setStageNames(const std::vector<std::string> &names);
+
+    void recordStage(int stage, double ms);
+    void recordFrame(double ms);
+    // the frame was left to the previous results by a gate
+    void recordGatedFrame() { fGatedFrames.fetch_add(1, std::memory_order_relaxed); }
+
+    void setQueueDepth(int64_t frames) { fQueueDepth.store(frames, std::memory_order_relaxed); }
+    void setDroppedFrames(uint64_t total) { fDroppedFrames.store(total, std::memory_order_relaxed); }
+    void setModelResets(uint64_t total) { fModelResets.store(total, std::memory_order_relaxed); }
+    void setDeadlineMisses(uint64_t total) { fDeadlineMisses.store(total, std::memory_order_relaxed); }
+    void setGovernorLevel(int level) { fGovernorLevel.store(level, std::memory_order_relaxed); }
+
+    // Prometheus text exposition format, version 0.0.4
+    std::string exposition() const;
+
+private:
+    struct StageCounters {
+        StageCounters() : runs(0), totalUs(0), lastUs(0) {}
+        std::atomic<uint64_t> runs;
+        std::atomic<uint64_t> totalUs;
+        std::atomic<uint64_t> lastUs;
+    };
+
+    enum { bucketCount = 10 };
+    static const double bucketBoundsMs[bucketCount];
+
+    std::vector<std::string> fStageNames;
+    StageCounters fStages[maxStages];
+
+    std::atomic<uint64_t> fFrameUs;
+    std::atomic<uint64_t> fFrameBuckets[bucketCount + 1];  // the last one is +Inf
+    std::atomic<uint64_t> fGatedFrames;
+    std::atomic<int64_t> fQueueDepth;
+    std::atomic<uint64_t> fDroppedFrames;
+    std::atomic<uint64_t> fModelResets;
+    std::atomic<uint64_t> fDeadlineMisses;
+    std::atomic<int> fGovernorLevel;
+
+    PipelineMetrics(const PipelineMetrics&);
+    PipelineMetrics &operator=(const PipelineMetrics&);
+};
+
+#endif // PIPELINEMETRICS_H
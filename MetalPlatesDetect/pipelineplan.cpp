@@ -0,0 +1,210 @@
+#include "pipelineplan.h"
+#include "opencvtoolwidgets.h"
+#include "pipelinemetrics.h"
+#include "tracing.h"
+#include "memoryaccounting.h"
+#include <QDebug>
+#include <algorithm>
+
+using namespace OpencvKernels;
+
+namespace {
+
+// a tool that reallocates its output writes into a buffer of its own, which the
+// plan never sees: its result is copied back into the plan's buffer
+void processInto(OpencvBaseToolWidget *tool, cv::Mat &src, cv::Mat &dst)
+{
+    cv::Mat target = dst;
+    tool->process(&src, &dst);
+    if (dst.data == target.data)
+        return;
+    if (dst.size() != target.size() || dst.type() != target.type())
+        CV_Error(cv::Error::StsUnmatchedSizes, std::string(tool->metaObject()->className()) + " did not write the output format it reported");
+    qWarning() << tool->metaObject()->className() << "reallocated its output, copied into the plan's buffer";
+    dst.copyTo(target);
+    dst = target;
+}
+
+}
+
+PipelinePlan::PipelinePlan() :
+    fLastSink(-1),
+    fFrame(0),
+    fAction(frameRunFull),
+    fGate(-1),
+    fType(-1),
+    fValid(false),
+    fMetrics(nullptr)
+{
+}
+
+void PipelinePlan::compile(const QList<OpencvBaseToolWidget*> &tools, const cv::Mat &input)
+{
+    MemoryAccounting::StageScope memoryScope("PipelinePlan");
+    fSteps.clear();
+    fViewBuffer.clear();
+    fViewStep.clear();
+    fBuffers.clear();
+    fLastSink = -1;
+    fInput = cv::Mat();
+    fSize = input.size();
+    fType = input.type();
+
+    int lastBuffer = -1;
+    int type = fType;
+    // the first enabled tool with a reference image provides it for all of them
+    cv::Mat reference;
+    foreach (auto tool, tools) {
+        if (tool->toolIsEnabled() && reference.empty())
+            reference = tool->referenceImage();
+    }
+    // a tool modelling colour frames keeps the planes of the tools in front of it
+    bool colorRequired = false;
+    for (int t = tools.count() - 1; t >= 0; t--) {
+        if (tools[t]->toolIsEnabled()) {
+            tools[t]->setColorRequired(colorRequired);
+            colorRequired = colorRequired || tools[t]->needsColorInput();
+        }
+    }
+
+    for (int t = 0; t < tools.count(); t++) {
+        OpencvBaseToolWidget *tool = tools[t];
+        if (tool->toolIsEnabled()) {
+            tool->setStageReference(reference);
+            if (!reference.empty()) {
+                cv::Mat transformed;
+                tool->transformReference(reference, transformed);
+                reference = transformed;
+            }
+
+            Step step;
+            step.tool = tool;
+            step.toolIndex = t;
+            step.memoryStage = MemoryAccounting::instance().stageId(tool->metaObject()->className());
+            step.inputBuffer = lastBuffer;
+            step.frame = -1;
+            step.regions = false;
+            if (tool->forwardsInput())
+                step.outputBuffer = lastBuffer;
+            else {
+                type = tool->outputType(type);
+                fBuffers.push_back(cv::Mat(fSize, type));
+                step.outputBuffer = int(fBuffers.size()) - 1;
+            }
+            fSteps.append(step);
+            lastBuffer = step.outputBuffer;
+            if (tool->isSink())
+                fLastSink = fSteps.count() - 1;
+        }
+        fViewBuffer.append(lastBuffer);
+        fViewStep.append(fSteps.count() - 1);
+    }
+    fValid = true;
+}
+
+bool PipelinePlan::isCompiledFor(const cv::Mat &input) const
+{
+    return fValid && input.size() == fSize && input.type() == fType;
+}
+
+void PipelinePlan::setInput(const cv::Mat &input)
+{
+    fInput = input;
+    fFrame++;
+
+    fGate = -1;
+    fAction = frameRunFull;
+    for (int i = 0; i < fSteps.count() && fGate < 0; i++) {
+        fAction = fSteps[i].tool->planFrame(input, &fRegions);
+        if (fAction != frameRunFull)
+            fGate = i;
+    }
+    if (fAction == frameRunRegions) {
+        // the others run on the whole frame; if no tool works on regions the frame runs in full
+        const int margin = fSteps[fGate].tool->regionMargin();
+        bool any = false;
+        for (int i = 0; i < fGate; i++) {
+            const bool supported = fSteps[i].tool->supportsRegions(margin);
+            fSteps[i].regions = supported || fSteps[i].tool->forwardsInput();
+            any = any || supported;
+        }
+        if (!any)
+            fAction = frameRunFull;
+    }
+    if (fMetrics && (fAction == frameSkipUpstream || fAction == frameSkipDownstream))
+        fMetrics->recordGatedFrame();
+}
+
+void PipelinePlan::invalidateFrom(const OpencvBaseToolWidget *tool)
+{
+    bool after = false;
+    for (int i = 0; i < fSteps.count(); i++) {
+        after = after || fSteps[i].tool == tool;
+        if (after)
+            fSteps[i].frame = -1;
+    }
+}
+
+void PipelinePlan::run(const cv::Mat &input)
+{
+    setInput(input);
+    evaluate(fSteps.count() - 1);
+}
+
+void PipelinePlan::evaluate(int lastStep)
+{
+    TRACE_SPAN("PipelinePlan::evaluate");
+    int64 frameStart = cv::getTickCount();
+    bool ran = false;
+
+    for (int i = 0; i <= lastStep; i++) {
+        Step &step = fSteps[i];
+        if (step.frame == fFrame)
+            continue;
+        // the outputs of a step only depend on earlier steps, so a step holding the
+        // previous frame has earlier steps that held it too: gating stays consistent
+        const bool previous = step.frame == fFrame - 1;
+        const bool upstream = i < fGate;
+        const bool downstream = fGate >= 0 && i > fGate;
+        step.frame = fFrame;
+        if (previous && ((fAction == frameSkipUpstream && upstream) || (fAction == frameSkipDownstream && downstream)))
+            continue;
+
+        // class names are static strings, as the trace needs them
+        Tracing::Span span(step.tool->metaObject()->className());
+        MemoryAccounting::StageScope memoryScope(step.memoryStage);
+        int64 start = cv::getTickCount();
+        cv::Mat src = buffer(step.inputBuffer);
+        cv::Mat dst = buffer(step.outputBuffer);
+        if (previous && fAction == frameRunRegions && upstream && step.regions) {
+            for (size_t r = 0; r < fRegions.size(); r++) {
+                cv::Mat srcRegion = src(fRegions[r]);
+                cv::Mat dstRegion = dst(fRegions[r]);
+                processInto(step.tool, srcRegion, dstRegion);
+            }
+        }
+        else
+            processInto(step.tool, src, dst);
+        ran = true;
+        if (fMetrics)
+            fMetrics->recordStage(step.toolIndex, (cv::getTickCount() - start) * 1000. / cv::getTickFrequency());
+    }
+
+    if (fMetrics && ran)
+        fMetrics->recordFrame((cv::getTickCount() - frameStart) * 1000. / cv::getTickFrequency());
+}
+
+cv::Mat PipelinePlan::result(int toolIndex)
+{
+    if (toolIndex < 0 || toolIndex >= fViewBuffer.count())
+        return cv::Mat();
+    // a plan waiting to be compiled again shows what it has
+    if (fValid && !fInput.empty())
+        evaluate(std::max(fViewStep[toolIndex], fLastSink));
+    return buffer(fViewBuffer[toolIndex]);
+}
+
+cv::Mat PipelinePlan::buffer(int index) const
+{
+    return index < 0 ? fInput : fBuffers[index];
+}
@@ -0,0 +1,93 @@
+#ifndef PIPELINEPLAN_H
+#define PIPELINEPLAN_H
+
+#include <QList>
+#include <QVector>
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <vector>
+#include "opencvkernels.h"
+
+class OpencvBaseToolWidget;
+class PipelineMetrics;
+
+// Execution plan compiled from the tool list: disabled tools are elided and
+// every enabled tool gets a preallocated output buffer of the right size and
+// type. The plan only has to be rebuilt when the tool topology (enabled flags,
+// output formats) or the input geometry changes.
+// Before every frame the enabled tools may gate it (see planFrame()): the
+// first tool that does not ask for a full run decides whether the tools in
+// front of it run on changed regions only or are skipped, or whether the
+// tools after it are skipped.
+// Tools that only look at the frame (forwardsInput()) get no buffer of their
+// own, they see and pass on the output of the previous tool.
+// The reference image (the background) is passed through the enabled tools
+// once at compile time, every tool gets it as it looks at its input. Tools in
+// front of one that models colour frames (needsColorInput()) are told to keep
+// their planes.
+// Evaluation is pull based: setInput() starts a frame and result() runs the
+// tools up to the requested one, plus the sinks (isSink()) and what they
+// depend on. Outputs stay cached until the next frame, or until the
+// parameters of a tool change, which makes it and the tools after it run again.
+// Gated work (regions, skips) is only done by tools that hold the output of
+// the previous frame, the others run in full. Tools that can not work on the
+// regions (see supportsRegions()) run on the whole frame, which holds the
+// previous frame outside the regions.
+// With metrics set every tool's run is recorded as the stage of its index in
+// the tool list. Memory allocated by a tool is accounted to its class name,
+// the plan's own buffers to PipelinePlan.
+class PipelinePlan
+{
+public:
+    PipelinePlan();
+
+    void compile(const QList<OpencvBaseToolWidget*> &tools, const cv::Mat &input);
+    void invalidate() { fValid = false; }
+    bool isCompiledFor(const cv::Mat &input) const;
+    bool hasInput() const { return !fInput.empty(); }
+
+    // starts a new frame, the tools gate it but nothing runs before a result is asked for
+    void setInput(const cv::Mat &input);
+    // the tool's output and the outputs after it are computed again when asked for
+    void invalidateFrom(const OpencvBaseToolWidget *tool);
+    // setInput() and every tool
+    void run(const cv::Mat &input);
+    void setMetrics(PipelineMetrics *metrics) { fMetrics = metrics; }
+
+    // output of the tool with the given index, a disabled tool shows the output of the previous enabled one;
+    // runs what is not current of the tools it depends on, unless the plan has to be compiled again
+    cv::Mat result(int toolIndex);
+    int toolCount() const { return fViewBuffer.count(); }
+
+private:
+    struct Step {
+        OpencvBaseToolWidget *tool;
+        int toolIndex;
+        int memoryStage;
+        int inputBuffer;    // -1 is the plan input
+        int outputBuffer;   // same as inputBuffer for forwarding tools
+        int64_t frame;      // frame the output is current for, -1 if none
+        bool regions;       // runs on the regions of the current frame
+    };
+
+    cv::Mat buffer(int index) const;
+    // runs the steps up to the given one that are not current
+    void evaluate(int lastStep);
+
+    QVector<Step> fSteps;
+    std::vector<cv::Mat> fBuffers;
+    QVector<int> fViewBuffer;
+    QVector<int> fViewStep;     // last enabled step up to the tool, -1 if none
+    int fLastSink;
+    std::vector<cv::Rect> fRegions;
+    cv::Mat fInput;
+    int64_t fFrame;
+    OpencvKernels::FrameAction fAction;
+    int fGate;
+    cv::Size fSize;
+    int fType;
+    bool fValid;
+    PipelineMetrics *fMetrics;
+};
+
+#endif // PIPELINEPLAN_H
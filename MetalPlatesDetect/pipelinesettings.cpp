@@ -0,0 +1,388 @@
+#include "pipelinesettings.h"
+#include <QSettings>
+
+using namespace OpencvKernels;
+
+namespace PipelineSettings {
+
+const char * const SeparateChannelsGroup = "SeparateChannelsToolWidget";
+const char * const BackgroundSubtractorGroup = "BackgroundSubtractorToolWidget";
+const char * const MorphologyGroup = "MorphologyToolWidget";
+const char * const ClaheGroup = "ClaheToolWidget";
+const char * const PlateTrackerGroup = "PlateTrackerToolWidget";
+const char * const MotionGateGroup = "MotionGateToolWidget";
+const char * const LatencyGovernorGroup = "LatencyGovernor";
+const char * const MetricsGroup = "Metrics";
+const char * const TracingGroup = "Tracing";
+const char * const MemoryGroup = "Memory";
+const char * const FrameArenaGroup = "FrameArena";
+const char * const AffinityGroup = "Affinity";
+const char * const DetectionLogGroup = "DetectionLog";
+const char * const OutputRingGroup = "OutputRing";
+
+bool readToolEnabled(QSettings *settings)
+{
+    return settings->value("Enabled", true).toBool();
+}
+
+void writeToolEnabled(QSettings *settings, bool enabled)
+{
+    settings->setValue("Enabled", enabled);
+}
+
+SeparateChannelsParams readSeparateChannelsParams(QSettings *settings)
+{
+    SeparateChannelsParams d;
+    SeparateChannelsParams p;
+    p.mode = (ColorMode)(settings->value("Mode", d.mode).toInt());
+    p.channel = qBound(-1, settings->value("OutputChannel", d.channel).toInt(), 2);
+    return p;
+}
+
+void writeSeparateChannelsParams(QSettings *settings, const SeparateChannelsParams &p)
+{
+    settings->setValue("Mode", p.mode);
+    settings->setValue("OutputChannel", p.channel);
+}
+
+BackgroundSubtractorParams readBackgroundSubtractorParams(QSettings *settings)
+{
+    BackgroundSubtractorParams d;
+    BackgroundSubtractorParams p;
+    p.algo = (BackgroundAlgo)(settings->value("algorithm", d.algo).toInt());
+    p.history =         settings->value("History",          d.history).toInt();
+    p.threshold =       settings->value("Threshold",        d.threshold).toDouble();
+    p.detectShadows =   settings->value("DetectShadows",    d.detectShadows).toBool();
+
+    p.minPixelStability =   settings->value("MinPixelStability",    d.minPixelStability).toInt();
+    p.maxPixelStability =   settings->value("MaxPixelStability",    d.maxPixelStability).toInt();
+    p.useHistory =          settings->value("UseHistory",           d.useHistory).toBool();
+    p.isParallel =          settings->value("IsParallel",           d.isParallel).toBool();
+
+    p.initializationFrames =    settings->value("InitializationFrames", d.initializationFrames).toInt();
+    p.decisionThreshold =       settings->value("DecisionThreshold",    d.decisionThreshold).toDouble();
+
+    p.motionCompensation =              settings->value("MotionCompensation",           d.motionCompensation).toBool();
+    p.nSamples =                        settings->value("NSamples",                     d.nSamples).toInt();
+    p.replaceRate =                     settings->value("ReplaceRate",                  d.replaceRate).toDouble();
+    p.propagationRate =                 settings->value("PropagationRate",              d.propagationRate).toDouble();
+    p.hitsThreshold =                   settings->value("HitsThreshold",                d.hitsThreshold).toInt();
+    p.alpha =                           settings->value("Alpha",                        d.alpha).toDouble();
+    p.beta =                            settings->value("Beta",                         d.beta).toDouble();
+    p.blinkingSupressionDecay =         settings->value("BlinkingSupressionDecay",      d.blinkingSupressionDecay).toDouble();
+    p.blinkingSupressionMultiplier =    settings->value("BlinkingSupressionMultiplier", d.blinkingSupressionMultiplier).toDouble();
+    p.noiseRemovalThresholdFacBG =      settings->value("NoiseRemovalThresholdFacBG",   d.noiseRemovalThresholdFacBG).toDouble();
+    p.noiseRemovalThresholdFacFG =      settings->value("NoiseRemovalThresholdFacFG",   d.noiseRemovalThresholdFacFG).toDouble();
+
+    p.LSBPRadius =      settings->value("LSBPRadius",       d.LSBPRadius).toInt();
+    p.Tlower =          settings->value("Tlower",           d.Tlower).toDouble();
+    p.Tupper =          settings->value("Tupper",           d.Tupper).toDouble();
+    p.Tinc =            settings->value("Tinc",             d.Tinc).toDouble();
+    p.Tdec =            settings->value("Tdec",             d.Tdec).toDouble();
+    p.Rscale =          settings->value("Rscale",           d.Rscale).toDouble();
+    p.Rincdec =         settings->value("Rincdec",          d.Rincdec).toDouble();
+    p.LSBPthreshold =   settings->value("LSBPthreshold",    d.LSBPthreshold).toInt();
+    p.minCount =        settings->value("MinCount",         d.minCount).toInt();
+
+    p.nmixtures =       settings->value("Nmixtures",        d.nmixtures).toInt();
+    p.backgroundRatio = settings->value("BackgroundRatio",  d.backgroundRatio).toDouble();
+    p.noiseSigma =      settings->value("NoiseSigma",       d.noiseSigma).toDouble();
+
+    p.halfPrecision =   settings->value("HalfPrecision",    d.halfPrecision).toBool();
+
+    p.continuousModel = settings->value("ContinuousModel",  d.continuousModel).toBool();
+    return p;
+}
+
+void writeBackgroundSubtractorParams(QSettings *settings, const BackgroundSubtractorParams &p)
+{
+    settings->setValue("algorithm", p.algo);
+    settings->setValue("History", p.history);
+    settings->setValue("Threshold", p.threshold);
+    settings->setValue("DetectShadows", p.detectShadows);
+
+    settings->setValue("MinPixelStability", p.minPixelStability);
+    settings->setValue("MaxPixelStability", p.maxPixelStability);
+    settings->setValue("UseHistory", p.useHistory);
+    settings->setValue("IsParallel", p.isParallel);
+
+    settings->setValue("InitializationFrames", p.initializationFrames);
+    settings->setValue("DecisionThreshold", p.decisionThreshold);
+
+    settings->setValue("MotionCompensation", p.motionCompensation);
+    settings->setValue("NSamples", p.nSamples);
+    settings->setValue("ReplaceRate", p.replaceRate);
+    settings->setValue("PropagationRate", p.propagationRate);
+    settings->setValue("HitsThreshold", p.hitsThreshold);
+    settings->setValue("Alpha", p.alpha);
+    settings->setValue("Beta", p.beta);
+    settings->setValue("BlinkingSupressionDecay", p.blinkingSupressionDecay);
+    settings->setValue("BlinkingSupressionMultiplier", p.blinkingSupressionMultiplier);
+    settings->setValue("NoiseRemovalThresholdFacBG", p.noiseRemovalThresholdFacBG);
+    settings->setValue("NoiseRemovalThresholdFacFG", p.noiseRemovalThresholdFacFG);
+
+    settings->setValue("LSBPRadius", p.LSBPRadius);
+    settings->setValue("Tlower", p.Tlower);
+    settings->setValue("Tupper", p.Tupper);
+    settings->setValue("Tinc", p.Tinc);
+    settings->setValue("Tdec", p.Tdec);
+    settings->setValue("Rscale", p.Rscale);
+    settings->setValue("Rincdec", p.Rincdec);
+    settings->setValue("LSBPthreshold", p.LSBPthreshold);
+    settings->setValue("MinCount", p.minCount);
+
+    settings->setValue("Nmixtures", p.nmixtures);
+    settings->setValue("BackgroundRatio", p.backgroundRatio);
+    settings->setValue("NoiseSigma", p.noiseSigma);
+
+    settings->setValue("HalfPrecision", p.halfPrecision);
+    settings->setValue("ContinuousModel", p.continuousModel);
+}
+
+MorphologyParams readMorphologyParams(QSettings *settings)
+{
+    MorphologyParams d;
+    MorphologyParams p;
+    p.binarize =    settings->value("Binarize",     d.binarize).toBool();
+    p.open =        settings->value("Open",         d.open).toBool();
+    p.close =       settings->value("Close",        d.close).toBool();
+    p.fillHoles =   settings->value("FillHoles",    d.fillHoles).toBool();
+    p.shape = (MorphShape)(settings->value("Shape", d.shape).toInt());
+    p.width =       settings->value("Width",        d.width).toInt();
+    p.height =      settings->value("Height",       d.height).toInt();
+    return p;
+}
+
+void writeMorphologyParams(QSettings *settings, const MorphologyParams &p)
+{
+    settings->setValue("Binarize", p.binarize);
+    settings->setValue("Open", p.open);
+    settings->setValue("Close", p.close);
+    settings->setValue("FillHoles", p.fillHoles);
+    settings->setValue("Shape", p.shape);
+    settings->setValue("Width", p.width);
+    settings->setValue("Height", p.height);
+}
+
+PlateTracker::Params readPlateTrackerParams(QSettings *settings)
+{
+    PlateTracker::Params d;
+    PlateTracker::Params p;
+    p.revalidateEvery =     settings->value("RevalidateEvery",      d.revalidateEvery).toInt();
+    p.changeThreshold =     settings->value("ChangeThreshold",      d.changeThreshold).toInt();
+    p.downscale =           settings->value("Downscale",            d.downscale).toInt();
+    p.regionMargin =        settings->value("RegionMargin",         d.regionMargin).toInt();
+    p.maxRegionFraction =   settings->value("MaxRegionFraction",    d.maxRegionFraction).toDouble();
+    p.minArea =             settings->value("MinArea",              d.minArea).toInt();
+    p.matchOverlap =        settings->value("MatchOverlap",         d.matchOverlap).toDouble();
+    p.maxMisses =           settings->value("MaxMisses",            d.maxMisses).toInt();
+    return p;
+}
+
+void writePlateTrackerParams(QSettings *settings, const PlateTracker::Params &p)
+{
+    settings->setValue("RevalidateEvery", p.revalidateEvery);
+    settings->setValue("ChangeThreshold", p.changeThreshold);
+    settings->setValue("Downscale", p.downscale);
+    settings->setValue("RegionMargin", p.regionMargin);
+    settings->setValue("MaxRegionFraction", p.maxRegionFraction);
+    settings->setValue("MinArea", p.minArea);
+    settings->setValue("MatchOverlap", p.matchOverlap);
+    settings->setValue("MaxMisses", p.maxMisses);
+}
+
+OpencvKernels::ClaheParams readClaheParams(QSettings *settings)
+{
+    OpencvKernels::ClaheParams d;
+    OpencvKernels::ClaheParams p;
+    p.clipLimit =   settings->value("ClipLimit", d.clipLimit).toDouble();
+    p.tilesX =      settings->value("TilesX",    d.tilesX).toInt();
+    p.tilesY =      settings->value("TilesY",    d.tilesY).toInt();
+    return p;
+}
+
+void writeClaheParams(QSettings *settings, const OpencvKernels::ClaheParams &p)
+{
+    settings->setValue("ClipLimit", p.clipLimit);
+    settings->setValue("TilesX", p.tilesX);
+    settings->setValue("TilesY", p.tilesY);
+}
+
+MotionGate::Params readMotionGateParams(QSettings *settings)
+{
+    MotionGate::Params d;
+    MotionGate::Params p;
+    p.downscale =           settings->value("Downscale",        d.downscale).toInt();
+    p.pixelThreshold =      settings->value("PixelThreshold",   d.pixelThreshold).toInt();
+    p.activateFraction =    settings->value("ActivateFraction", d.activateFraction).toDouble();
+    p.releaseFraction =     settings->value("ReleaseFraction",  d.releaseFraction).toDouble();
+    p.holdFrames =          settings->value("HoldFrames",       d.holdFrames).toInt();
+    p.feedEvery =           settings->value("FeedEvery",        d.feedEvery).toInt();
+    return p;
+}
+
+void writeMotionGateParams(QSettings *settings, const MotionGate::Params &p)
+{
+    settings->setValue("Downscale", p.downscale);
+    settings->setValue("PixelThreshold", p.pixelThreshold);
+    settings->setValue("ActivateFraction", p.activateFraction);
+    settings->setValue("ReleaseFraction", p.releaseFraction);
+    settings->setValue("HoldFrames", p.holdFrames);
+    settings->setValue("FeedEvery", p.feedEvery);
+}
+
+ToolParams::ToolParams() :
+    claheEnabled(true),
+    channelsEnabled(true),
+    subtractorEnabled(true),
+    morphologyEnabled(true)
+{
+}
+
+ToolParams readToolParams(QSettings *settings)
+{
+    ToolParams p;
+    settings->beginGroup(ClaheGroup);
+    p.claheEnabled = readToolEnabled(settings);
+    p.clahe = readClaheParams(settings);
+    settings->endGroup();
+    settings->beginGroup(SeparateChannelsGroup);
+    p.channelsEnabled = readToolEnabled(settings);
+    if (p.channelsEnabled)
+        p.channels = readSeparateChannelsParams(settings);
+    settings->endGroup();
+    settings->beginGroup(BackgroundSubtractorGroup);
+    p.subtractorEnabled = readToolEnabled(settings);
+    p.subtractor = readBackgroundSubtractorParams(settings);
+    if (backgroundAlgoNeedsColor(p.subtractor.algo))
+        p.channels.channel = -1;
+    p.backgroundImage = settings->value("BackgroundImage").toString().toStdString();
+    settings->endGroup();
+    settings->beginGroup(MorphologyGroup);
+    p.morphologyEnabled = readToolEnabled(settings);
+    p.morphology = readMorphologyParams(settings);
+    settings->endGroup();
+    settings->beginGroup(PlateTrackerGroup);
+    p.tracker = readPlateTrackerParams(settings);
+    settings->endGroup();
+    settings->beginGroup(MotionGateGroup);
+    p.gate = readMotionGateParams(settings);
+    settings->endGroup();
+    return p;
+}
+
+LatencyGovernor::Params readLatencyGovernorParams(QSettings *settings)
+{
+    LatencyGovernor::Params d;
+    LatencyGovernor::Params p;
+    p.enabled =             settings->value("Enabled",          d.enabled).toBool();
+    p.deadlineMs =          settings->value("DeadlineMs",       d.deadlineMs).toDouble();
+    p.riskFraction =        settings->value("RiskFraction",     d.riskFraction).toDouble();
+    p.headroomFraction =    settings->value("HeadroomFraction", d.headroomFraction).toDouble();
+    p.stepUpAfter =         settings->value("StepUpAfter",      d.stepUpAfter).toInt();
+    p.settleFrames =        settings->value("SettleFrames",     d.settleFrames).toInt();
+    p.smoothing =           settings->value("Smoothing",        d.smoothing).toDouble();
+    p.maxLevel =            settings->value("MaxLevel",         d.maxLevel).toInt();
+    return p;
+}
+
+void writeLatencyGovernorParams(QSettings *settings, const LatencyGovernor::Params &p)
+{
+    settings->setValue("Enabled", p.enabled);
+    settings->setValue("DeadlineMs", p.deadlineMs);
+    settings->setValue("RiskFraction", p.riskFraction);
+    settings->setValue("HeadroomFraction", p.headroomFraction);
+    settings->setValue("StepUpAfter", p.stepUpAfter);
+    settings->setValue("SettleFrames", p.settleFrames);
+    settings->setValue("Smoothing", p.smoothing);
+    settings->setValue("MaxLevel", p.maxLevel);
+}
+
+int readMetricsPort(QSettings *settings)
+{
+    return settings->value("Port", 0).toInt();
+}
+
+void writeMetricsPort(QSettings *settings, int port)
+{
+    settings->setValue("Port", port);
+}
+
+QString readTraceFile(QSettings *settings)
+{
+    return settings->value("File").toString();
+}
+
+void writeTraceFile(QSettings *settings, const QString &path)
+{
+    settings->setValue("File", path);
+}
+
+bool readMemoryAccounting(QSettings *settings)
+{
+    return settings->value("Accounting", false).toBool();
+}
+
+void writeMemoryAccounting(QSettings *settings, bool enabled)
+{
+    settings->setValue("Accounting", enabled);
+}
+
+FrameArenaAllocator::Params readFrameArenaParams(QSettings *settings)
+{
+    FrameArenaAllocator::Params d;
+    FrameArenaAllocator::Params p;
+    p.enabled =         settings->value("Enabled",      d.enabled).toBool();
+    p.sizeMB =          settings->value("SizeMB",       d.sizeMB).toInt();
+    p.minBufferKB =     settings->value("MinBufferKB",  d.minBufferKB).toInt();
+    p.hugePages =       settings->value("HugePages",    d.hugePages).toBool();
+    return p;
+}
+
+void writeFrameArenaParams(QSettings *settings, const FrameArenaAllocator::Params &p)
+{
+    settings->setValue("Enabled", p.enabled);
+    settings->setValue("SizeMB", p.sizeMB);
+    settings->setValue("MinBufferKB", p.minBufferKB);
+    settings->setValue("HugePages", p.hugePages);
+}
+
+QString readStreamCores(QSettings *settings, int stream)
+{
+    // an unquoted list like 0-3,8 comes back split at the commas
+    return settings->value(QString("Stream%1").arg(stream)).toStringList().join(',');
+}
+
+void writeStreamCores(QSettings *settings, int stream, const QString &cores)
+{
+    settings->setValue(QString("Stream%1").arg(stream), cores);
+}
+
+QString readDetectionLogFile(QSettings *settings)
+{
+    return settings->value("File").toString();
+}
+
+void writeDetectionLogFile(QSettings *settings, const QString &path)
+{
+    settings->setValue("File", path);
+}
+
+ShmRing::Params readOutputRingParams(QSettings *settings)
+{
+    ShmRing::Params d;
+    ShmRing::Params p;
+    p.name =            settings->value("Name",     QString::fromStdString(d.name)).toString().toStdString();
+    p.slots =           settings->value("Slots",    d.slots).toInt();
+    p.slotKB =          settings->value("SlotKB",   d.slotKB).toInt();
+    return p;
+}
+
+void writeOutputRingParams(QSettings *settings, const ShmRing::Params &p)
+{
+    settings->setValue("Name", QString::fromStdString(p.name));
+    settings->setValue("Slots", p.slots);
+    settings->setValue("SlotKB", p.slotKB);
+}
+
+} // namespace PipelineSettings
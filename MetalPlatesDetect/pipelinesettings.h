@@ -0,0 +1,112 @@
+#ifndef PIPELINESETTINGS_H
+#define PIPELINESETTINGS_H
+
+#include "opencvkernels.h"
+#include "fastmorphology.h"
+#include "labclahe.h"
+#include "platetracker.h"
+#include "motiongate.h"
+#include "latencygovernor.h"
+#include "framearena.h"
+#include "shmring.h"
+#include <string>
+
+class QSettings;
+class QString;
+
+// config.ini layout shared by the tool widgets and the headless path.
+// The read/write functions work on the current settings group.
+namespace PipelineSettings {
+
+extern const char * const SeparateChannelsGroup;
+extern const char * const BackgroundSubtractorGroup;
+extern const char * const MorphologyGroup;
+extern const char * const ClaheGroup;
+extern const char * const PlateTrackerGroup;
+extern const char * const MotionGateGroup;
+extern const char * const LatencyGovernorGroup;
+extern const char * const MetricsGroup;
+extern const char * const TracingGroup;
+extern const char * const MemoryGroup;
+extern const char * const FrameArenaGroup;
+extern const char * const AffinityGroup;
+extern const char * const DetectionLogGroup;
+extern const char * const OutputRingGroup;
+
+// the On/Off state of the tool whose group is current
+bool readToolEnabled(QSettings *settings);
+void writeToolEnabled(QSettings *settings, bool enabled);
+
+OpencvKernels::SeparateChannelsParams readSeparateChannelsParams(QSettings *settings);
+void writeSeparateChannelsParams(QSettings *settings, const OpencvKernels::SeparateChannelsParams &params);
+
+OpencvKernels::BackgroundSubtractorParams readBackgroundSubtractorParams(QSettings *settings);
+void writeBackgroundSubtractorParams(QSettings *settings, const OpencvKernels::BackgroundSubtractorParams &params);
+
+OpencvKernels::MorphologyParams readMorphologyParams(QSettings *settings);
+void writeMorphologyParams(QSettings *settings, const OpencvKernels::MorphologyParams &params);
+
+PlateTracker::Params readPlateTrackerParams(QSettings *settings);
+void writePlateTrackerParams(QSettings *settings, const PlateTracker::Params &params);
+
+OpencvKernels::ClaheParams readClaheParams(QSettings *settings);
+void writeClaheParams(QSettings *settings, const OpencvKernels::ClaheParams &params);
+
+MotionGate::Params readMotionGateParams(QSettings *settings);
+void writeMotionGateParams(QSettings *settings, const MotionGate::Params &params);
+
+// the tools of the production path, as the headless path runs them;
+// with the Separate Channels tool off the channels forward all planes, in front of
+// a subtractor that models colour frames they keep all planes of the mode as the plan does
+struct ToolParams {
+    ToolParams();
+
+    bool                                        claheEnabled;
+    bool                                        channelsEnabled;
+    bool                                        subtractorEnabled;
+    bool                                        morphologyEnabled;
+    OpencvKernels::ClaheParams                  clahe;
+    OpencvKernels::SeparateChannelsParams       channels;
+    OpencvKernels::BackgroundSubtractorParams   subtractor;
+    OpencvKernels::MorphologyParams             morphology;
+    PlateTracker::Params                        tracker;
+    MotionGate::Params                          gate;
+    std::string                                 backgroundImage;
+};
+
+// unlike the other functions enters the tool groups itself
+ToolParams readToolParams(QSettings *settings);
+
+LatencyGovernor::Params readLatencyGovernorParams(QSettings *settings);
+void writeLatencyGovernorParams(QSettings *settings, const LatencyGovernor::Params &params);
+
+// local port of the metrics server, 0 disables it
+int readMetricsPort(QSettings *settings);
+void writeMetricsPort(QSettings *settings, int port);
+
+// Chrome trace written when the program ends, empty disables tracing
+QString readTraceFile(QSettings *settings);
+void writeTraceFile(QSettings *settings, const QString &path);
+
+// count cv::Mat memory per stage, takes effect at start
+bool readMemoryAccounting(QSettings *settings);
+void writeMemoryAccounting(QSettings *settings, bool enabled);
+
+// takes effect at start
+FrameArenaAllocator::Params readFrameArenaParams(QSettings *settings);
+void writeFrameArenaParams(QSettings *settings, const FrameArenaAllocator::Params &params);
+
+// cores a camera stream is pinned to, like "0-3,8"; empty leaves it to the scheduler
+QString readStreamCores(QSettings *settings, int stream);
+void writeStreamCores(QSettings *settings, int stream, const QString &cores);
+
+// binary log every detection is appended to, empty disables it
+QString readDetectionLogFile(QSettings *settings);
+void writeDetectionLogFile(QSettings *settings, const QString &path);
+
+ShmRing::Params readOutputRingParams(QSettings *settings);
+void writeOutputRingParams(QSettings *settings, const ShmRing::Params &params);
+
+} // namespace PipelineSettings
+
+#endif // PIPELINESETTINGS_H
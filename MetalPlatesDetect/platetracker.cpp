@@ -0,0 +1,190 @@
+#include "platetracker.h"
+#include "tracing.h"
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+
+using namespace OpencvKernels;
+
+PlateTracker::Params::Params() :
+    revalidateEvery(30),
+    changeThreshold(25),
+    downscale(4),
+    regionMargin(16),
+    maxRegionFraction(0.5),
+    minArea(500),
+    matchOverlap(0.3),
+    maxMisses(3)
+{
+}
+
+PlateTracker::PlateTracker() :
+    fSinceFull(0),
+    fNextId(1)
+{
+}
+
+void PlateTracker::setParams(const Params &params)
+{
+    fParams = params;
+    reset();
+}
+
+void PlateTracker::reset()
+{
+    fReference.release();
+    fFrameSize = cv::Size();
+    fSinceFull = 0;
+    fTracks.clear();
+}
+
+void PlateTracker::shrink(const cv::Mat &frame, cv::Mat &small) const
+{
+    cv::Mat gray;
+    if (frame.channels() == 3)
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    else if (frame.channels() == 4)
+        cv::cvtColor(frame, gray, cv::COLOR_BGRA2GRAY);
+    else
+        gray = frame;
+    int downscale = std::max(fParams.downscale, 1);
+    cv::Size size(std::max(frame.cols / downscale, 1), std::max(frame.rows / downscale, 1));
+    cv::resize(gray, small, size, 0, 0, cv::INTER_AREA);
+}
+
+static double overlap(const cv::Rect &a, const cv::Rect &b)
+{
+    double inter = (a & b).area();
+    double uni = a.area() + b.area() - inter;
+    return uni > 0 ? inter / uni : 0;
+}
+
+FrameAction PlateTracker::planFrame(const cv::Mat &frame, std::vector<cv::Rect> *regions)
+{
+    TRACE_SPAN("PlateTracker::planFrame");
+    regions->clear();
+    shrink(frame, fSmall);
+
+    bool full = fReference.empty() || frame.size() != fFrameSize || fSinceFull + 1 >= fParams.revalidateEvery;
+    if (!full) {
+        cv::Mat diff;
+        cv::absdiff(fSmall, fReference, diff);
+        cv::threshold(diff, diff, fParams.changeThreshold, 255, cv::THRESH_BINARY);
+        if (!cv::countNonZero(diff)) {
+            fSinceFull++;
+            fStats.skipped++;
+            return frameSkipUpstream;
+        }
+
+        cv::Mat labels, blobs, centroids;
+        int count = cv::connectedComponentsWithStats(diff, labels, blobs, centroids, 8, CV_32S);
+        double sx = double(frame.cols) / fSmall.cols;
+        double sy = double(frame.rows) / fSmall.rows;
+        cv::Rect frameRect(0, 0, frame.cols, frame.rows);
+        for (int i = 1; i < count; i++) {
+            int x = blobs.at<int>(i, cv::CC_STAT_LEFT);
+            int y = blobs.at<int>(i, cv::CC_STAT_TOP);
+            int w = blobs.at<int>(i, cv::CC_STAT_WIDTH);
+            int h = blobs.at<int>(i, cv::CC_STAT_HEIGHT);
+            cv::Rect r(int(x * sx) - fParams.regionMargin, int(y * sy) - fParams.regionMargin,
+                       int(w * sx + 1) + 2 * fParams.regionMargin, int(h * sy + 1) + 2 * fParams.regionMargin);
+            regions->push_back(r & frameRect);
+        }
+
+        // merge overlapping regions so no pixel is processed twice
+        for (bool merged = true; merged; ) {
+            merged = false;
+            for (size_t i = 0; i < regions->size() && !merged; i++) {
+                for (size_t j = i + 1; j < regions->size(); j++) {
+                    if (((*regions)[i] & (*regions)[j]).area()) {
+                        (*regions)[i] |= (*regions)[j];
+                        regions->erase(regions->begin() + j);
+                        merged = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        double area = 0;
+        for (size_t i = 0; i < regions->size(); i++)
+            area += (*regions)[i].area();
+        if (area <= fParams.maxRegionFraction * frameRect.area()) {
+            // the regions are processed now, later frames are compared to this content
+            for (size_t i = 0; i < regions->size(); i++) {
+                const cv::Rect &r = (*regions)[i];
+                cv::Rect small(int(r.x / sx), int(r.y / sy), int(r.width / sx), int(r.height / sy));
+                small &= cv::Rect(0, 0, fSmall.cols, fSmall.rows);
+                fSmall(small).copyTo(fReference(small));
+            }
+            fSinceFull++;
+            fStats.regions++;
+            return frameRunRegions;
+        }
+        regions->clear();
+    }
+
+    cv::swap(fReference, fSmall);
+    fFrameSize = frame.size();
+    fSinceFull = 0;
+    fStats.full++;
+    return frameRunFull;
+}
+
+void PlateTracker::update(const cv::Mat &mask)
+{
+    TRACE_SPAN("PlateTracker::update");
+    if (mask.empty() || mask.type() != CV_8UC1)
+        return;
+
+    cv::Mat binary, labels, blobs, centroids;
+    cv::threshold(mask, binary, 127, 255, cv::THRESH_BINARY);
+    int count = cv::connectedComponentsWithStats(binary, labels, blobs, centroids, 8, CV_32S);
+
+    std::vector<bool> matched(fTracks.size(), false);
+    std::vector<Track> born;
+    for (int i = 1; i < count; i++) {
+        int area = blobs.at<int>(i, cv::CC_STAT_AREA);
+        if (area < fParams.minArea)
+            continue;
+        cv::Rect box(blobs.at<int>(i, cv::CC_STAT_LEFT), blobs.at<int>(i, cv::CC_STAT_TOP),
+                     blobs.at<int>(i, cv::CC_STAT_WIDTH), blobs.at<int>(i, cv::CC_STAT_HEIGHT));
+
+        int best = -1;
+        double bestOverlap = fParams.matchOverlap;
+        for (size_t t = 0; t < fTracks.size(); t++) {
+            double o = overlap(fTracks[t].box, box);
+            if (!matched[t] && o >= bestOverlap) {
+                best = int(t);
+                bestOverlap = o;
+            }
+        }
+        if (best >= 0) {
+            Track &track = fTracks[best];
+            track.box = box;
+            track.area = area;
+            track.age++;
+            track.misses = 0;
+            matched[best] = true;
+        }
+        else {
+            Track track;
+            track.id = fNextId++;
+            track.box = box;
+            track.area = area;
+            track.age = 1;
+            track.misses = 0;
+            born.push_back(track);
+        }
+    }
+
+    std::vector<Track> alive;
+    for (size_t t = 0; t < fTracks.size(); t++) {
+        Track track = fTracks[t];
+        if (!matched[t] && ++track.misses > fParams.maxMisses)
+            continue;
+        alive.push_back(track);
+    }
+    alive.insert(alive.end(), born.begin(), born.end());
+    fTracks.swap(alive);
+}
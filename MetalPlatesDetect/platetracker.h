@@ -0,0 +1,69 @@
+#ifndef PLATETRACKER_H
+#define PLATETRACKER_H
+
+#include "opencvkernels.h"
+#include <cstdint>
+#include <vector>
+
+// Follows plates across frames and decides how much of the next frame has
+// to go through the expensive stages: nothing when the frame did not change
+// since the last processed one, only the changed regions when they are
+// small, the whole frame every revalidateEvery frames or on big changes.
+class PlateTracker
+{
+public:
+    struct Params {
+        Params();
+
+        int     revalidateEvery;    // frames between forced full detections
+        int     changeThreshold;    // gray level difference counted as change
+        int     downscale;          // change detection runs on a frame this many times smaller
+        int     regionMargin;       // pixels added around changed regions
+        double  maxRegionFraction;  // above this share of the frame the whole frame is processed
+        int     minArea;            // smallest blob reported as plate
+        double  matchOverlap;       // IoU needed to continue a track
+        int     maxMisses;          // frames a track survives without a detection
+    };
+
+    struct Track {
+        int         id;
+        cv::Rect    box;
+        int         area;
+        int         age;
+        int         misses;
+    };
+
+    struct Stats {
+        Stats() : full(0), regions(0), skipped(0) {}
+        uint64_t full;
+        uint64_t regions;
+        uint64_t skipped;
+    };
+
+    PlateTracker();
+
+    void setParams(const Params &params);
+    const Params &params() const { return fParams; }
+    void reset();
+
+    OpencvKernels::FrameAction planFrame(const cv::Mat &frame, std::vector<cv::Rect> *regions);
+    // feed the mask produced for the frame passed to the last planFrame()
+    void update(const cv::Mat &mask);
+
+    const std::vector<Track> &tracks() const { return fTracks; }
+    const Stats &stats() const { return fStats; }
+
+private:
+    Params fParams;
+    cv::Mat fReference;
+    cv::Mat fSmall;
+    cv::Size fFrameSize;
+    int fSinceFull;
+    int fNextId;
+    std::vector<Track> fTracks;
+    Stats fStats;
+
+    void shrink(const cv::Mat &frame, cv::Mat &small) const;
+};
+
+#endif // PLATETRACKER_H
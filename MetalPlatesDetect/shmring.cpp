@@ -0,0 +1,290 @@
+#include "shmring.h"
+
+#include <atomic>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ShmRing {
+
+namespace {
+
+const char magic[8] = { 'M', 'P', 'S', 'H', 'R', 'I', 'N', 'G' };
+const uint32_t version = 1;
+const size_t cacheLine = 64;
+
+// the producer and the readers are different processes, the atomics must not need a lock
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "64-bit atomics are not lock-free");
+
+struct RingHeader {
+    char                    magic[8];
+    uint32_t                version;
+    uint32_t                slots;
+    uint64_t                slotSize;   // slot header and payload
+    std::atomic<uint64_t>   next;       // sequence of the next item to be published
+};
+
+// state is 2 * sequence + 1 while the item is written, 2 * sequence + 2 when it is complete
+struct SlotHeader {
+    std::atomic<uint64_t>   state;
+    ItemHeader              item;
+};
+
+static_assert(sizeof(RingHeader) <= cacheLine && sizeof(SlotHeader) <= cacheLine, "headers take one cache line");
+
+size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+const SlotHeader *slotAt(const uchar *base, const RingHeader *header, uint64_t sequence)
+{
+    return reinterpret_cast<const SlotHeader*>(base + cacheLine + sequence % header->slots * header->slotSize);
+}
+
+// The producer creates the segment with the size, replacing one of another
+// size; a reader maps what is there and gets its size back.
+uchar *mapSegment(const std::string &name, size_t &size, bool create, void *&handle)
+{
+    handle = nullptr;
+#ifdef _WIN32
+    std::string local = "Local\\" + (name[0] == '/' ? name.substr(1) : name);
+    HANDLE mapping = create ? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                                 DWORD(uint64_t(size) >> 32), DWORD(size), local.c_str())
+                            : OpenFileMappingA(FILE_MAP_READ, FALSE, local.c_str());
+    if (!mapping)
+        return nullptr;
+    void *p = MapViewOfFile(mapping, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, create ? size : 0);
+    if (!p) {
+        CloseHandle(mapping);
+        return nullptr;
+    }
+    if (!create) {
+        MEMORY_BASIC_INFORMATION info;
+        VirtualQuery(p, &info, sizeof(info));
+        size = info.RegionSize;
+    }
+    handle = mapping;
+    return static_cast<uchar*>(p);
+#else
+    int fd = shm_open(name.c_str(), create ? O_RDWR | O_CREAT : O_RDONLY, 0600);
+    if (fd < 0)
+        return nullptr;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return nullptr;
+    }
+    if (create && info.st_size != 0 && size_t(info.st_size) != size) {
+        // readers still mapping the old segment keep it until they reopen
+        close(fd);
+        shm_unlink(name.c_str());
+        fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+        if (fd < 0)
+            return nullptr;
+        info.st_size = 0;
+    }
+    if (create && info.st_size == 0 && ftruncate(fd, off_t(size)) != 0) {
+        close(fd);
+        return nullptr;
+    }
+    if (!create)
+        size = size_t(info.st_size);
+    void *p = size ? mmap(nullptr, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    return p == MAP_FAILED ? nullptr : static_cast<uchar*>(p);
+#endif
+}
+
+void unmapSegment(const uchar *base, size_t size, void *handle)
+{
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(base);
+    CloseHandle(handle);
+#else
+    (void)handle;
+    munmap(const_cast<uchar*>(base), size);
+#endif
+}
+
+}
+
+Params::Params() :
+    slots(8),
+    slotKB(8192)
+{
+}
+
+Producer::Producer() :
+    fBase(nullptr),
+    fSize(0),
+    fHandle(nullptr),
+    fPublished(0)
+{
+}
+
+bool Producer::open(const Params &params)
+{
+    close();
+    if (params.name.empty() || params.slots < 1 || params.slotKB < 1)
+        return false;
+    const uint64_t slotSize = cacheLine + alignUp(size_t(params.slotKB) << 10, cacheLine);
+    size_t size = cacheLine + size_t(slotSize * params.slots);
+    fBase = mapSegment(params.name, size, true, fHandle);
+    if (!fBase)
+        return false;
+    fSize = size;
+
+    RingHeader *header = reinterpret_cast<RingHeader*>(fBase);
+    if (memcmp(header->magic, magic, sizeof(magic)) != 0 || header->version != version ||
+            header->slots != uint32_t(params.slots) || header->slotSize != slotSize) {
+        // readers of a ring with another geometry see the sequence start over
+        header->version = version;
+        header->slots = uint32_t(params.slots);
+        header->slotSize = slotSize;
+        for (int i = 0; i < params.slots; i++)
+            const_cast<SlotHeader*>(slotAt(fBase, header, uint64_t(i)))->state.store(0, std::memory_order_relaxed);
+        header->next.store(0, std::memory_order_release);
+        memcpy(header->magic, magic, sizeof(magic));
+    }
+    return true;
+}
+
+void Producer::close()
+{
+    if (!fBase)
+        return;
+    unmapSegment(fBase, fSize, fHandle);
+    fBase = nullptr;
+    fSize = 0;
+    fHandle = nullptr;
+}
+
+bool Producer::publish(PayloadType type, uint32_t stream, int64_t timeUs, const cv::Mat &mat)
+{
+    if (!fBase || mat.empty() || mat.dims > 2)
+        return false;
+    RingHeader *header = reinterpret_cast<RingHeader*>(fBase);
+    const size_t rowBytes = mat.cols * mat.elemSize();
+    const uint64_t size = uint64_t(rowBytes) * mat.rows;
+    if (size > header->slotSize - cacheLine)
+        return false;
+
+    const uint64_t sequence = header->next.load(std::memory_order_relaxed);
+    SlotHeader *slot = const_cast<SlotHeader*>(slotAt(fBase, header, sequence));
+    slot->state.store(2 * sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    ItemHeader &item = slot->item;
+    item.sequence = sequence;
+    item.timeUs = timeUs;
+    item.type = type;
+    item.stream = stream;
+    item.rows = mat.rows;
+    item.cols = mat.cols;
+    item.matType = mat.type();
+    item.step = uint32_t(rowBytes);
+    item.size = size;
+    cv::Mat pixels(mat.rows, mat.cols, mat.type(), reinterpret_cast<uchar*>(slot) + cacheLine, rowBytes);
+    mat.copyTo(pixels);
+
+    slot->state.store(2 * sequence + 2, std::memory_order_release);
+    header->next.store(sequence + 1, std::memory_order_release);
+    fPublished++;
+    return true;
+}
+
+Reader::Reader() :
+    fBase(nullptr),
+    fSize(0),
+    fHandle(nullptr),
+    fNext(0),
+    fSkipped(0)
+{
+}
+
+bool Reader::open(const std::string &name)
+{
+    close();
+    size_t size = 0;
+    const uchar *base = mapSegment(name, size, false, fHandle);
+    if (!base)
+        return false;
+    const RingHeader *header = reinterpret_cast<const RingHeader*>(base);
+    if (size < cacheLine || memcmp(header->magic, magic, sizeof(magic)) != 0 || header->version != version) {
+        unmapSegment(base, size, fHandle);
+        fHandle = nullptr;
+        return false;
+    }
+    fBase = base;
+    fSize = size;
+    fNext = header->next.load(std::memory_order_acquire);
+    fSkipped = 0;
+    return true;
+}
+
+void Reader::close()
+{
+    if (!fBase)
+        return;
+    unmapSegment(fBase, fSize, fHandle);
+    fBase = nullptr;
+    fSize = 0;
+    fHandle = nullptr;
+}
+
+bool Reader::next(Item &item)
+{
+    if (!fBase)
+        return false;
+    const RingHeader *header = reinterpret_cast<const RingHeader*>(fBase);
+    const uint64_t slots = header->slots;
+    const uint64_t slotSize = header->slotSize;
+    if (!slots || slotSize <= cacheLine || cacheLine + slots * slotSize > fSize)
+        return false;
+
+    const uint64_t end = header->next.load(std::memory_order_acquire);
+    if (fNext > end)
+        fNext = end;    // the producer started over
+    if (end - fNext > slots) {
+        fSkipped += end - slots - fNext;
+        fNext = end - slots;
+    }
+    for (; fNext < end; fNext++) {
+        const SlotHeader *slot = slotAt(fBase, header, fNext);
+        const uint64_t complete = 2 * fNext + 2;
+        if (slot->state.load(std::memory_order_acquire) == complete) {
+            memcpy(&item.header, &slot->item, sizeof(ItemHeader));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot->state.load(std::memory_order_relaxed) == complete && item.header.size <= slotSize - cacheLine) {
+                item.data = reinterpret_cast<const uchar*>(slot) + cacheLine;
+                fNext++;
+                return true;
+            }
+        }
+        // overwritten after end was read
+        fSkipped++;
+    }
+    return false;
+}
+
+bool Reader::isValid(const Item &item) const
+{
+    if (!fBase)
+        return false;
+    const RingHeader *header = reinterpret_cast<const RingHeader*>(fBase);
+    if (!header->slots || cacheLine + header->slots * header->slotSize > fSize)
+        return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slotAt(fBase, header, item.header.sequence)->state.load(std::memory_order_relaxed) == 2 * item.header.sequence + 2;
+}
+
+} // namespace ShmRing
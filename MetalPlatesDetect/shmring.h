@@ -0,0 +1,108 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <string>
+
+// Ring of frames and masks in POSIX shared memory (a named file mapping on
+// Windows) for local consumers such as the PLC bridge and the QA dashboard.
+// The producer writes the slots in turn and never waits for anybody: a
+// reader that falls behind by more than the ring finds its items
+// overwritten, skips ahead and counts what it lost. The sequence number of
+// every slot is odd while the producer writes it, so a reader using the
+// pixels in place can tell afterwards whether they were overwritten
+// meanwhile. Consumers only need this file, shmring.cpp and OpenCV core.
+namespace ShmRing {
+
+enum PayloadType {
+    payloadFrame = 1,
+    payloadMask = 2
+};
+
+struct Params {
+    Params();
+
+    std::string name;       // "/metalplates" style, empty disables the ring
+    int         slots;
+    int         slotKB;     // largest payload, larger ones are not published
+};
+
+// in front of the pixels of every published item
+struct ItemHeader {
+    uint64_t    sequence;
+    int64_t     timeUs;     // since the epoch
+    uint32_t    type;       // PayloadType
+    uint32_t    stream;
+    int32_t     rows;
+    int32_t     cols;
+    int32_t     matType;
+    uint32_t    step;
+    uint64_t    size;
+};
+
+class Producer
+{
+public:
+    Producer();
+    ~Producer() { close(); }
+
+    // creates the segment, or takes over the one of a previous run with the same geometry
+    bool open(const Params &params);
+    void close();
+    bool isOpen() const { return fBase != nullptr; }
+
+    // copies the pixels into the next slot, false when they do not fit
+    bool publish(PayloadType type, uint32_t stream, int64_t timeUs, const cv::Mat &mat);
+    uint64_t publishedCount() const { return fPublished; }
+
+private:
+    uchar *fBase;
+    size_t fSize;
+    void *fHandle;
+    uint64_t fPublished;
+
+    Producer(const Producer&);
+    Producer &operator=(const Producer&);
+};
+
+class Reader
+{
+public:
+    struct Item {
+        ItemHeader      header;
+        const uchar     *data;      // in the segment
+
+        // no copy, check isValid() after using it
+        cv::Mat mat() const { return cv::Mat(header.rows, header.cols, header.matType, const_cast<uchar*>(data), header.step); }
+    };
+
+    Reader();
+    ~Reader() { close(); }
+
+    // false while the producer has not created the ring; reading starts with the next item published
+    bool open(const std::string &name);
+    void close();
+    bool isOpen() const { return fBase != nullptr; }
+
+    // the next item in sequence order, false when there is none yet
+    bool next(Item &item);
+    // false once the producer started to overwrite the item
+    bool isValid(const Item &item) const;
+    // items overwritten before they were read
+    uint64_t skippedCount() const { return fSkipped; }
+
+private:
+    const uchar *fBase;
+    size_t fSize;
+    void *fHandle;
+    uint64_t fNext;
+    uint64_t fSkipped;
+
+    Reader(const Reader&);
+    Reader &operator=(const Reader&);
+};
+
+} // namespace ShmRing
+
+#endif // SHMRING_H
@@ -0,0 +1,347 @@
+#include "soamixture.h"
+#include "tracing.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace OpencvKernels {
+
+namespace {
+
+// the remaining constants of MOG2, with its defaults
+const float backgroundRatio = 0.9f;
+const float varThresholdGen = 9.f;
+const float varInit = 15.f;
+const float varMin = 4.f;
+const float varMax = 75.f;
+const float complexityReduction = 0.05f;
+const float shadowThreshold = 0.5f;
+const uchar shadowValue = 127;
+
+// Per-thread scratch for one row, every array is a run over x.
+struct RowScratch {
+    std::vector<float> weights;     // the row widened from half precision
+    std::vector<float> pix;         // channels * cols
+    std::vector<float> dist2;       // nmixtures * cols
+    std::vector<float> heavier;     // weight of the components ranked above, nmixtures * cols
+    std::vector<float> best;        // index of the matched component, -1 for none
+    std::vector<float> bestWeight;
+    std::vector<float> weakest;
+    std::vector<float> weakestWeight;
+    std::vector<float> active;      // number of components in use
+    std::vector<float> sum;
+    std::vector<uchar> background;
+    std::vector<uchar> shadow;
+
+    void resize(int cols, int channels, int nmixtures, bool half)
+    {
+        weights.resize(half ? size_t(nmixtures) * cols : 0);
+        pix.resize(size_t(channels) * cols);
+        dist2.resize(size_t(nmixtures) * cols);
+        heavier.resize(size_t(nmixtures) * cols);
+        best.resize(cols);
+        bestWeight.resize(cols);
+        weakest.resize(cols);
+        weakestWeight.resize(cols);
+        active.resize(cols);
+        sum.resize(cols);
+        background.resize(cols);
+        shadow.resize(cols);
+    }
+};
+
+// heavier[k] = total weight of the components that come before k in MOG2's weight order
+void rankWeights(const float *w, float *heavier, int K, int W)
+{
+    for (int k = 0; k < K; k++) {
+        const float *wk = w + k * W;
+        float *h = heavier + k * W;
+        std::fill(h, h + W, 0.f);
+        for (int j = 0; j < K; j++) {
+            if (j == k)
+                continue;
+            const float *wj = w + j * W;
+            if (j < k) {
+                for (int x = 0; x < W; x++)
+                    h[x] += wj[x] >= wk[x] ? wj[x] : 0.f;
+            }
+            else {
+                for (int x = 0; x < W; x++)
+                    h[x] += wj[x] > wk[x] ? wj[x] : 0.f;
+            }
+        }
+    }
+}
+
+void updateRow(const uchar *src, uchar *mask, float *weight, float *state, int W, int C, int K,
+               float alpha, float varThreshold, bool detectShadows, RowScratch &s)
+{
+    float *variance = state;
+    float *mean = state + K * W;
+    const float alpha1 = 1.f - alpha;
+    const float prune = -alpha * complexityReduction;
+
+    for (int c = 0; c < C; c++) {
+        float *p = &s.pix[c * W];
+        for (int x = 0; x < W; x++)
+            p[x] = src[x * C + c];
+    }
+
+    // squared distances to every component
+    for (int k = 0; k < K; k++) {
+        float *d = &s.dist2[k * W];
+        std::fill(d, d + W, 0.f);
+        for (int c = 0; c < C; c++) {
+            const float *m = mean + (k * C + c) * W;
+            const float *p = &s.pix[c * W];
+            for (int x = 0; x < W; x++) {
+                float diff = p[x] - m[x];
+                d[x] += diff * diff;
+            }
+        }
+    }
+
+    // decay, then the heaviest component within the generation threshold matches
+    std::fill(s.best.begin(), s.best.end(), -1.f);
+    std::fill(s.bestWeight.begin(), s.bestWeight.end(), 0.f);
+    for (int k = 0; k < K; k++) {
+        float *w = weight + k * W;
+        const float *v = variance + k * W;
+        const float *d = &s.dist2[k * W];
+        float *best = s.best.data();
+        float *bestWeight = s.bestWeight.data();
+        for (int x = 0; x < W; x++) {
+            bool used = w[x] > 0.f;
+            w[x] = used ? alpha1 * w[x] + prune : 0.f;
+            bool match = used && d[x] < varThresholdGen * v[x] && w[x] > bestWeight[x];
+            best[x] = match ? float(k) : best[x];
+            bestWeight[x] = match ? w[x] : bestWeight[x];
+        }
+    }
+
+    // background when a component up to the matched one is within the background part and the threshold
+    rankWeights(weight, s.heavier.data(), K, W);
+    std::fill(s.background.begin(), s.background.end(), 0);
+    for (int k = 0; k < K; k++) {
+        const float *w = weight + k * W;
+        const float *v = variance + k * W;
+        const float *d = &s.dist2[k * W];
+        const float *h = &s.heavier[k * W];
+        const float *best = s.best.data();
+        const float *bestWeight = s.bestWeight.data();
+        uchar *bg = s.background.data();
+        for (int x = 0; x < W; x++) {
+            bool upToMatch = best[x] < 0.f || w[x] > bestWeight[x] || best[x] == float(k);
+            bool fits = w[x] > 0.f && upToMatch && h[x] < backgroundRatio && d[x] < varThreshold * v[x];
+            bg[x] |= uchar(fits);
+        }
+    }
+
+    // the matched component learns, components below the pruning level are dropped
+    std::fill(s.sum.begin(), s.sum.end(), 0.f);
+    std::fill(s.active.begin(), s.active.end(), 0.f);
+    for (int k = 0; k < K; k++) {
+        float *w = weight + k * W;
+        float *v = variance + k * W;
+        const float *d = &s.dist2[k * W];
+        const float *best = s.best.data();
+        float *sum = s.sum.data();
+        float *active = s.active.data();
+        for (int x = 0; x < W; x++) {
+            bool matched = best[x] == float(k);
+            float wk = w[x] + (matched ? alpha : 0.f);
+            wk = wk < -prune ? 0.f : wk;
+            w[x] = wk;
+            float rate = matched ? alpha / wk : 0.f;
+            float vk = v[x] + rate * (d[x] - v[x]);
+            v[x] = std::min(std::max(vk, varMin), varMax);
+            sum[x] += wk;
+            active[x] += wk > 0.f ? 1.f : 0.f;
+        }
+        for (int c = 0; c < C; c++) {
+            float *m = mean + (k * C + c) * W;
+            const float *p = &s.pix[c * W];
+            for (int x = 0; x < W; x++) {
+                float rate = best[x] == float(k) ? alpha / std::max(w[x], 1e-5f) : 0.f;
+                m[x] += rate * (p[x] - m[x]);
+            }
+        }
+    }
+
+    // normalize, then unmatched pixels replace their weakest component with a new one
+    std::fill(s.weakest.begin(), s.weakest.end(), 0.f);
+    std::fill(s.weakestWeight.begin(), s.weakestWeight.end(), 2.f);
+    for (int k = 0; k < K; k++) {
+        float *w = weight + k * W;
+        const float *sum = s.sum.data();
+        float *weakest = s.weakest.data();
+        float *weakestWeight = s.weakestWeight.data();
+        for (int x = 0; x < W; x++) {
+            w[x] = sum[x] > 0.f ? w[x] / sum[x] : 0.f;
+            bool weaker = w[x] < weakestWeight[x];
+            weakest[x] = weaker ? float(k) : weakest[x];
+            weakestWeight[x] = weaker ? w[x] : weakestWeight[x];
+        }
+    }
+    for (int k = 0; k < K; k++) {
+        float *w = weight + k * W;
+        float *v = variance + k * W;
+        const float *best = s.best.data();
+        const float *weakest = s.weakest.data();
+        const float *active = s.active.data();
+        for (int x = 0; x < W; x++) {
+            bool unmatched = best[x] < 0.f;
+            bool replaced = unmatched && weakest[x] == float(k);
+            bool alone = active[x] == 0.f || (active[x] == 1.f && w[x] > 0.f && replaced);
+            float fresh = alone ? 1.f : alpha;
+            w[x] = replaced ? fresh : (unmatched ? w[x] * alpha1 : w[x]);
+            v[x] = replaced ? varInit : v[x];
+        }
+        for (int c = 0; c < C; c++) {
+            float *m = mean + (k * C + c) * W;
+            const float *p = &s.pix[c * W];
+            for (int x = 0; x < W; x++)
+                m[x] = (best[x] < 0.f && weakest[x] == float(k)) ? p[x] : m[x];
+        }
+    }
+
+    // shadows: a darker version of one of the background components
+    std::fill(s.shadow.begin(), s.shadow.end(), 0);
+    if (detectShadows) {
+        rankWeights(weight, s.heavier.data(), K, W);
+        for (int k = 0; k < K; k++) {
+            const float *w = weight + k * W;
+            const float *v = variance + k * W;
+            const float *h = &s.heavier[k * W];
+            uchar *shadow = s.shadow.data();
+            for (int x = 0; x < W; x++) {
+                float numerator = 0.f, denominator = 0.f;
+                for (int c = 0; c < C; c++) {
+                    float m = mean[(k * C + c) * W + x];
+                    numerator += s.pix[c * W + x] * m;
+                    denominator += m * m;
+                }
+                float a = denominator > 0.f ? numerator / denominator : 0.f;
+                float dist2a = 0.f;
+                for (int c = 0; c < C; c++) {
+                    float diff = a * mean[(k * C + c) * W + x] - s.pix[c * W + x];
+                    dist2a += diff * diff;
+                }
+                bool fits = w[x] > 0.f && h[x] <= backgroundRatio && denominator > 0.f
+                        && a <= 1.f && a >= shadowThreshold && dist2a < varThreshold * v[x] * a * a;
+                shadow[x] |= uchar(fits);
+            }
+        }
+    }
+
+    for (int x = 0; x < W; x++)
+        mask[x] = s.background[x] ? 0 : (s.shadow[x] ? shadowValue : 255);
+}
+
+}
+
+SoaMixtureSubtractor::SoaMixtureSubtractor(int history, double varThreshold, int nmixtures, bool detectShadows, bool halfPrecision) :
+    fHistory(std::max(history, 1)),
+    fVarThreshold(float(varThreshold)),
+    fNmixtures(std::max(1, std::min(nmixtures, 16))),
+    fDetectShadows(detectShadows),
+    fHalfPrecision(halfPrecision),
+    fChannels(0),
+    fFrames(0)
+{
+}
+
+void SoaMixtureSubtractor::apply(cv::InputArray _image, cv::OutputArray _fgmask, double learningRate)
+{
+    TRACE_SPAN("SoaMixtureSubtractor::apply");
+    cv::Mat image = _image.getMat();
+    CV_Assert(image.depth() == CV_8U && image.channels() <= 4);
+
+    const int K = fNmixtures;
+    const int C = image.channels();
+    const int W = image.cols;
+    if (image.size() != fSize || C != fChannels) {
+        fSize = image.size();
+        fChannels = C;
+        fFrames = 0;
+        fWeights = cv::Mat::zeros(image.rows, K * W, fHalfPrecision ? CV_16F : CV_32F);
+        fState = cv::Mat::zeros(image.rows, K * (1 + C) * W, CV_32F);
+    }
+
+    ++fFrames;
+    const float alpha = float(learningRate >= 0 && fFrames > 1 ? learningRate : 1. / std::min(2 * fFrames, fHistory));
+
+    _fgmask.create(image.size(), CV_8UC1);
+    cv::Mat mask = _fgmask.getMat();
+
+    cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range &range) {
+        TRACE_SPAN("soa mixture rows");
+        RowScratch scratch;
+        scratch.resize(W, C, K, fHalfPrecision);
+        for (int y = range.start; y < range.end; y++) {
+            cv::Mat weightRow = fWeights.row(y);
+            float *state = fState.ptr<float>(y);
+            if (fHalfPrecision) {
+                cv::Mat wide(1, K * W, CV_32F, scratch.weights.data());
+                weightRow.convertTo(wide, CV_32F);
+                updateRow(image.ptr<uchar>(y), mask.ptr<uchar>(y), scratch.weights.data(), state, W, C, K, alpha, fVarThreshold, fDetectShadows, scratch);
+                wide.convertTo(weightRow, CV_16F);
+            }
+            else
+                updateRow(image.ptr<uchar>(y), mask.ptr<uchar>(y), weightRow.ptr<float>(), state, W, C, K, alpha, fVarThreshold, fDetectShadows, scratch);
+        }
+    });
+}
+
+void SoaMixtureSubtractor::getBackgroundImage(cv::OutputArray backgroundImage) const
+{
+    if (fState.empty()) {
+        backgroundImage.release();
+        return;
+    }
+
+    const int K = fNmixtures;
+    const int C = fChannels;
+    const int W = fSize.width;
+    backgroundImage.create(fSize, CV_8UC(C));
+    cv::Mat result = backgroundImage.getMat();
+    cv::Mat wide;
+    for (int y = 0; y < fSize.height; y++) {
+        fWeights.row(y).convertTo(wide, CV_32F);
+        const float *weight = wide.ptr<float>();
+        const float *mean = fState.ptr<float>(y) + K * W;
+        uchar *d = result.ptr<uchar>(y);
+        for (int x = 0; x < W; x++) {
+            int heaviest = 0;
+            for (int k = 1; k < K; k++) {
+                if (weight[k * W + x] > weight[heaviest * W + x])
+                    heaviest = k;
+            }
+            for (int c = 0; c < C; c++)
+                d[x * C + c] = cv::saturate_cast<uchar>(mean[(heaviest * C + c) * W + x]);
+        }
+    }
+}
+
+MaskAgreement compareMasks(const cv::Mat &a, const cv::Mat &b)
+{
+    CV_Assert(a.size() == b.size() && a.type() == CV_8UC1 && b.type() == CV_8UC1);
+    MaskAgreement result;
+    int64 same = 0, intersection = 0, unionCount = 0;
+    for (int y = 0; y < a.rows; y++) {
+        const uchar *pa = a.ptr<uchar>(y);
+        const uchar *pb = b.ptr<uchar>(y);
+        for (int x = 0; x < a.cols; x++) {
+            bool fa = pa[x] > shadowValue;
+            bool fb = pb[x] > shadowValue;
+            same += fa == fb;
+            intersection += fa && fb;
+            unionCount += fa || fb;
+        }
+    }
+    result.pixels = a.total() ? double(same) / a.total() : 1.;
+    result.foregroundIoU = unionCount ? double(intersection) / unionCount : 1.;
+    return result;
+}
+
+} // namespace OpencvKernels
@@ -0,0 +1,58 @@
+#ifndef SOAMIXTURE_H
+#define SOAMIXTURE_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/video/background_segm.hpp>
+
+// Gaussian-mixture background model after Zivkovic, the algorithm behind
+// MOG2, with the per-pixel state kept as structure of arrays: for every row
+// the weights, variances and channel means of component k are contiguous
+// runs over x. The update walks components in the outer and pixels in the
+// inner loops without branches, so the inner loops vectorize, and rows are
+// processed in parallel. The weights may be stored in half precision, each row
+// is widened to float while it is updated; variances and means stay in float,
+// half of them loses the updates of about 1/history a slow background makes.
+//
+// Unlike MOG2 the components are not kept sorted and their count is fixed;
+// a pixel matches the heaviest component within the generation threshold,
+// which is the component MOG2 finds first in its sorted list.
+namespace OpencvKernels {
+
+class SoaMixtureSubtractor : public cv::BackgroundSubtractor
+{
+public:
+    // the defaults are those of cv::createBackgroundSubtractorMOG2
+    SoaMixtureSubtractor(int history = 500, double varThreshold = 16, int nmixtures = 5,
+                         bool detectShadows = true, bool halfPrecision = false);
+
+    void apply(cv::InputArray image, cv::OutputArray fgmask, double learningRate = -1) override;
+    void getBackgroundImage(cv::OutputArray backgroundImage) const override;
+
+    // bytes held for the per-pixel state
+    size_t stateSize() const { return fWeights.total() * fWeights.elemSize() + fState.total() * fState.elemSize(); }
+
+private:
+    int fHistory;
+    float fVarThreshold;
+    int fNmixtures;
+    bool fDetectShadows;
+    bool fHalfPrecision;
+
+    cv::Size fSize;
+    int fChannels;
+    int fFrames;
+    cv::Mat fWeights;       // one row per image row, nmixtures * cols
+    cv::Mat fState;         // one row per image row: variances, means, each nmixtures * cols
+};
+
+// how closely two masks agree, shadows (values up to 127) count as background
+struct MaskAgreement {
+    double  pixels;         // share of pixels with the same decision
+    double  foregroundIoU;  // intersection over union of the foregrounds, 1 when both are empty
+};
+
+MaskAgreement compareMasks(const cv::Mat &a, const cv::Mat &b);
+
+} // namespace OpencvKernels
+
+#endif // SOAMIXTURE_H
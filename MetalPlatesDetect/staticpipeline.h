@@ -0,0 +1,305 @@
+#ifndef STATICPIPELINE_H
+#define STATICPIPELINE_H
+
+#include "opencvkernels.h"
+#include "fastmorphology.h"
+#include "labclahe.h"
+#include "memoryaccounting.h"
+
+// Compile-time composed stage chains for the fixed production pipeline.
+// Stages are plain classes with InputChannels/OutputChannels, an Optional
+// flag and a non-virtual process(); they call the same kernels as the tool
+// widgets so a chain produces exactly the masks of the equivalent widget
+// pipeline. Optional stages only refine the result and may be skipped.
+// Stage names are what the memory accounting charges their buffers to.
+// framesIndependent() tells whether the frames of a batch may be processed
+// in any order and concurrently, stages keeping state across frames say no.
+// Stages of tools that can be switched off in the GUI pass the frame on when
+// disabled, as the plan elides the tool.
+
+class ClaheStage
+{
+public:
+    enum { InputChannels = 3, OutputChannels = 3, Optional = 0 };
+    static const char *name() { return "ClaheStage"; }
+    bool framesIndependent() const { return true; }
+
+    ClaheStage() : fEnabled(true) {}
+
+    void setParams(const OpencvKernels::ClaheParams &params) { fParams = params; }
+    const OpencvKernels::ClaheParams &params() const { return fParams; }
+    void setEnabled(bool enabled) { fEnabled = enabled; }
+    bool enabled() const { return fEnabled; }
+
+    void process(const cv::Mat &src, cv::Mat &dst)
+    {
+        if (fEnabled)
+            OpencvKernels::claheLab(src, dst, fParams);
+        else
+            dst = src;
+    }
+
+private:
+    OpencvKernels::ClaheParams fParams;
+    bool fEnabled;
+};
+
+// Mirrors OpencvSeparateChannelsToolWidget: converts to the mode and keeps
+// one channel (Planes 1), or all planes (Planes 3). The plane count is what
+// the chain is typed by, the mode and the channel are set from the settings.
+// BGR with all planes forwards the frame untouched.
+template <int Planes>
+class SeparateChannelsStage
+{
+public:
+    static_assert(Planes == 1 || Planes == 3, "a single plane or all of them");
+    enum { InputChannels = 3, OutputChannels = Planes, Optional = 0 };
+    static const char *name() { return "SeparateChannelsStage"; }
+    bool framesIndependent() const { return true; }
+
+    SeparateChannelsStage() { fParams.channel = Planes == 1 ? 0 : -1; }
+
+    // true if the parameters give the plane count of the stage
+    static bool fits(const OpencvKernels::SeparateChannelsParams &params) { return (params.channel < 0) == (Planes == 3); }
+    void setParams(const OpencvKernels::SeparateChannelsParams &params) { CV_Assert(fits(params)); fParams = params; }
+    const OpencvKernels::SeparateChannelsParams &params() const { return fParams; }
+
+    // the output is the input itself
+    bool forwardsInput() const { return fParams.mode == OpencvKernels::modeBGR && fParams.channel < 0; }
+
+    void process(const cv::Mat &src, cv::Mat &dst)
+    {
+        if (forwardsInput())
+            dst = src;
+        else
+            OpencvKernels::separateChannel(src, dst, fParams.mode, fParams.channel);
+    }
+
+private:
+    OpencvKernels::SeparateChannelsParams fParams;
+};
+
+template <OpencvKernels::BackgroundAlgo Algo, int Channels = 3>
+class BackgroundSubtractorStage
+{
+public:
+    enum { InputChannels = Channels, OutputChannels = 1, Optional = 0 };
+    static const char *name() { return "BackgroundSubtractorStage"; }
+    bool framesIndependent() const { return !fParams.continuousModel; }
+
+    BackgroundSubtractorStage() { fParams.algo = Algo; }
+
+    // the algorithm is fixed by the template argument
+    void setParams(const OpencvKernels::BackgroundSubtractorParams &params) { fParams = params; fParams.algo = Algo; }
+    const OpencvKernels::BackgroundSubtractorParams &params() const { return fParams; }
+    void setBackground(const cv::Mat &background) { fBackground = background; }
+    const cv::Mat &background() const { return fBackground; }
+    uint64_t modelResetCount() const { return fModel.resetCount(); }
+
+    void process(const cv::Mat &src, cv::Mat &dst)
+    {
+        if (fParams.continuousModel)
+            fModel.apply(fParams, fBackground, src, dst);
+        else
+            OpencvKernels::subtractBackground(fParams, fBackground, src, dst);
+    }
+
+private:
+    OpencvKernels::BackgroundSubtractorParams fParams;
+    OpencvKernels::BackgroundModel fModel;
+    cv::Mat fBackground;
+};
+
+class MorphologyStage
+{
+public:
+    enum { InputChannels = 1, OutputChannels = 1, Optional = 1 };
+    static const char *name() { return "MorphologyStage"; }
+    bool framesIndependent() const { return true; }
+
+    MorphologyStage() : fEnabled(true) {}
+
+    void setParams(const OpencvKernels::MorphologyParams &params) { fParams = params; }
+    const OpencvKernels::MorphologyParams &params() const { return fParams; }
+    void setEnabled(bool enabled) { fEnabled = enabled; }
+    bool enabled() const { return fEnabled; }
+    bool supportsRegions() const { return !fEnabled || fParams.supportsRegions(); }
+
+    // a region of a whole mask reads the mask around it, see cleanupMaskRegion()
+    void process(const cv::Mat &src, cv::Mat &dst)
+    {
+        if (!fEnabled)
+            src.copyTo(dst);
+        else if (src.isSubmatrix())
+            OpencvKernels::cleanupMaskRegion(src, dst, fParams);
+        else
+            OpencvKernels::cleanupMask(src, dst, fParams);
+    }
+
+private:
+    OpencvKernels::MorphologyParams fParams;
+    bool fEnabled;
+};
+
+template <typename Stage>
+void processStageBatch(Stage &stage, const std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst)
+{
+    dst.resize(src.size());
+    OpencvKernels::processFrames(int(src.size()), stage.framesIndependent(), [&](int i) { stage.process(src[i], dst[i]); });
+}
+
+template <typename... Stages>
+class StaticPipeline;
+
+template <int Index, typename Pipeline>
+struct StaticPipelineStage
+{
+    typedef typename StaticPipelineStage<Index - 1, typename Pipeline::Tail>::Type Type;
+    static Type &get(Pipeline &pipeline) { return StaticPipelineStage<Index - 1, typename Pipeline::Tail>::get(pipeline.tail()); }
+};
+
+template <typename Pipeline>
+struct StaticPipelineStage<0, Pipeline>
+{
+    typedef typename Pipeline::Head Type;
+    static Type &get(Pipeline &pipeline) { return pipeline.head(); }
+};
+
+template <typename Last>
+class StaticPipeline<Last>
+{
+public:
+    typedef Last Head;
+    enum { InputChannels = Last::InputChannels, OutputChannels = Last::OutputChannels, StageCount = 1 };
+    static_assert(!Last::Optional || int(Last::InputChannels) == int(Last::OutputChannels), "an optional stage must keep the channel count");
+
+    StaticPipeline() : fSkipOptional(false), fHeadMs(0) {}
+
+    void process(const cv::Mat &src, cv::Mat &dst)
+    {
+        int64 start = cv::getTickCount();
+        MemoryAccounting::StageScope memoryScope(memoryStage());
+        if (fSkipOptional && Last::Optional)
+            src.copyTo(dst);
+        else
+            fHead.process(src, dst);
+        fHeadMs = (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+    }
+
+    void processBatch(const std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst)
+    {
+        int64 start = cv::getTickCount();
+        MemoryAccounting::StageScope memoryScope(memoryStage());
+        if (fSkipOptional && Last::Optional) {
+            dst.resize(src.size());
+            for (size_t i = 0; i < src.size(); i++)
+                src[i].copyTo(dst[i]);
+        }
+        else
+            processStageBatch(fHead, src, dst);
+        fHeadMs = (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+    }
+
+    void setSkipOptional(bool skip) { fSkipOptional = skip; }
+    // time the stage took in the last process() or processBatch() call
+    double stageMs(int index) const { return index == 0 ? fHeadMs : 0; }
+
+    Head &head() { return fHead; }
+    template <int Index>
+    typename StaticPipelineStage<Index, StaticPipeline>::Type &stage() { return StaticPipelineStage<Index, StaticPipeline>::get(*this); }
+
+private:
+    Head fHead;
+    bool fSkipOptional;
+    double fHeadMs;
+
+    static int memoryStage() { static const int stage = MemoryAccounting::instance().stageId(Last::name()); return stage; }
+};
+
+template <typename First, typename... Rest>
+class StaticPipeline<First, Rest...>
+{
+public:
+    typedef First Head;
+    typedef StaticPipeline<Rest...> Tail;
+    enum { InputChannels = First::InputChannels, OutputChannels = Tail::OutputChannels, StageCount = 1 + Tail::StageCount };
+    static_assert(int(First::OutputChannels) == int(Tail::InputChannels), "adjacent pipeline stages disagree on the channel count");
+    static_assert(!First::Optional || int(First::InputChannels) == int(First::OutputChannels), "an optional stage must keep the channel count");
+
+    StaticPipeline() : fSkipOptional(false), fHeadMs(0) {}
+
+    // the intermediate buffer is reused from frame to frame
+    void process(const cv::Mat &src, cv::Mat &dst)
+    {
+        if (fSkipOptional && First::Optional) {
+            fHeadMs = 0;
+            fTail.process(src, dst);
+            return;
+        }
+        int64 start = cv::getTickCount();
+        {
+            MemoryAccounting::StageScope memoryScope(memoryStage());
+            fHead.process(src, fIntermediate);
+        }
+        fHeadMs = (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+        fTail.process(fIntermediate, dst);
+    }
+
+    // every stage takes the whole batch before the next one does, so a stage's
+    // setup is paid once per batch; the intermediate buffers are reused between batches
+    void processBatch(const std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst)
+    {
+        if (fSkipOptional && First::Optional) {
+            fHeadMs = 0;
+            fTail.processBatch(src, dst);
+            return;
+        }
+        int64 start = cv::getTickCount();
+        {
+            MemoryAccounting::StageScope memoryScope(memoryStage());
+            processStageBatch(fHead, src, fBatchIntermediate);
+        }
+        fHeadMs = (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+        fTail.processBatch(fBatchIntermediate, dst);
+    }
+
+    void setSkipOptional(bool skip) { fSkipOptional = skip; fTail.setSkipOptional(skip); }
+    double stageMs(int index) const { return index == 0 ? fHeadMs : fTail.stageMs(index - 1); }
+
+    Head &head() { return fHead; }
+    Tail &tail() { return fTail; }
+    // what the head stage wrote in the last process() call, the input of the tail
+    cv::Mat &headOutput() { return fIntermediate; }
+    template <int Index>
+    typename StaticPipelineStage<Index, StaticPipeline>::Type &stage() { return StaticPipelineStage<Index, StaticPipeline>::get(*this); }
+
+private:
+    Head fHead;
+    Tail fTail;
+    cv::Mat fIntermediate;
+    std::vector<cv::Mat> fBatchIntermediate;
+    bool fSkipOptional;
+    double fHeadMs;
+
+    static int memoryStage() { static const int stage = MemoryAccounting::instance().stageId(First::name()); return stage; }
+};
+
+// glare suppression -> separate channels -> GSOC -> mask cleanup, as configured on the production line;
+// the headless path refuses settings that configure another algorithm. GSOC models colour frames,
+// so the channels keep all planes (see PipelineSettings::ToolParams)
+typedef StaticPipeline<
+    ClaheStage,
+    SeparateChannelsStage<3>,
+    BackgroundSubtractorStage<OpencvKernels::GSOC>,
+    MorphologyStage
+> ProductionPipeline;
+
+// what the latency governor falls back to when the budget is at risk
+typedef StaticPipeline<
+    ClaheStage,
+    SeparateChannelsStage<3>,
+    BackgroundSubtractorStage<OpencvKernels::cheapBackgroundAlgo>,
+    MorphologyStage
+> FallbackPipeline;
+
+#endif // STATICPIPELINE_H
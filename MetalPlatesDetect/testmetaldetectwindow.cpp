@@ -1,7 +1,14 @@
 #include "testmetaldetectwindow.h"
 #include "ui_testmetaldetectwindow.h"
 #include "opencvtoolwidgets.h"
+#include "pipelinesettings.h"
+#include "metricsserver.h"
+#include "memoryaccounting.h"
+#include "threadaffinity.h"
+#include "configwatcher.h"
+#include <QDateTime>
 #include <QFileDialog>
+#include <QDebug>
 
 
 #include <opencv2/imgcodecs.hpp>
@@ -11,7 +18,12 @@
 TestMetalDetectWindow::TestMetalDetectWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::TestMetalDetectWindow),
-    m_settings("config.ini", QSettings::IniFormat)
+    m_settings("config.ini", QSettings::IniFormat),
+    fMetricsServer(new MetricsServer(&fMetrics, this)),
+    fMetricsPort(0),
+    fMemoryAccounting(false),
+    fMaskTool(-1),
+    fConfigListener(nullptr)
 {
     ui->setupUi(this);
 
@@ -21,39 +33,111 @@ TestMetalDetectWindow::TestMetalDetectWindow(QWidget *parent) :
 
     ui->toolBox->removeItem(0);
 
+    fProcessList.append(new OpencvMotionGateToolWidget());
+    ui->toolBox->addItem(fProcessList.last(), "Motion gate");
+    ui->cbResultView->addItem("Motion gate");
+
+    fProcessList.append(new OpencvClaheToolWidget());
+    ui->toolBox->addItem(fProcessList.last(), "Glare suppression (CLAHE)");
+    ui->cbResultView->addItem("Glare suppression");
+
     fProcessList.append(new OpencvSeparateChannelsToolWidget());
-    fResultViewList.append(cv::Mat());
     ui->toolBox->addItem(fProcessList.last(), "Separate Channels");
     ui->cbResultView->addItem("Separate channels");
 
     fProcessList.append(new OpencvBackgroundSubtractorToolWidget());
-    fResultViewList.append(cv::Mat());
     ui->toolBox->addItem(fProcessList.last(), "Background subtractor");
     ui->cbResultView->addItem("Background subtractor");
 
+    fProcessList.append(new OpencvMorphologyToolWidget());
+    ui->toolBox->addItem(fProcessList.last(), "Mask cleanup");
+    ui->cbResultView->addItem("Mask cleanup");
+    fMaskTool = fProcessList.count() - 1;
+
+    fProcessList.append(new OpencvPlateTrackerToolWidget());
+    ui->toolBox->addItem(fProcessList.last(), "Plate tracker");
+    ui->cbResultView->addItem("Plate tracker");
+
+    std::vector<std::string> stageNames;
+    for (int i = 0; i < ui->toolBox->count(); i++)
+        stageNames.push_back(ui->toolBox->itemText(i).toStdString());
+    fMetrics.setStageNames(stageNames);
+    fPlan.setMetrics(&fMetrics);
+
     connect(ui->pbLoadOriginal, SIGNAL(clicked(bool)), this, SLOT(loadOriginal()));
     connect(ui->cbResultView, SIGNAL(currentIndexChanged(int)), this, SLOT(resultViewIndexChanged(int)));
     connect(ui->pbProcess, SIGNAL(clicked(bool)), this, SLOT(process()));
+    foreach (auto tool, fProcessList) {
+        connect(tool, SIGNAL(topologyChanged()), this, SLOT(invalidatePlan()));
+        connect(tool, SIGNAL(parametersChanged()), this, SLOT(toolParametersChanged()));
+    }
 
     loadSettings();
+    if (fMetricsPort > 0)
+        fMetricsServer->start(quint16(fMetricsPort));
+    fConfigListener = new ConfigListener(m_settings.fileName(), [this]() { reloadToolSettings(); }, this);
 }
 
 TestMetalDetectWindow::~TestMetalDetectWindow()
 {
     saveSettings();
+    // the server reads fMetrics, which goes before the children are deleted
+    fMetricsServer->stop();
+    if (Tracing::enabled() && !Tracing::writeChromeTrace(fTraceFile.toStdString()))
+        qWarning() << "Can't write trace" << fTraceFile;
 
     delete ui;
 }
 
 void TestMetalDetectWindow::loadSettings()
 {
+    // the plan runs on this thread, pinned like stream 0 of the headless path
+    m_settings.beginGroup(PipelineSettings::AffinityGroup);
+    fStreamCores = PipelineSettings::readStreamCores(&m_settings, 0);
+    m_settings.endGroup();
+    if (!fStreamCores.isEmpty() && !ThreadAffinity::pinStream(ThreadAffinity::parseCores(fStreamCores.toStdString())))
+        qWarning() << "Can't pin to cores" << fStreamCores;
+
+    // first, so the buffers the tools load come from the arena and are counted;
+    // the accounting goes in front of the arena
+    m_settings.beginGroup(PipelineSettings::FrameArenaGroup);
+    fFrameArena = PipelineSettings::readFrameArenaParams(&m_settings);
+    m_settings.endGroup();
+    if (fFrameArena.enabled && !FrameArenaAllocator::instance().install(fFrameArena))
+        qWarning() << "Can't reserve" << fFrameArena.sizeMB << "MB for the frame arena";
+
+    m_settings.beginGroup(PipelineSettings::MemoryGroup);
+    fMemoryAccounting = PipelineSettings::readMemoryAccounting(&m_settings);
+    m_settings.endGroup();
+    if (fMemoryAccounting && !MemoryAccounting::instance().isInstalled())
+        MemoryAccounting::instance().install();
+
     m_settings.beginGroup("TestMetalDetectWindow");
     ui->splitter->restoreState(m_settings.value("MainSplitter").toByteArray());
     fOriginalImagePath = m_settings.value("OriginalImagePath").toString();
     m_settings.endGroup();
 
+    m_settings.beginGroup(PipelineSettings::MetricsGroup);
+    fMetricsPort = PipelineSettings::readMetricsPort(&m_settings);
+    m_settings.endGroup();
+
+    m_settings.beginGroup(PipelineSettings::TracingGroup);
+    fTraceFile = PipelineSettings::readTraceFile(&m_settings);
+    m_settings.endGroup();
+    if (!fTraceFile.isEmpty()) {
+        Tracing::setThreadName("GUI");
+        Tracing::setEnabled(true);
+    }
+
+    m_settings.beginGroup(PipelineSettings::OutputRingGroup);
+    fOutputRingParams = PipelineSettings::readOutputRingParams(&m_settings);
+    m_settings.endGroup();
+    if (!fOutputRingParams.name.empty() && !fOutputRing.open(fOutputRingParams))
+        qWarning() << "Can't create the output ring" << QString::fromStdString(fOutputRingParams.name);
+
     foreach (auto tool, fProcessList) {
         tool->loadSettings(&m_settings);
+        tool->loadEnabled(&m_settings);
     }
 
     if (!fOriginalImagePath.isEmpty())
@@ -67,27 +151,42 @@ void TestMetalDetectWindow::saveSettings()
     m_settings.setValue("OriginalImagePath", fOriginalImagePath);
     m_settings.endGroup();
 
+    m_settings.beginGroup(PipelineSettings::MetricsGroup);
+    PipelineSettings::writeMetricsPort(&m_settings, fMetricsPort);
+    m_settings.endGroup();
+
+    m_settings.beginGroup(PipelineSettings::TracingGroup);
+    PipelineSettings::writeTraceFile(&m_settings, fTraceFile);
+    m_settings.endGroup();
+
+    m_settings.beginGroup(PipelineSettings::AffinityGroup);
+    PipelineSettings::writeStreamCores(&m_settings, 0, fStreamCores);
+    m_settings.endGroup();
+
+    m_settings.beginGroup(PipelineSettings::FrameArenaGroup);
+    PipelineSettings::writeFrameArenaParams(&m_settings, fFrameArena);
+    m_settings.endGroup();
+
+    m_settings.beginGroup(PipelineSettings::MemoryGroup);
+    PipelineSettings::writeMemoryAccounting(&m_settings, fMemoryAccounting);
+    m_settings.endGroup();
+
+    m_settings.beginGroup(PipelineSettings::OutputRingGroup);
+    PipelineSettings::writeOutputRingParams(&m_settings, fOutputRingParams);
+    m_settings.endGroup();
+
     foreach (auto tool, fProcessList) {
         tool->saveSettings(&m_settings);
+        tool->saveEnabled(&m_settings);
     }
 }
 
-void TestMetalDetectWindow::resizeEvent(QResizeEvent*)
-{
-    resultViewIndexChanged(ui->cbResultView->currentIndex());
-}
-
 void TestMetalDetectWindow::loadOriginal(QString path)
 {
+    TRACE_SPAN("decode original");
     fOriginalImage = cv::imread( path.toStdString(), cv::IMREAD_UNCHANGED );
     QImage resultImg = QImage( fOriginalImage.data, fOriginalImage.cols, fOriginalImage.rows, fOriginalImage.step, QImage::Format_RGB888 ).copy();
-    lbView->setScaledPixmap(
-        QPixmap::fromImage( resultImg ).scaled(
-            lbView->size(),
-            Qt::KeepAspectRatio,
-            Qt::SmoothTransformation
-        )
-    );
+    lbView->postFrame(resultImg);
 }
 
 void TestMetalDetectWindow::loadOriginal()
@@ -99,70 +198,86 @@ void TestMetalDetectWindow::loadOriginal()
     }
 }
 
+void TestMetalDetectWindow::reloadToolSettings()
+{
+    m_settings.sync();
+    // changed values invalidate the plan from their tool on, the model is only
+    // rebuilt when the subtractor parameters differ
+    foreach (auto tool, fProcessList) {
+        tool->loadSettings(&m_settings);
+        tool->loadEnabled(&m_settings);
+    }
+}
+
+void TestMetalDetectWindow::invalidatePlan()
+{
+    fPlan.invalidate();
+}
+
+void TestMetalDetectWindow::toolParametersChanged()
+{
+    fPlan.invalidateFrom(qobject_cast<OpencvBaseToolWidget*>(sender()));
+}
+
+// only the tools up to the viewed one (and the sinks) run, switching the view
+// to a later tool runs the rest on the same frame
 void TestMetalDetectWindow::resultViewIndexChanged(int index)
 {
     QImage resultImg;
     if (!index) {
+        TRACE_SPAN("QImage conversion");
         resultImg = QImage( fOriginalImage.data, fOriginalImage.cols, fOriginalImage.rows, fOriginalImage.step, QImage::Format_RGB888 ).copy();
     }
     else {
-        cv::Mat src = fResultViewList[index-1];
-        resultImg = QImage( src.data, src.cols, src.rows, src.step, QImage::Format_Grayscale8 ).copy();
+        cv::Mat src = fPlan.result(index-1);
+        TRACE_SPAN("QImage conversion");
+        QImage::Format format = src.channels() == 3 ? QImage::Format_RGB888 : QImage::Format_Grayscale8;
+        resultImg = QImage( src.data, src.cols, src.rows, src.step, format ).copy();
+    }
+
+    lbView->postFrame(resultImg);
+    QString message = QString("Frames posted: %1, displayed: %2, dropped: %3")
+            .arg(lbView->postedFrames())
+            .arg(lbView->displayedFrames())
+            .arg(lbView->droppedFrames());
+    const MemoryAccounting &memory = MemoryAccounting::instance();
+    if (memory.isInstalled()) {
+        message += QString(", memory live %1 MB, peak %2 MB, %3 allocations last frame%4")
+                .arg(memory.liveBytes() / (1024. * 1024), 0, 'f', 1)
+                .arg(memory.peakBytes() / (1024. * 1024), 0, 'f', 1)
+                .arg(memory.frameAllocations())
+                .arg(memory.leakSuspected() ? ", growing steadily" : "");
+        ui->statusBar->setToolTip(QString::fromStdString(memory.describe()).trimmed());
     }
+    ui->statusBar->showMessage(message);
+    publishMetrics();
+}
 
-    lbView->setScaledPixmap(
-        QPixmap::fromImage( resultImg ).scaled(
-            lbView->size(),
-            Qt::KeepAspectRatio,
-            Qt::SmoothTransformation
-        )
-    );
+void TestMetalDetectWindow::publishMetrics()
+{
+    uint64_t resets = 0;
+    foreach (auto tool, fProcessList)
+        resets += tool->modelResetCount();
+    fMetrics.setModelResets(resets);
+    fMetrics.setDroppedFrames(lbView->droppedFrames());
+    fMetrics.setQueueDepth(lbView->pendingFrames());
 }
 
 void TestMetalDetectWindow::process()
 {
-    for (int i = 0; i < fProcessList.count(); i++) {
-        auto processor = fProcessList[i];
-        if (!processor->toolIsEnabled()) {
-            fResultViewList[i] = i > 0 ? fResultViewList[i-1] : fOriginalImage;
-            continue;
-        }
-        cv::Mat dst;
-        if (!i)
-            processor->process(&fOriginalImage, &dst);
-        else {
-            cv::Mat src = fResultViewList[i-1];
-            processor->process(&src, &dst);
-        }
-        fResultViewList[i] = dst;
-//        cv::imshow( "Background", dst );
-//        cv::imshow( "Background1", fResultViewList[i] );
-    }
+    if (fOriginalImage.empty())
+        return;
+    if (!fPlan.isCompiledFor(fOriginalImage))
+        fPlan.compile(fProcessList, fOriginalImage);
+    fPlan.setInput(fOriginalImage);
+    // pulls the viewed output, the frame's work is done after it
     resultViewIndexChanged(ui->cbResultView->currentIndex());
-
-//    cv::Mat img, img2;
-//    img = fOriginalImage;
-//    cv::cvtColor(fOriginalImage, img2, cv::COLOR_RGB2Lab/*COLOR_BGR2GRAY*/);
-
-//    // Extract the L channel
-//        std::vector<cv::Mat> lab_planes(3);
-//        cv::split(img2, lab_planes);  // now we have the L image in lab_planes[0]
-
-////    cv::Mat img3, img4;
-//    cv::Ptr<cv::CLAHE> clane = cv::createCLAHE();
-//    clane->setClipLimit(4);
-//    cv::Mat dst;
-//    clane->apply(lab_planes[0], dst);
-
-//    // Merge the the color planes back into an Lab image
-//    dst.copyTo(lab_planes[0]);
-//    cv::merge(lab_planes, img2);
-
-//    // convert back to RGB
-//       cv::Mat image_clahe;
-//       cv::cvtColor(img2, image_clahe, cv::COLOR_Lab2RGB);
-//       cv::imshow( "CLAHE", img2 );
-
-////    cv::cvtColor(img3, img4, cv::COLOR_Lab2RGB/*COLOR_GRAY2BGR*/);
-//    cv::imshow( "CLAHE 2", image_clahe );
+    if (fOutputRing.isOpen()) {
+        // consumers need the mask whatever is viewed
+        const int64_t timeUs = QDateTime::currentMSecsSinceEpoch() * 1000;
+        fOutputRing.publish(ShmRing::payloadFrame, 0, timeUs, fOriginalImage);
+        fOutputRing.publish(ShmRing::payloadMask, 0, timeUs, fPlan.result(fMaskTool));
+    }
+    if (MemoryAccounting::instance().isInstalled() && MemoryAccounting::instance().endFrame())
+        qWarning().noquote() << "Memory keeps growing, possible leak:\n" << QString::fromStdString(MemoryAccounting::instance().describe());
 }
@@ -4,10 +4,20 @@
 #include <QMainWindow>
 #include <QSettings>
 #include <QPainter>
+#include <QGuiApplication>
+#include <QScreen>
 #include <opencv2/core.hpp>
+#include "triplebuffer.h"
+#include "pipelineplan.h"
+#include "pipelinemetrics.h"
+#include "tracing.h"
+#include "framearena.h"
+#include "shmring.h"
 
 class OpencvBaseToolWidget;
 class ScaledPixmap;
+class MetricsServer;
+class ConfigListener;
 
 namespace Ui {
 class TestMetalDetectWindow;
@@ -23,9 +33,6 @@ public:
     void loadSettings();
     void saveSettings();
 
-protected:
-    void resizeEvent(QResizeEvent*) override;
-
 private:
     Ui::TestMetalDetectWindow *ui;
     ScaledPixmap *lbView;
@@ -34,27 +41,66 @@ private:
     QString fOriginalImagePath;
 
     QList<OpencvBaseToolWidget*> fProcessList;
-    QList<cv::Mat> fResultViewList;
+    PipelinePlan fPlan;
+    PipelineMetrics fMetrics;
+    MetricsServer *fMetricsServer;
+    int fMetricsPort;
+    QString fTraceFile;
+    bool fMemoryAccounting;
+    FrameArenaAllocator::Params fFrameArena;
+    QString fStreamCores;
+    ShmRing::Params fOutputRingParams;
+    ShmRing::Producer fOutputRing;
+    int fMaskTool;      // its result is published to the output ring
+    ConfigListener *fConfigListener;
 
     void loadOriginal(QString path);
+    void publishMetrics();
+    // the tools take edits of config.ini made outside, applied with the next frame
+    void reloadToolSettings();
 
 private slots:
     void loadOriginal();
     void resultViewIndexChanged(int);
     void process();
+    void invalidatePlan();
+    void toolParametersChanged();
 };
 
 class ScaledPixmap : public QWidget {
 public:
-    ScaledPixmap(QWidget *parent = 0) : QWidget(parent) {}
+    ScaledPixmap(QWidget *parent = 0) : QWidget(parent) {
+        qreal refreshRate = QGuiApplication::primaryScreen() ? QGuiApplication::primaryScreen()->refreshRate() : 60;
+        startTimer(qMax(1, qRound(1000 / qMax(refreshRate, qreal(1)))), Qt::PreciseTimer);
+    }
     void setScaledPixmap(const QPixmap &pixmap) {
         m_pixmap = pixmap;
         update();
     }
-    QSize ScaledPixmap::sizeHint() const override {
+    // Can be called from any thread and never blocks. Only the newest frame
+    // posted between two display refreshes is shown, the rest are dropped.
+    void postFrame(const QImage &image) {
+        m_frames.writeBuffer() = image;
+        m_frames.publish();
+    }
+    quint64 postedFrames() const { return m_frames.publishedCount(); }
+    quint64 droppedFrames() const { return m_frames.droppedCount(); }
+    quint64 displayedFrames() const { return m_frames.consumedCount(); }
+    int pendingFrames() const { return m_frames.hasPending() ? 1 : 0; }
+    QSize sizeHint() const override {
         return m_pixmap.size();
     }
 protected:
+    void timerEvent(QTimerEvent *) override {
+        if (m_frames.consume()) {
+            m_frame = m_frames.readBuffer();
+            rescaleFrame();
+        }
+    }
+    void resizeEvent(QResizeEvent *event) override {
+        rescaleFrame();
+        QWidget::resizeEvent(event);
+    }
     void paintEvent(QPaintEvent *event) {
         QPainter painter(this);
         if (false == m_pixmap.isNull()) {
@@ -69,6 +115,16 @@ protected:
 
 private:
     QPixmap m_pixmap;
+    QImage m_frame;
+    TripleBuffer<QImage> m_frames;
+
+    void rescaleFrame() {
+        if (m_frame.isNull())
+            return;
+        TRACE_SPAN("rescale frame");
+        m_pixmap = QPixmap::fromImage( m_frame.scaled(size(), Qt::KeepAspectRatio, Qt::SmoothTransformation) );
+        update();
+    }
 };
 
 #endif // TESTMETALDETECTWINDOW_H
@@ -0,0 +1,72 @@
+#include "threadaffinity.h"
+
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace ThreadAffinity {
+
+std::vector<int> parseCores(const std::string &spec)
+{
+    std::vector<int> cores;
+    std::stringstream items(spec);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        item.erase(std::remove(item.begin(), item.end(), ' '), item.end());
+        if (item.empty())
+            continue;
+        char *end = nullptr;
+        long first = std::strtol(item.c_str(), &end, 10);
+        long last = first;
+        if (*end == '-')
+            last = std::strtol(end + 1, &end, 10);
+        if (*end || first < 0 || last < first)
+            return std::vector<int>();
+        for (long core = first; core <= last; core++)
+            cores.push_back(int(core));
+    }
+    std::sort(cores.begin(), cores.end());
+    cores.erase(std::unique(cores.begin(), cores.end()), cores.end());
+    return cores;
+}
+
+bool pinCurrentThread(const std::vector<int> &cores)
+{
+    if (cores.empty())
+        return false;
+#ifdef _WIN32
+    DWORD_PTR mask = 0;
+    for (size_t i = 0; i < cores.size(); i++) {
+        if (cores[i] < int(sizeof(DWORD_PTR) * 8))
+            mask |= DWORD_PTR(1) << cores[i];
+    }
+    return mask && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cores.size(); i++) {
+        if (cores[i] < CPU_SETSIZE)
+            CPU_SET(cores[i], &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+bool pinStream(const std::vector<int> &cores)
+{
+    if (!pinCurrentThread(cores))
+        return false;
+    // the pool threads are started by the next parallel_for_ of this thread
+    cv::setNumThreads(int(cores.size()));
+    return true;
+}
+
+} // namespace ThreadAffinity
@@ -0,0 +1,25 @@
+#ifndef THREADAFFINITY_H
+#define THREADAFFINITY_H
+
+#include <string>
+#include <vector>
+
+// Pinning of the processing to a set of cores, one set per camera stream.
+// The thread that runs the pipeline is pinned before it starts any worker,
+// so the cv::parallel_for_ pool it creates inherits the set and the buffers
+// the workers touch first stay in the caches and on the memory node of
+// those cores.
+namespace ThreadAffinity {
+
+// "0-3,8" gives 0, 1, 2, 3 and 8; empty for an empty or malformed spec
+std::vector<int> parseCores(const std::string &spec);
+
+// pins the calling thread, threads it starts afterwards inherit the set
+bool pinCurrentThread(const std::vector<int> &cores);
+
+// pins the calling thread and sizes the OpenCV pool to the set
+bool pinStream(const std::vector<int> &cores);
+
+} // namespace ThreadAffinity
+
+#endif // THREADAFFINITY_H
@@ -0,0 +1,157 @@
+#include "tracing.h"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace Tracing {
+
+std::atomic<bool> gEnabled(false);
+
+namespace {
+
+const int chunkEvents = 4096;
+const int maxChunks = 256;      // 24 MB per thread, later spans are dropped
+
+struct Event {
+    const char *name;
+    int64_t startNs;
+    int64_t endNs;
+};
+
+// Filled by the owning thread only. The writer reads up to the published
+// count, so a chunk is never moved or resized once it is linked in.
+struct Chunk {
+    Chunk() : count(0), next(nullptr) {}
+    Event events[chunkEvents];
+    std::atomic<int> count;
+    std::atomic<Chunk*> next;
+};
+
+struct ThreadBuffer {
+    explicit ThreadBuffer(int id) : id(id), name(nullptr), tail(&head), chunks(1), dropped(0) {}
+    int id;
+    std::atomic<const char*> name;
+    Chunk head;
+    Chunk *tail;
+    int chunks;
+    std::atomic<uint64_t> dropped;
+};
+
+const std::chrono::steady_clock::time_point gEpoch = std::chrono::steady_clock::now();
+
+std::mutex gRegistryMutex;
+// kept after their threads end so their spans still get written
+std::vector<ThreadBuffer*> gBuffers;
+
+ThreadBuffer *threadBuffer()
+{
+    static thread_local ThreadBuffer *buffer = nullptr;
+    if (!buffer) {
+        std::lock_guard<std::mutex> lock(gRegistryMutex);
+        buffer = new ThreadBuffer(int(gBuffers.size()) + 1);
+        gBuffers.push_back(buffer);
+    }
+    return buffer;
+}
+
+void writeString(FILE *file, const char *text)
+{
+    fputc('"', file);
+    for (const char *c = text; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', file);
+        fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+}
+
+void setEnabled(bool enabled)
+{
+    gEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void setThreadName(const char *name)
+{
+    threadBuffer()->name.store(name, std::memory_order_relaxed);
+}
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - gEpoch).count();
+}
+
+void record(const char *name, int64_t startNs, int64_t endNs)
+{
+    ThreadBuffer *buffer = threadBuffer();
+    Chunk *chunk = buffer->tail;
+    int n = chunk->count.load(std::memory_order_relaxed);
+    if (n == chunkEvents) {
+        if (buffer->chunks == maxChunks) {
+            buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Chunk *next = new Chunk;
+        chunk->next.store(next, std::memory_order_release);
+        buffer->tail = chunk = next;
+        buffer->chunks++;
+        n = 0;
+    }
+    Event &event = chunk->events[n];
+    event.name = name;
+    event.startNs = startNs;
+    event.endNs = endNs;
+    chunk->count.store(n + 1, std::memory_order_release);
+}
+
+bool writeChromeTrace(const std::string &path)
+{
+    std::vector<ThreadBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> lock(gRegistryMutex);
+        buffers = gBuffers;
+    }
+
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file)
+        return false;
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+    bool first = true;
+    for (size_t b = 0; b < buffers.size(); b++) {
+        const ThreadBuffer *buffer = buffers[b];
+        const char *name = buffer->name.load(std::memory_order_relaxed);
+        char threadName[32];
+        if (!name) {
+            snprintf(threadName, sizeof(threadName), "thread %d", buffer->id);
+            name = threadName;
+        }
+        fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",", buffer->id);
+        writeString(file, name);
+        fputs("}}", file);
+        first = false;
+
+        uint64_t dropped = buffer->dropped.load(std::memory_order_relaxed);
+        if (dropped)
+            fprintf(file, ",\n{\"name\":\"dropped spans\",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":0,\"args\":{\"spans\":%llu}}",
+                    buffer->id, (unsigned long long)dropped);
+
+        for (const Chunk *chunk = &buffer->head; chunk; chunk = chunk->next.load(std::memory_order_acquire)) {
+            int count = chunk->count.load(std::memory_order_acquire);
+            for (int i = 0; i < count; i++) {
+                const Event &event = chunk->events[i];
+                fputs(",\n{\"name\":", file);
+                writeString(file, event.name);
+                fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                        buffer->id, event.startNs / 1000., (event.endNs - event.startNs) / 1000.);
+            }
+        }
+    }
+    fputs("\n]}\n", file);
+    return fclose(file) == 0;
+}
+
+} // namespace Tracing
@@ -0,0 +1,50 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Fine-grained timing spans for latency outliers, written out as Chrome
+// trace-event JSON (chrome://tracing, ui.perfetto.dev). Every thread records
+// into a buffer of its own, appending never locks; while tracing is off a
+// span costs one relaxed load. Span names must be string literals or
+// otherwise outlive the trace.
+namespace Tracing {
+
+extern std::atomic<bool> gEnabled;
+
+inline bool enabled() { return gEnabled.load(std::memory_order_relaxed); }
+void setEnabled(bool enabled);
+
+// shown instead of the thread number, call from the thread itself
+void setThreadName(const char *name);
+
+int64_t nowNs();
+void record(const char *name, int64_t startNs, int64_t endNs);
+
+// writes everything recorded so far, may run while other threads still record
+bool writeChromeTrace(const std::string &path);
+
+class Span
+{
+public:
+    explicit Span(const char *name) : fName(enabled() ? name : nullptr), fStart(fName ? nowNs() : 0) {}
+    ~Span() { if (fName) record(fName, fStart, nowNs()); }
+
+private:
+    const char *fName;
+    int64_t fStart;
+
+    Span(const Span&);
+    Span &operator=(const Span&);
+};
+
+} // namespace Tracing
+
+#define TRACE_SPAN_CONCAT2(a, b) a##b
+#define TRACE_SPAN_CONCAT(a, b) TRACE_SPAN_CONCAT2(a, b)
+// times the rest of the enclosing scope
+#define TRACE_SPAN(name) Tracing::Span TRACE_SPAN_CONCAT(traceSpan, __LINE__)(name)
+
+#endif // TRACING_H
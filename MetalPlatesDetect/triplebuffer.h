@@ -0,0 +1,71 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Single producer / single consumer triple buffer.
+// The producer always owns a slot of its own, so publish() never waits for the
+// consumer; the consumer only ever picks up the newest published slot and
+// everything published in between is counted as dropped.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() :
+        fState(packState(1, false)),
+        fWriteIndex(0),
+        fReadIndex(2),
+        fPublished(0),
+        fDropped(0),
+        fConsumed(0)
+    {}
+
+    // producer side
+    T &writeBuffer() { return fSlots[fWriteIndex]; }
+    void publish()
+    {
+        uint32_t prev = fState.exchange(packState(fWriteIndex, true), std::memory_order_acq_rel);
+        fWriteIndex = slotIndex(prev);
+        fPublished.fetch_add(1, std::memory_order_relaxed);
+        if (isFresh(prev))
+            fDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // consumer side, returns false if nothing new was published since the last call
+    bool consume()
+    {
+        if (!isFresh(fState.load(std::memory_order_acquire)))
+            return false;
+        uint32_t prev = fState.exchange(packState(fReadIndex, false), std::memory_order_acq_rel);
+        fReadIndex = slotIndex(prev);
+        fConsumed.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    const T &readBuffer() const { return fSlots[fReadIndex]; }
+    bool hasPending() const { return isFresh(fState.load(std::memory_order_acquire)); }
+
+    // counters, safe to read from any thread
+    uint64_t publishedCount() const { return fPublished.load(std::memory_order_relaxed); }
+    uint64_t droppedCount() const { return fDropped.load(std::memory_order_relaxed); }
+    uint64_t consumedCount() const { return fConsumed.load(std::memory_order_relaxed); }
+
+private:
+    static uint32_t packState(uint32_t index, bool fresh) { return index | (fresh ? 4u : 0u); }
+    static uint32_t slotIndex(uint32_t state) { return state & 3u; }
+    static bool isFresh(uint32_t state) { return (state & 4u) != 0; }
+
+    T fSlots[3];
+    std::atomic<uint32_t> fState;   // middle slot index + "not consumed yet" flag
+    uint32_t fWriteIndex;           // owned by the producer
+    uint32_t fReadIndex;            // owned by the consumer
+
+    std::atomic<uint64_t> fPublished;
+    std::atomic<uint64_t> fDropped;
+    std::atomic<uint64_t> fConsumed;
+
+    TripleBuffer(const TripleBuffer&);
+    TripleBuffer &operator=(const TripleBuffer&);
+};
+
+#endif // TRIPLEBUFFER_H